@@ -9,8 +9,9 @@
 
 // Initializes SDL (video and timer). SDL creates a window where you can draw.
 // A pointer to this SDL_Surface is returned. After calling this function
-// you can use the function PutPixelSDL to do the actual drawing.
-SDL_Surface* InitializeSDL( int width, int height, bool fullscreen = false );
+// you can use the function PutPixelSDL to do the actual drawing. With
+// doubleBuffer, SDL is asked for a hardware surface that SDL_Flip presents.
+SDL_Surface* InitializeSDL( int width, int height, bool fullscreen = false, bool doubleBuffer = false );
 
 // Checks all events/messages sent to the SDL program and returns true as long
 // as no quit event has been received.
@@ -27,7 +28,7 @@ bool NoQuitMessageSDL();
 // SDL_UpdateRect( surface, 0, 0, 0, 0 );
 void PutPixelSDL( SDL_Surface* surface, int x, int y, const glm::vec3& color );
 
-SDL_Surface* InitializeSDL( int width, int height, bool fullscreen )
+SDL_Surface* InitializeSDL( int width, int height, bool fullscreen, bool doubleBuffer )
 {
 	if( SDL_Init( SDL_INIT_VIDEO | SDL_INIT_TIMER ) < 0 )
 	{
@@ -39,6 +40,8 @@ SDL_Surface* InitializeSDL( int width, int height, bool fullscreen )
 	Uint32 flags = SDL_SWSURFACE;
 	if( fullscreen )
 		flags |= SDL_FULLSCREEN;
+	if( doubleBuffer )
+		flags = (flags & ~SDL_SWSURFACE) | SDL_HWSURFACE | SDL_DOUBLEBUF;
 
 	SDL_Surface* surface = nullptr;
 	surface = SDL_SetVideoMode( width, height, 32, flags );
@@ -0,0 +1,28 @@
+#ifndef PROJECT_ARGUMENTS_H
+#define PROJECT_ARGUMENTS_H
+
+#include <cmath>
+#include <cstdlib>
+#include <optional>
+
+/**
+ * Voxel size of a --bake option at argument i, shared by the command line tools. The size is optional, so only a
+ * number after it is taken as one, and i moves past it. Empty if the size is not a positive finite number.
+ */
+inline std::optional<float> ParseBakeOption(int argc, char *argv[], int &i) {
+    float size = 0.01f;
+    if (i + 1 < argc) {
+        char *end = nullptr;
+        float value = std::strtof(argv[i + 1], &end);
+        if (end != argv[i + 1] && *end == '\0') {
+            size = value;
+            ++i;
+        }
+    }
+    if (!std::isfinite(size) || size <= 0) {
+        return std::nullopt;
+    }
+    return size;
+}
+
+#endif //PROJECT_ARGUMENTS_H
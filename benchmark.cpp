@@ -0,0 +1,511 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "renderer.h"
+#include "examples.h"
+#include "scenefile.h"
+#include "arguments.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// Microbenchmarks of distance functions, operators and the tracer, and frame throughput of the example scenes.
+// Inputs come from a fixed seed and the name of each benchmark, so results can be compared across versions and
+// between filtered and full runs.
+
+using namespace sdf;
+
+struct Options {
+    double minTime = 0.2;
+    int width = 360;
+    int height = 360;
+    int frames = 3;
+    int tileSize = 32;
+    bool scaling = false;
+    // Voxel size of the distance caches baked into scenes before timing their frames, none if 0
+    float bake = 0;
+    unsigned seed = 42;
+    std::string filter;
+    std::string json;
+};
+
+struct Measurement {
+    std::string name;
+    double nsPerCall;
+    std::uint64_t calls;
+};
+
+struct FrameMeasurement {
+    std::string scene;
+    int width;
+    int height;
+    double milliseconds;
+    FrameStats stats;
+};
+
+struct ScalingMeasurement {
+    std::string scene;
+    int threads;
+    double milliseconds;
+    // Time on one thread over time on this many, and that per thread
+    double speedup;
+    double efficiency;
+    std::uint64_t steals;
+};
+
+// Accumulates results so the compiler cannot drop the measured calls
+volatile float sink;
+
+class Benchmark {
+public:
+    explicit Benchmark(const Options &options) : options(options) {
+        std::mt19937 random = generator("points");
+        std::uniform_real_distribution<float> coordinate(-1.5f, 1.5f);
+        for (auto &p : points) {
+            p = {coordinate(random), coordinate(random), coordinate(random)};
+        }
+    }
+
+    // Stream for results as they are measured, kept apart from JSON written to standard output
+    std::ostream &log() const {
+        return options.json == "-" ? std::cerr : std::cout;
+    }
+
+    // Generator of the inputs of one benchmark, seeded from its name so they do not depend on what else runs
+    std::mt19937 generator(const std::string &name) const {
+        // FNV-1a, the same on every platform unlike std::hash
+        std::uint32_t hash = 2166136261u;
+        for (unsigned char c : name) {
+            hash = (hash ^ c) * 16777619u;
+        }
+        std::seed_seq seed{options.seed, hash};
+        return std::mt19937(seed);
+    }
+
+    // Time calls of `call` with the index of an input, until the minimum time has passed. Times include an indirect
+    // call of a few nanoseconds.
+    void measure(const std::string &name, const std::function<float(std::size_t)> &call) {
+        if (name.find(options.filter) == std::string::npos) {
+            return;
+        }
+        using Clock = std::chrono::steady_clock;
+        float accumulated = 0;
+        std::uint64_t calls = 0;
+        std::uint64_t batch = 16;
+        auto start = Clock::now();
+        double elapsed = 0;
+        // At least one batch, so that there is a time per call
+        do {
+            for (std::uint64_t i = 0; i < batch; ++i) {
+                accumulated += call(static_cast<std::size_t>((calls + i) % Inputs));
+            }
+            calls += batch;
+            batch = std::min<std::uint64_t>(batch * 2, 1 << 16);
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < options.minTime);
+        sink = accumulated;
+        results.push_back({name, elapsed * 1e9 / static_cast<double>(calls), calls});
+        log() << name << ": " << results.back().nsPerCall << " ns" << std::endl;
+    }
+
+    // Node and tape evaluation of a distance function at random points.
+    void distance(const std::string &name, const std::shared_ptr<Node> &node) {
+        measure(name + "/node", [&](std::size_t i) {
+            return node->signedDistance(points[i]);
+        });
+        Tape tape = Tape::compile(*node);
+        measure(name + "/tape", [&](std::size_t i) {
+            return tape.signedDistance(points[i]);
+        });
+    }
+
+    void primitives() {
+        distance("primitive/Sphere", std::make_shared<Sphere>(0.5f));
+        distance("primitive/Plane", std::make_shared<Plane>(glm::normalize(vec3{0.2f, 1, 0.1f}), 0.5f));
+        distance("primitive/Torus", std::make_shared<Torus>(vec2{0.5f, 0.2f}));
+        distance("primitive/Box", std::make_shared<Box>(vec3{0.4f, 0.3f, 0.5f}));
+        distance("primitive/Triangle", std::make_shared<Triangle>(vec3{-0.5f, 0, 0}, vec3{0.5f, 0, 0.2f},
+                                                                  vec3{0, 0.6f, -0.1f}));
+        distance("primitive/Mesh", std::make_shared<Mesh>(example::torusMesh(0.5f, 0.2f, 96, 32)));
+    }
+
+    void operators() {
+        auto box = [] { return std::make_shared<Box>(vec3{0.4f, 0.3f, 0.5f}); };
+        auto sphere = [] { return std::make_shared<Sphere>(0.5f); };
+        for (bool smooth : {false, true}) {
+            std::string kind = smooth ? "smooth" : "hard";
+            distance("op/Union/" + kind, std::make_shared<ops::Union>(box(), sphere(), smooth, 0.1f));
+            distance("op/Difference/" + kind, std::make_shared<ops::Difference>(box(), sphere(), smooth, 0.1f));
+            distance("op/Intersection/" + kind, std::make_shared<ops::Intersection>(box(), sphere(), smooth, 0.1f));
+
+            // A grid of small spheres, enough for the union to use its BVH
+            std::vector<std::shared_ptr<Node>> children;
+            for (int i = 0; i < 27; ++i) {
+                vec3 position = vec3(i % 3, i / 3 % 3, i / 9) - 1.0f;
+                children.push_back(std::make_shared<ops::Transform>(std::make_shared<Sphere>(0.2f), position));
+            }
+            distance("op/UnionN/" + kind, std::make_shared<ops::UnionN>(children, smooth, 0.1f));
+        }
+        distance("op/Transform", std::make_shared<ops::Transform>(box(), vec3{0.1f, 0.2f, 0}, vec3{0.3f, 0.5f, 0},
+                                                                  vec3{1.5f}));
+        distance("op/Elongate", std::make_shared<ops::Elongate>(sphere(), vec3{0.3f, 0, 0.1f}));
+        distance("op/Round", std::make_shared<ops::Round>(box(), 0.05f));
+        distance("op/Onion", std::make_shared<ops::Onion>(sphere(), 0.05f));
+    }
+
+    void normals() {
+        auto die = example::hollowDieCSG(16, 16);
+        auto &node = die->sdfNodes.front();
+        measure("normal/hollowDieCSG", [&](std::size_t i) {
+            return node->normal(points[i]).x;
+        });
+    }
+
+    // Conversion of a whole frame to 32 bit pixels, as done to present it
+    void present() {
+        Framebuffer framebuffer(options.width, options.height);
+        std::mt19937 random = generator("present/quantize");
+        std::uniform_real_distribution<float> color(-0.1f, 1.1f);
+        for (int y = 0; y < options.height; ++y) {
+            for (int x = 0; x < options.width; ++x) {
+                framebuffer.set(x, y, {color(random), color(random), color(random)});
+            }
+        }
+        std::vector<std::uint32_t> surface(static_cast<std::size_t>(options.width) * options.height);
+        measure("present/quantize", [&](std::size_t i) {
+            framebuffer.quantize(surface.data(), static_cast<std::ptrdiff_t>(options.width) * 4, PixelFormat{});
+            return static_cast<float>(surface[i % surface.size()]);
+        });
+    }
+
+    // Parts of the tracer, on primary rays through random pixels of a scene
+    void tracer(const std::string &name) {
+        auto scene = example::create(name, options.width, options.height);
+        scene->optimize();
+        scene->ensureLight();
+        auto camera = scene->getActiveCamera();
+
+        std::mt19937 random = generator("scene/" + name);
+        std::uniform_real_distribution<float> x(0, float(options.width)), y(0, float(options.height));
+        std::vector<Ray> rays;
+        struct Hit {
+            vec3 p, N, V;
+            Material material;
+        };
+        std::vector<Hit> hits;
+        for (std::size_t i = 0; i < Inputs; ++i) {
+            rays.push_back(Ray::fromView(x(random), y(random), options.width, options.height, camera));
+            auto[object, t] = scene->raycast(rays.back());
+            if (t >= 0) {
+                vec3 p = rays.back().at(t);
+                auto sample = scene->sdfNodes[object]->sampleAt(p);
+                hits.push_back({p, scene->sdfNodes[object]->normal(p), -rays.back().dir,
+                                scene->materials.resolve(sample.materials)});
+            }
+        }
+
+        measure("scene/" + name + "/raycast", [&](std::size_t i) {
+            return scene->raycast(rays[i]).second;
+        });
+        if (hits.empty()) {
+            return;
+        }
+        measure("scene/" + name + "/computeShadow", [&](std::size_t i) {
+            const Hit &hit = hits[i % hits.size()];
+            vec3 start = hit.p + hit.N * Scene::ShadowBias;
+            vec3 L = glm::normalize(scene->lights.front()->position - start);
+            return scene->computeShadow(Ray(start, L), scene->scene.shadowIntensity,
+                                        glm::length(scene->lights.front()->position - start));
+        });
+        measure("scene/" + name + "/computeLightingModel", [&](std::size_t i) {
+            const Hit &hit = hits[i % hits.size()];
+            return scene->computeLightingModel(hit.p, hit.N, hit.V, hit.material).first.x;
+        });
+    }
+
+    // Loading a scene file of many objects, first parsing and optimizing it, then from the cache that wrote
+    void startup() {
+        constexpr int Objects = 100000;
+        const std::string names[] = {"startup/parse", "startup/cache"};
+        auto selected = [&](const std::string &name) {
+            return name.find(options.filter) != std::string::npos;
+        };
+        if (std::none_of(std::begin(names), std::end(names), selected)) {
+            return;
+        }
+        auto path = std::filesystem::temp_directory_path() / "benchmark_startup.scene";
+        auto cache = std::filesystem::path(path) += ".cache";
+        {
+            std::ofstream file(path);
+            std::mt19937 random = generator("startup");
+            file << "material red { albedo 0.8 0.2 0.2 }\nmaterial green { albedo 0.2 0.8 0.2 }\nobject union {\n";
+            std::uniform_real_distribution<float> coordinate(-1, 1);
+            for (int i = 0; i < Objects; ++i) {
+                file << "transform position " << coordinate(random) << ' ' << coordinate(random) << ' '
+                     << coordinate(random) << " { sphere 0.01 material " << (i % 2 ? "red" : "green") << " }\n";
+            }
+            file << "}\n";
+        }
+        std::filesystem::remove(cache);
+
+        // The first load writes the cache the second one reads, so both run either way
+        for (const std::string &name : names) {
+            auto start = std::chrono::steady_clock::now();
+            auto scene = loadScene(path, options.width);
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (!selected(name)) {
+                continue;
+            }
+            results.push_back({name, elapsed * 1e9, 1});
+            log() << name << ": " << elapsed * 1e3 << " ms for " << Objects << " objects" << std::endl;
+        }
+        std::filesystem::remove(path);
+        std::filesystem::remove(cache);
+    }
+
+    // Extraction of the surface of the die at 256 cells across, kept in memory
+    void meshing() {
+        const std::string name = "mesh/hollowDieCSG";
+        if (name.find(options.filter) == std::string::npos) {
+            return;
+        }
+        auto die = example::hollowDieCSG(16, 16);
+        die->optimize();
+        DualContouring contouring(256);
+        MeshDataWriter writer;
+        auto start = std::chrono::steady_clock::now();
+        contouring.extract(*die->sdfNodes.front(), writer);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        results.push_back({name, elapsed * 1e9, 1});
+        log() << name << ": " << elapsed * 1e3 << " ms for " << contouring.getStats().triangles << " triangles"
+              << std::endl;
+    }
+
+    // Median frame of a scene, rendered without reprojection from an earlier frame
+    FrameStats medianFrame(Scene &scene) const {
+        Renderer renderer;
+        renderer.setTileSize(options.tileSize);
+        Framebuffer framebuffer(options.width, options.height);
+        std::vector<FrameStats> runs;
+        for (int frame = 0; frame < options.frames; ++frame) {
+            renderer.reset();
+            runs.push_back(renderer.render(scene, framebuffer));
+        }
+        std::sort(runs.begin(), runs.end(), [](const FrameStats &a, const FrameStats &b) {
+            return a.milliseconds < b.milliseconds;
+        });
+        return runs[runs.size() / 2];
+    }
+
+    // Optimized example scene, baked if asked to
+    example::ScenePtr create(example::Factory factory) const {
+        auto scene = factory(options.width, options.height);
+        scene->optimize();
+        if (options.bake > 0) {
+            scene->bakeDistanceCache(options.bake);
+        }
+        return scene;
+    }
+
+    void frames() {
+        for (auto &[name, factory] : example::all()) {
+            if (("frame/" + std::string(name)).find(options.filter) == std::string::npos) {
+                continue;
+            }
+            auto scene = create(factory);
+            FrameStats median = medianFrame(*scene);
+            frameResults.push_back({std::string(name), options.width, options.height, median.milliseconds, median});
+            log() << "frame/" << name << ": " << median.milliseconds << " ms, "
+                  << median.primaryRaysPerSecond() / 1e6 << " M primary rays/s, "
+                  << median.raysPerSecond() / 1e6 << " M marched rays/s" << std::endl;
+        }
+    }
+
+    // Frame times of every example scene from one thread up to one per core, doubling the threads each time
+    void scaling() {
+#ifdef _OPENMP
+        const int cores = omp_get_num_procs();
+        const int previous = omp_get_max_threads();
+#else
+        const int cores = 1;
+#endif
+        std::vector<int> counts;
+        for (int threads = 1; threads < cores; threads *= 2) {
+            counts.push_back(threads);
+        }
+        counts.push_back(cores);
+
+        for (auto &[name, factory] : example::all()) {
+            if (("scaling/" + std::string(name)).find(options.filter) == std::string::npos) {
+                continue;
+            }
+            auto scene = create(factory);
+            // Build the caches of the scene before timing
+            medianFrame(*scene);
+
+            double single = 0;
+            for (int threads : counts) {
+#ifdef _OPENMP
+                omp_set_num_threads(threads);
+#endif
+                FrameStats median = medianFrame(*scene);
+                if (threads == 1) {
+                    single = median.milliseconds;
+                }
+                double speedup = median.milliseconds > 0 ? single / median.milliseconds : 0.0;
+                scalingResults.push_back({std::string(name), threads, median.milliseconds, speedup,
+                                          speedup / threads, median.steals});
+                log() << "scaling/" << name << "/" << threads << ": " << median.milliseconds << " ms, speedup "
+                      << speedup << ", efficiency " << speedup / threads << ", " << median.steals << " steals"
+                      << std::endl;
+            }
+        }
+#ifdef _OPENMP
+        omp_set_num_threads(previous);
+#endif
+    }
+
+    void writeJSON(std::ostream &out) const {
+        out << "{\n  \"seed\": " << options.seed << ",\n  \"bake\": " << options.bake << ",\n  \"benchmarks\": [\n";
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            const auto &r = results[i];
+            out << "    {\"name\": \"" << r.name << "\", \"ns_per_call\": " << r.nsPerCall
+                << ", \"calls\": " << r.calls << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ],\n  \"frames\": [\n";
+        for (std::size_t i = 0; i < frameResults.size(); ++i) {
+            const auto &f = frameResults[i];
+            out << "    {\"scene\": \"" << f.scene << "\", \"width\": " << f.width << ", \"height\": " << f.height
+                << ", \"milliseconds\": " << f.milliseconds
+                << ", \"primary_mrays_per_second\": " << f.stats.primaryRaysPerSecond() / 1e6
+                << ", \"marched_mrays_per_second\": " << f.stats.raysPerSecond() / 1e6
+                << ", \"steps_per_ray\": " << f.stats.march.stepsPerRay() << "}"
+                << (i + 1 < frameResults.size() ? "," : "") << "\n";
+        }
+        out << "  ],\n  \"scaling\": [\n";
+        for (std::size_t i = 0; i < scalingResults.size(); ++i) {
+            const auto &r = scalingResults[i];
+            out << "    {\"scene\": \"" << r.scene << "\", \"threads\": " << r.threads
+                << ", \"milliseconds\": " << r.milliseconds << ", \"speedup\": " << r.speedup
+                << ", \"efficiency\": " << r.efficiency << ", \"steals\": " << r.steals << "}"
+                << (i + 1 < scalingResults.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+private:
+    static constexpr std::size_t Inputs = 4096;
+
+    Options options;
+    std::array<vec3, Inputs> points;
+    std::vector<Measurement> results;
+    std::vector<FrameMeasurement> frameResults;
+    std::vector<ScalingMeasurement> scalingResults;
+};
+
+void PrintUsage(const char *program) {
+    std::cout << "Usage: " << program << " [options]\n\n"
+              << "Options:\n"
+              << "  --filter <text>      Only run benchmarks whose name contains the text\n"
+              << "  --min-time <seconds> Minimum time per microbenchmark (default 0.2)\n"
+              << "  -W, --width <pixels> Image width of scene benchmarks (default 360)\n"
+              << "  -H, --height <pixels> Image height of scene benchmarks (default 360)\n"
+              << "  -f, --frames <count> Frames per scene, of which the median is reported (default 3)\n"
+              << "  -T, --tile <pixels>  Side length of the tiles handed to threads (default 32)\n"
+              << "  --scaling            Also time every scene from one thread up to one per core\n"
+              << "  --bake [voxel]       Bake distance caches with the given voxel size into the scenes of frame and\n"
+              << "                       scaling benchmarks before timing them (default 0.01)\n"
+              << "  --seed <number>      Seed of the random inputs (default 42)\n"
+              << "  --json <path>        Also write the results as JSON, '-' for standard output\n";
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            PrintUsage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        if (arg == "--scaling") {
+            options.scaling = true;
+            continue;
+        }
+        if (arg == "--bake") {
+            auto size = ParseBakeOption(argc, argv, i);
+            if (!size) {
+                std::cerr << "Voxel size of --bake must be a positive number" << std::endl;
+                return EXIT_FAILURE;
+            }
+            options.bake = *size;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+        const char *value = argv[++i];
+        if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--min-time") {
+            options.minTime = std::atof(value);
+        } else if (arg == "-W" || arg == "--width") {
+            options.width = std::atoi(value);
+        } else if (arg == "-H" || arg == "--height") {
+            options.height = std::atoi(value);
+        } else if (arg == "-f" || arg == "--frames") {
+            options.frames = std::atoi(value);
+        } else if (arg == "-T" || arg == "--tile") {
+            options.tileSize = std::atoi(value);
+        } else if (arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::atol(value));
+        } else if (arg == "--json") {
+            options.json = value;
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (options.width <= 0 || options.height <= 0 || options.frames <= 0 || options.tileSize <= 0) {
+        std::cerr << "Resolution, frames and tile size must be positive" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Benchmark benchmark(options);
+    benchmark.primitives();
+    benchmark.operators();
+    benchmark.normals();
+    benchmark.present();
+    benchmark.startup();
+    benchmark.meshing();
+    for (const char *scene : {"spherePhong", "hollowDieCSG", "triangles"}) {
+        benchmark.tracer(scene);
+    }
+    benchmark.frames();
+    if (options.scaling) {
+        benchmark.scaling();
+    }
+
+    if (options.json == "-") {
+        benchmark.writeJSON(std::cout);
+    } else if (!options.json.empty()) {
+        std::ofstream file(options.json);
+        benchmark.writeJSON(file);
+        if (!file) {
+            std::cerr << "Could not write " << options.json << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
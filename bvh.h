@@ -0,0 +1,199 @@
+#ifndef PROJECT_BVH_H
+#define PROJECT_BVH_H
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include "sdf/bounds.h"
+
+/**
+ * Bounding volume hierarchy over the objects of a scene.
+ * @details
+ * Objects with finite bounds are organised in a binary tree split at the median centroid along the widest axis.
+ * Unbounded objects, like planes, are kept in a separate list and always considered before the tree.
+ */
+class BVH {
+public:
+    BVH() = default;
+
+    explicit BVH(const std::vector<sdf::AABB> &objectBounds) : objectBounds(objectBounds) {
+        std::vector<int> bounded;
+        for (int i = 0; i < objectBounds.size(); ++i) {
+            if (objectBounds[i].isFinite()) {
+                bounded.push_back(i);
+            } else if (!objectBounds[i].isEmpty()) {
+                unbounded.push_back(i);
+            }
+            sceneBounds = sceneBounds.merge(objectBounds[i]);
+        }
+        if (!bounded.empty()) {
+            build(bounded, 0, bounded.size());
+        }
+    }
+
+    /* Bounds of the whole scene. */
+    [[nodiscard]] const sdf::AABB &bounds() const {
+        return sceneBounds;
+    }
+
+    /* Bounds of a single object. */
+    [[nodiscard]] const sdf::AABB &bounds(int object) const {
+        return objectBounds[object];
+    }
+
+    struct Node {
+        sdf::AABB box;
+        int left = -1;
+        int right = -1;
+        // Index of the object for leaves, -1 otherwise
+        int object = -1;
+    };
+
+    /* Nodes of the tree, root first. Empty if no object has finite bounds. */
+    [[nodiscard]] const std::vector<Node> &getNodes() const {
+        return nodes;
+    }
+
+    /* Objects with infinite bounds, which are not part of the tree. */
+    [[nodiscard]] const std::vector<int> &getUnbounded() const {
+        return unbounded;
+    }
+
+    /**
+     * Visit objects nearest first, skipping those that cannot matter.
+     * @param priority Returns the ordering key of a bound, or infinity if the bound can be skipped. Called again
+     * right before a node is entered, so it may depend on results of objects visited so far.
+     * @param visit Called with the index of each object that was not skipped
+     * @param selected Nodes to consider, see select, or null for all of them. Unbounded objects are not affected.
+     */
+    template<class Priority, class Visit>
+    void traverse(Priority &&priority, Visit &&visit, const std::vector<char> *selected = nullptr) const {
+        constexpr float inf = std::numeric_limits<float>::infinity();
+
+        for (int object : unbounded) {
+            if (priority(objectBounds[object]) < inf) {
+                visit(object);
+            }
+        }
+        if (nodes.empty()) {
+            return;
+        }
+
+        // Small fixed size stack, the tree is balanced
+        int stack[64];
+        int top = 0;
+        if (selected && !(*selected)[0]) {
+            return;
+        }
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            if (!(priority(node.box) < inf)) {
+                continue;
+            }
+            if (node.object >= 0) {
+                visit(node.object);
+                continue;
+            }
+            // Push the farther child first so the nearer one is visited first
+            float left = !selected || (*selected)[node.left] ? priority(nodes[node.left].box) : inf;
+            float right = !selected || (*selected)[node.right] ? priority(nodes[node.right].box) : inf;
+            if (left < right) {
+                if (right < inf) stack[top++] = node.right;
+                stack[top++] = node.left;
+            } else {
+                if (left < inf) stack[top++] = node.left;
+                if (right < inf) stack[top++] = node.right;
+            }
+        }
+    }
+
+    /**
+     * Select the nodes of the tree whose bounds pass a test, for traverse. The test is only asked about children of
+     * selected nodes, so it must fail for bounds within bounds it fails for.
+     * @param selected One entry per node, set to whether the node is selected
+     */
+    template<class Test>
+    void select(Test &&test, std::vector<char> &selected) const {
+        selected.assign(nodes.size(), 0);
+        if (nodes.empty() || !test(nodes[0].box)) {
+            return;
+        }
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        selected[0] = 1;
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            for (int child : {node.left, node.right}) {
+                if (child >= 0 && test(nodes[child].box)) {
+                    selected[child] = 1;
+                    stack[top++] = child;
+                }
+            }
+        }
+    }
+
+    /**
+     * Find the object with the smallest signed distance at p, evaluating only objects whose bounds are nearer than the
+     * best distance found so far.
+     * @param distance Evaluates the signed distance of an object at p
+     * @return Index of the nearest object, or -1 if there is none, and its distance
+     */
+    template<class Distance>
+    std::pair<int, float> nearest(const glm::vec3 &p, Distance &&distance) const {
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        float min = inf;
+        int minObject = -1;
+        traverse([&](const sdf::AABB &box) {
+            float d = box.distance(p);
+            return d < min ? d : inf;
+        }, [&](int object) {
+            float d = distance(object);
+            if (d < min) {
+                min = d;
+                minObject = object;
+            }
+        });
+        return {minObject, min};
+    }
+
+private:
+    std::vector<Node> nodes;
+    std::vector<int> unbounded;
+    std::vector<sdf::AABB> objectBounds;
+    sdf::AABB sceneBounds;
+
+    int build(std::vector<int> &objects, std::size_t begin, std::size_t end) {
+        int index = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+
+        sdf::AABB box, centroids;
+        for (std::size_t i = begin; i < end; ++i) {
+            box = box.merge(objectBounds[objects[i]]);
+            glm::vec3 c = objectBounds[objects[i]].center();
+            centroids = centroids.merge({c, c});
+        }
+        nodes[index].box = box;
+
+        if (end - begin == 1) {
+            nodes[index].object = objects[begin];
+            return index;
+        }
+
+        glm::vec3 extent = centroids.max - centroids.min;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        std::size_t mid = (begin + end) / 2;
+        std::nth_element(objects.begin() + begin, objects.begin() + mid, objects.begin() + end, [&](int a, int b) {
+            return objectBounds[a].center()[axis] < objectBounds[b].center()[axis];
+        });
+
+        int left = build(objects, begin, mid);
+        int right = build(objects, mid, end);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        return index;
+    }
+};
+
+#endif //PROJECT_BVH_H
@@ -15,6 +15,9 @@ using glm::mat4;
 class Camera {
 public:
     Camera(const vec3& position, const vec3& up, float focalLength);
+    // Restore a camera from its position, view and rotation matrices
+    Camera(const vec3& position, const mat4& view, const mat4& rotation, float focalLength)
+    : T(view), R(rotation), position(position), f(focalLength) {}
     void translate(float x, float y, float z, bool local=true);
     void rotate(const vec3& axis, float angle, bool local = true);
 
@@ -29,6 +32,10 @@ public:
         return R;
     }
 
+    [[nodiscard]] mat4 view() const {
+        return T;
+    }
+
     [[nodiscard]] mat4 transform() const {
         return R * T;
     }
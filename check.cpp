@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "examples.h"
+
+// ----------------------------------------------------------------------------
+// Checks the faster ways of evaluating distances against the scalar reference of the CSG tree. Every object of every
+// example scene, as built and once optimized, is compiled to a tape and evaluated at random points with the scalar
+// tape interpreter, the batched SIMD kernels, dual numbers and tapes specialized to small boxes around the points.
+// Exits with a failure if any of them disagrees with Node::signedDistances.
+
+using namespace sdf;
+
+// Points per object, and points per box a tape is specialized to
+constexpr std::size_t Points = 4096;
+constexpr std::size_t PointsPerBox = 16;
+constexpr float BoxSize = 0.25f;
+// Largest difference to the reference, relative to its magnitude above 1
+constexpr float Tolerance = 1e-4f;
+// Mismatches printed per evaluator at most
+constexpr int MaxReported = 5;
+
+class Check {
+public:
+    explicit Check(unsigned seed) : random(seed) {}
+
+    // Compare every evaluator of an object to its scalar reference at random points around the scene
+    void object(const std::string &name, Node &node) {
+        std::uniform_real_distribution<float> coordinate(-2, 2);
+        std::vector<float> x(Points), y(Points), z(Points);
+        for (std::size_t i = 0; i < Points; ++i) {
+            x[i] = coordinate(random);
+            y[i] = coordinate(random);
+            z[i] = coordinate(random);
+        }
+        std::vector<float> reference(Points);
+        node.signedDistances(x.data(), y.data(), z.data(), reference.data(), Points);
+
+        Tape tape = Tape::compile(node);
+        std::vector<float> batched(Points);
+        tape.signedDistances(x.data(), y.data(), z.data(), batched.data(), Points);
+
+        Mismatches scalar{name + "/tape"}, simd{name + "/batch"}, gradient{name + "/dual"};
+        Mismatches specialized{name + "/specialize"};
+        for (std::size_t i = 0; i < Points; ++i) {
+            glm::vec3 p{x[i], y[i], z[i]};
+            scalar.compare(p, reference[i], tape.signedDistance(p));
+            simd.compare(p, reference[i], batched[i]);
+            gradient.compare(p, reference[i], node.dualDistance(dual::Vec3::variable(p)).value);
+        }
+
+        // Boxes around some of the points, with more points scattered in each
+        std::uniform_real_distribution<float> offset(-BoxSize / 2, BoxSize / 2);
+        for (std::size_t i = 0; i < Points; i += PointsPerBox) {
+            glm::vec3 center{x[i], y[i], z[i]};
+            Tape local = tape.specialize({center - BoxSize / 2, center + BoxSize / 2});
+            for (std::size_t j = 0; j < PointsPerBox; ++j) {
+                glm::vec3 p = center + glm::vec3{offset(random), offset(random), offset(random)};
+                specialized.compare(p, node.signedDistance(p), local.signedDistance(p));
+            }
+        }
+
+        for (Mismatches *evaluator : {&scalar, &simd, &gradient, &specialized}) {
+            failed += evaluator->count;
+            if (evaluator->count > 0) {
+                std::cout << evaluator->name << ": " << evaluator->count << " mismatches" << std::endl;
+            }
+        }
+        ++objects;
+    }
+
+    void scene(const std::string &name, Scene &scene) {
+        const auto &nodes = scene.getObjects();
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            object(name + "/" + std::to_string(i), *nodes[i]);
+        }
+    }
+
+    [[nodiscard]] int getFailed() const {
+        return failed;
+    }
+
+    [[nodiscard]] int getObjects() const {
+        return objects;
+    }
+
+private:
+    // Points where an evaluator disagrees with the reference, reporting the first few
+    struct Mismatches {
+        std::string name;
+        int count = 0;
+
+        void compare(const glm::vec3 &p, float expected, float actual) {
+            bool agree = expected == actual
+                         || std::abs(expected - actual) <= Tolerance * std::max(1.0f, std::abs(expected));
+            if (agree) {
+                return;
+            }
+            if (++count <= MaxReported) {
+                std::cout << name << " at (" << p.x << ", " << p.y << ", " << p.z << "): " << actual << ", expected "
+                          << expected << std::endl;
+            }
+        }
+    };
+
+    std::mt19937 random;
+    int failed = 0;
+    int objects = 0;
+};
+
+int main(int argc, char *argv[]) {
+    unsigned seed = argc > 1 ? static_cast<unsigned>(std::atol(argv[1])) : 42;
+    Check check(seed);
+    for (auto &[name, factory] : example::all()) {
+        auto scene = factory(64, 64);
+        check.scene(std::string(name), *scene);
+        scene->optimize();
+        check.scene(std::string(name) + "/optimized", *scene);
+    }
+    std::cout << check.getObjects() << " objects, " << check.getFailed() << " mismatches" << std::endl;
+    return check.getFailed() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
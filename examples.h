@@ -1,6 +1,7 @@
 #ifndef PROJECT_EXAMPLES_H
 #define PROJECT_EXAMPLES_H
 
+#include <string_view>
 #include "scene.h"
 #include "sdf/sdf.h"
 
@@ -165,7 +166,7 @@ namespace example {
                         vec3{0.5, -0.5, -0.2},
                         vec3{std::numbers::pi / 1.5, std::numbers::pi / 6, 0}
                 ).asNode();
-        scene->addSDFObject(ring + die % 0.1);
+        auto dice = ring + die % 0.1;
 
         auto ground = Builder<Plane>(vec3{0, -1.f, 0}, 1.f).asNode();
         ground->setMaterial(Material{
@@ -174,7 +175,7 @@ namespace example {
                 .p = 128,
                 .ior = 1.33f
         });
-        scene->addSDFObject(ground);
+        scene->addSDFObjects({dice, ground});
 
         return scene;
     }
@@ -222,8 +223,6 @@ namespace example {
                                              vec3{std::numbers::pi / 6, 0, 0},
                                              vec3{2}).asNode();
 
-        scene->addSDFObject(positioned);
-
         auto ground = Builder<Plane>(vec3{0, -1.f, 0}, 1.f).asNode();
         ground->setMaterial(Material{
                 .albedo{0.8, 0.8, 0.8},
@@ -231,9 +230,90 @@ namespace example {
                 .p = 128,
                 .ior = 1.33f
         });
-        scene->addSDFObject(ground);
+        scene->addSDFObjects({positioned, ground});
 
         return scene;
     }
+
+    /* Closed triangle mesh of a torus around the y axis, with `rings` segments around it and `sides` around the tube. */
+    MeshData torusMesh(float radius, float tube, int rings, int sides) {
+        MeshData mesh;
+        for (int i = 0; i < rings; ++i) {
+            for (int j = 0; j < sides; ++j) {
+                float u = 2 * std::numbers::pi_v<float> * static_cast<float>(i) / static_cast<float>(rings);
+                float v = 2 * std::numbers::pi_v<float> * static_cast<float>(j) / static_cast<float>(sides);
+                float r = radius + tube * std::cos(v);
+                mesh.vertices.emplace_back(r * std::cos(u), tube * std::sin(v), r * std::sin(u));
+            }
+        }
+        for (int i = 0; i < rings; ++i) {
+            for (int j = 0; j < sides; ++j) {
+                auto index = [&](int ring, int side) {
+                    return static_cast<unsigned>((ring % rings) * sides + side % sides);
+                };
+                mesh.triangles.emplace_back(index(i, j), index(i, j + 1), index(i + 1, j + 1));
+                mesh.triangles.emplace_back(index(i, j), index(i + 1, j + 1), index(i + 1, j));
+            }
+        }
+        return mesh;
+    }
+
+    // A torus made of triangles, distances from the mesh rather than a formula.
+    ScenePtr meshTorus(int width, int height) {
+        auto scene = std::make_unique<Scene>(SceneProperties{
+                .backgroundColor{0.2, 0.2, 0.25},
+                .illumination = true,
+        });
+
+        auto mainLight = std::make_shared<Light>(vec3{-0.4, -1.0, -0.7}, vec3{1, 1, 1}, 10.f);
+        scene->addLight(mainLight);
+
+        auto camera = std::make_shared<Camera>(vec3{0, 0, -3.f}, vec3{0, 1.f, 0}, (float) width);
+        scene->setActiveCamera(camera);
+
+        auto torus = Builder<Mesh>(torusMesh(0.6f, 0.2f, 96, 32))
+                .withMaterial(Material{
+                        .albedo{0.85, 0.45, 0.15},
+                        .ks = 0.6f,
+                        .p = 48.f,
+                })
+                .withTransform(vec3{0, -0.2f, 0}, vec3{std::numbers::pi / 3, 0, 0})
+                .asNode();
+
+        auto ground = Builder<Plane>(vec3{0, -1.f, 0}, 1.f).asNode();
+        ground->setMaterial(Material{
+                .albedo{0.8, 0.8, 0.8},
+                .ks = 0.2f,
+                .p = 128,
+        });
+        scene->addSDFObjects({torus, ground});
+
+        return scene;
+    }
+
+    using Factory = ScenePtr (*)(int width, int height);
+
+    /* All example scenes by name. */
+    const std::vector<std::pair<std::string_view, Factory>> &all() {
+        static const std::vector<std::pair<std::string_view, Factory>> examples{
+                {"sphereNormals",     sphereNormals},
+                {"sphereRaymarching", sphereRaymarching},
+                {"spherePhong",       spherePhong},
+                {"hollowDieCSG",      hollowDieCSG},
+                {"triangles",         triangles},
+                {"meshTorus",         meshTorus},
+        };
+        return examples;
+    }
+
+    /* Create the example scene with the given name, or nullptr if there is none. */
+    ScenePtr create(std::string_view name, int width, int height) {
+        for (auto &[key, factory] : all()) {
+            if (key == name) {
+                return factory(width, height);
+            }
+        }
+        return nullptr;
+    }
 }
 #endif //PROJECT_EXAMPLES_H
@@ -0,0 +1,229 @@
+#ifndef PROJECT_FRAMEBUFFER_H
+#define PROJECT_FRAMEBUFFER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "sdf/simd.h"
+
+/* Layout of a 32 bit pixel: where each 8 bit channel starts, and bits set in every pixel, like an opaque alpha. */
+struct PixelFormat {
+    int redShift = 16;
+    int greenShift = 8;
+    int blueShift = 0;
+    std::uint32_t fill = 0xff000000;
+};
+
+/**
+ * Linear float colors of a rendered frame, row major, with writers for image files that need no external library.
+ * @details
+ * Colors are kept as three planes of floats, one per channel, so quantization loads a channel of several pixels at
+ * once.
+ */
+class Framebuffer {
+public:
+    Framebuffer() = default;
+
+    Framebuffer(int width, int height)
+            : w(width), h(height), plane(static_cast<std::size_t>(width) * height), channels(plane * 3) {}
+
+    [[nodiscard]] int width() const {
+        return w;
+    }
+
+    [[nodiscard]] int height() const {
+        return h;
+    }
+
+    [[nodiscard]] glm::vec3 at(int x, int y) const {
+        std::size_t i = static_cast<std::size_t>(y) * w + x;
+        return {channels[i], channels[plane + i], channels[2 * plane + i]};
+    }
+
+    void set(int x, int y, const glm::vec3 &color) {
+        std::size_t i = static_cast<std::size_t>(y) * w + x;
+        channels[i] = color.r;
+        channels[plane + i] = color.g;
+        channels[2 * plane + i] = color.b;
+    }
+
+    /**
+     * Quantize rows [y0, y1) to 8 bits per channel like PutPixelSDL does, into 32 bit pixels of the given format.
+     * @param pixels First pixel of row 0
+     * @param pitch Distance between the starts of rows in bytes
+     */
+    void quantize(void *pixels, std::ptrdiff_t pitch, const PixelFormat &format, int y0, int y1) const {
+        namespace simd = sdf::simd;
+        constexpr int Lanes = static_cast<int>(simd::Width);
+        const simd::Float zero(0.0f), scale(255.0f);
+        const simd::Int fill(format.fill);
+        for (int y = y0; y < y1; ++y) {
+            auto *row = reinterpret_cast<std::uint32_t *>(static_cast<std::uint8_t *>(pixels) + y * pitch);
+            const float *r = channels.data() + static_cast<std::size_t>(y) * w;
+            const float *g = r + plane;
+            const float *b = g + plane;
+            int x = 0;
+            for (; x + Lanes <= w; x += Lanes) {
+                auto channel = [&](const float *c, int shift) {
+                    return simd::truncate(simd::clamp(simd::Float::load(c + x) * scale, zero, scale)) << shift;
+                };
+                (channel(r, format.redShift) | channel(g, format.greenShift) | channel(b, format.blueShift) | fill)
+                        .store(row + x);
+            }
+            for (; x < w; ++x) {
+                auto channel = [&](const float *c, int shift) {
+                    return static_cast<std::uint32_t>(glm::clamp(255 * c[x], 0.f, 255.f)) << shift;
+                };
+                row[x] = channel(r, format.redShift) | channel(g, format.greenShift) | channel(b, format.blueShift)
+                         | format.fill;
+            }
+        }
+    }
+
+    /* Quantize the whole frame, rows in parallel. */
+    void quantize(void *pixels, std::ptrdiff_t pitch, const PixelFormat &format) const {
+        constexpr int Rows = 16;
+        #pragma omp parallel for
+        for (int y = 0; y < h; y += Rows) {
+            quantize(pixels, pitch, format, y, std::min(y + Rows, h));
+        }
+    }
+
+    /* Colors quantized to 8 bits per channel like PutPixelSDL does, as RGB triples. */
+    [[nodiscard]] std::vector<std::uint8_t> toRGB8() const {
+        // Quantize into the bytes of the first three channels, then drop every fourth byte
+        std::vector<std::uint32_t> packed(plane);
+        PixelFormat bytes{0, 8, 16, 0};
+        quantize(packed.data(), static_cast<std::ptrdiff_t>(w) * 4, bytes);
+        std::vector<std::uint8_t> rgb(plane * 3);
+        for (std::size_t i = 0; i < plane; ++i) {
+            rgb[i * 3] = static_cast<std::uint8_t>(packed[i]);
+            rgb[i * 3 + 1] = static_cast<std::uint8_t>(packed[i] >> 8);
+            rgb[i * 3 + 2] = static_cast<std::uint8_t>(packed[i] >> 16);
+        }
+        return rgb;
+    }
+
+    /* Write a binary PPM file. Returns false if the file could not be written. */
+    bool savePPM(const std::string &path) const {
+        std::ofstream file(path, std::ios::binary);
+        file << "P6\n" << w << " " << h << "\n255\n";
+        auto rgb = toRGB8();
+        file.write(reinterpret_cast<const char *>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+        return static_cast<bool>(file);
+    }
+
+    /**
+     * Write a PNG file. Returns false if the file could not be written.
+     * @details
+     * Image data is stored with uncompressed deflate blocks, so the file is about as large as a PPM, but readable
+     * everywhere.
+     */
+    bool savePNG(const std::string &path) const {
+        auto rgb = toRGB8();
+        // Each row starts with the byte of filter type None
+        std::vector<std::uint8_t> raw;
+        raw.reserve(rgb.size() + h);
+        for (int y = 0; y < h; ++y) {
+            raw.push_back(0);
+            auto row = rgb.begin() + static_cast<std::ptrdiff_t>(y) * w * 3;
+            raw.insert(raw.end(), row, row + w * 3);
+        }
+
+        // zlib stream of stored deflate blocks
+        std::vector<std::uint8_t> zlib{0x78, 0x01};
+        constexpr std::size_t MaxBlock = 65535;
+        for (std::size_t offset = 0; offset < raw.size() || offset == 0; offset += MaxBlock) {
+            auto length = static_cast<std::uint16_t>(std::min(MaxBlock, raw.size() - offset));
+            bool last = offset + length >= raw.size();
+            zlib.push_back(last ? 1 : 0);
+            zlib.push_back(length & 0xff);
+            zlib.push_back(length >> 8);
+            zlib.push_back(~length & 0xff);
+            zlib.push_back((~length >> 8) & 0xff);
+            zlib.insert(zlib.end(), raw.begin() + static_cast<std::ptrdiff_t>(offset),
+                        raw.begin() + static_cast<std::ptrdiff_t>(offset + length));
+        }
+        appendBigEndian(zlib, adler32(raw));
+
+        std::vector<std::uint8_t> header;
+        appendBigEndian(header, static_cast<std::uint32_t>(w));
+        appendBigEndian(header, static_cast<std::uint32_t>(h));
+        // 8 bits per channel, RGB, default compression, filtering and no interlacing
+        header.insert(header.end(), {8, 2, 0, 0, 0});
+
+        std::ofstream file(path, std::ios::binary);
+        const std::uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        file.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+        writeChunk(file, "IHDR", header);
+        writeChunk(file, "IDAT", zlib);
+        writeChunk(file, "IEND", {});
+        return static_cast<bool>(file);
+    }
+
+    /* Write a PNG or PPM file, depending on the extension of the path. */
+    bool save(const std::string &path) const {
+        if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".ppm") == 0) {
+            return savePPM(path);
+        }
+        return savePNG(path);
+    }
+
+private:
+    int w = 0;
+    int h = 0;
+    // Pixels per channel
+    std::size_t plane = 0;
+    // Red plane, then green, then blue
+    std::vector<float> channels;
+
+    static void appendBigEndian(std::vector<std::uint8_t> &out, std::uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<std::uint8_t>(value >> shift));
+        }
+    }
+
+    static std::uint32_t adler32(const std::vector<std::uint8_t> &data) {
+        std::uint32_t a = 1, b = 0;
+        for (std::uint8_t byte : data) {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    static std::uint32_t crc32(const std::uint8_t *data, std::size_t size, std::uint32_t crc = 0xffffffff) {
+        static const auto table = [] {
+            std::array<std::uint32_t, 256> t{};
+            for (std::uint32_t n = 0; n < 256; ++n) {
+                std::uint32_t c = n;
+                for (int k = 0; k < 8; ++k) {
+                    c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+                }
+                t[n] = c;
+            }
+            return t;
+        }();
+        for (std::size_t i = 0; i < size; ++i) {
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+    static void writeChunk(std::ofstream &file, const char *type, const std::vector<std::uint8_t> &data) {
+        std::vector<std::uint8_t> chunk;
+        appendBigEndian(chunk, static_cast<std::uint32_t>(data.size()));
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        // The checksum covers the type and the data
+        std::uint32_t crc = crc32(chunk.data() + 4, chunk.size() - 4) ^ 0xffffffff;
+        appendBigEndian(chunk, crc);
+        file.write(reinterpret_cast<const char *>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+    }
+};
+
+#endif //PROJECT_FRAMEBUFFER_H
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "renderer.h"
+#include "examples.h"
+#include "scenefile.h"
+#include "arguments.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// Batch renderer for machines without a display. Renders example scenes or scene files straight into image files.
+
+struct Options {
+    std::vector<std::string> scenes;
+    int width = 720;
+    int height = 720;
+    int threads = 0;
+    int frames = 1;
+    int tileSize = 32;
+    // Samples per pixel at most on edges, 1 for no anti-aliasing
+    int samples = 1;
+    // Rotation of the camera about the vertical axis between frames, in degrees
+    float orbit = 0;
+    // Output path, where {scene} and {frame} are replaced by the scene name and frame number
+    std::string output = "{scene}.png";
+    // Prefix of per pixel statistics, replaced like output. None if empty.
+    std::string statistics;
+    // Mesh file written instead of rendering, where {scene} is replaced. None if empty.
+    std::string mesh;
+    // Cells along the longest side of the bounds of the scene when meshing
+    int cells = 256;
+    // Voxel size of the distance caches baked into each scene before rendering, none if 0
+    float bake = 0;
+    // Whether the arguments asked for help or the list of scenes, which was printed instead of rendering
+    bool printed = false;
+};
+
+void PrintUsage(const char *program) {
+    std::cout << "Usage: " << program << " [options] <scene>...\n"
+              << "Renders example scenes or scene files without a display. Use 'all' to render every example.\n"
+              << "Scene files are cached next to them as <file>.cache, which later runs load instead.\n\n"
+              << "Options:\n"
+              << "  -W, --width <pixels>     Image width (default 720)\n"
+              << "  -H, --height <pixels>    Image height (default 720)\n"
+              << "  -t, --threads <count>    Number of threads (default: all cores)\n"
+              << "  -f, --frames <count>     Frames to render per scene (default 1)\n"
+              << "  -T, --tile <pixels>      Side length of the tiles handed to threads (default 32)\n"
+              << "  -a, --aa <samples>       Anti-alias edges with up to this many samples per pixel (default 1)\n"
+              << "  -r, --orbit <degrees>    Camera rotation between frames (default 0)\n"
+              << "  -o, --output <path>      Output file, .png or .ppm. {scene} and {frame} are replaced\n"
+              << "                           (default {scene}.png, or {scene}_{frame}.png for several frames)\n"
+              << "  -s, --stats <prefix>     Also write heatmaps of per pixel statistics, named <prefix>_steps.png\n"
+              << "                           and so on, and their totals and histograms to <prefix>.json\n"
+              << "  -m, --mesh <path>        Write a mesh of the bounded objects instead of rendering, .ply or .obj.\n"
+              << "                           {scene} is replaced\n"
+              << "  -c, --cells <count>      Cells along the longest side of the scene when meshing (default 256)\n"
+              << "  --bake [voxel]           Bake the distance fields of the bounded objects into caches with the\n"
+              << "                           given voxel size before rendering (default 0.01)\n"
+              << "  -l, --list               List the example scenes\n";
+}
+
+std::string Replace(std::string text, const std::string &key, const std::string &value) {
+    for (auto at = text.find(key); at != std::string::npos; at = text.find(key, at + value.size())) {
+        text.replace(at, key.size(), value);
+    }
+    return text;
+}
+
+// Returns false if the arguments are invalid, or if the program should exit after handling them.
+bool ParseArguments(int argc, char *argv[], Options &options) {
+    bool framePattern = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char * {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
+        const char *v = nullptr;
+        if (arg == "-h" || arg == "--help") {
+            PrintUsage(argv[0]);
+            options.printed = true;
+            return false;
+        } else if (arg == "-l" || arg == "--list") {
+            for (auto &[name, factory] : example::all()) {
+                std::cout << name << std::endl;
+            }
+            options.printed = true;
+            return false;
+        } else if (arg == "-W" || arg == "--width") {
+            if (!(v = value())) return false;
+            options.width = std::atoi(v);
+        } else if (arg == "-H" || arg == "--height") {
+            if (!(v = value())) return false;
+            options.height = std::atoi(v);
+        } else if (arg == "-t" || arg == "--threads") {
+            if (!(v = value())) return false;
+            options.threads = std::atoi(v);
+        } else if (arg == "-f" || arg == "--frames") {
+            if (!(v = value())) return false;
+            options.frames = std::atoi(v);
+        } else if (arg == "-T" || arg == "--tile") {
+            if (!(v = value())) return false;
+            options.tileSize = std::atoi(v);
+        } else if (arg == "-a" || arg == "--aa") {
+            if (!(v = value())) return false;
+            options.samples = std::atoi(v);
+        } else if (arg == "-r" || arg == "--orbit") {
+            if (!(v = value())) return false;
+            options.orbit = static_cast<float>(std::atof(v));
+        } else if (arg == "-o" || arg == "--output") {
+            if (!(v = value())) return false;
+            options.output = v;
+            framePattern = true;
+        } else if (arg == "-s" || arg == "--stats") {
+            if (!(v = value())) return false;
+            options.statistics = v;
+        } else if (arg == "-m" || arg == "--mesh") {
+            if (!(v = value())) return false;
+            options.mesh = v;
+        } else if (arg == "-c" || arg == "--cells") {
+            if (!(v = value())) return false;
+            options.cells = std::atoi(v);
+        } else if (arg == "--bake") {
+            auto size = ParseBakeOption(argc, argv, i);
+            if (!size) {
+                std::cerr << "Voxel size of --bake must be a positive number" << std::endl;
+                return false;
+            }
+            options.bake = *size;
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return false;
+        } else if (arg == "all") {
+            for (auto &[name, factory] : example::all()) {
+                options.scenes.emplace_back(name);
+            }
+        } else {
+            options.scenes.push_back(arg);
+        }
+    }
+
+    if (options.scenes.empty()) {
+        PrintUsage(argv[0]);
+        return false;
+    }
+    if (options.width <= 0 || options.height <= 0 || options.frames <= 0 || options.tileSize <= 0
+        || options.samples <= 0 || options.threads < 0 || options.cells <= 0) {
+        std::cerr << "Resolution, frames, tile size, samples, threads and cells must be positive"
+                  << std::endl;
+        return false;
+    }
+    for (auto &name : options.scenes) {
+        auto &examples = example::all();
+        if (std::none_of(examples.begin(), examples.end(), [&](auto &entry) { return entry.first == name; })
+            && !std::filesystem::is_regular_file(name)) {
+            std::cerr << "Unknown scene " << name << ", use --list to show all scenes" << std::endl;
+            return false;
+        }
+    }
+    if (!framePattern && options.frames > 1) {
+        options.output = "{scene}_{frame}.png";
+    }
+    if (!options.statistics.empty() && options.frames > 1 && options.statistics.find("{frame}") == std::string::npos) {
+        options.statistics += "_{frame}";
+    }
+    return true;
+}
+
+// Example scene by name, or a scene file by path, optimized either way. nullptr if the file cannot be loaded.
+std::unique_ptr<Scene> CreateScene(const std::string &name, const Options &options) {
+    if (auto scene = example::create(name, options.width, options.height)) {
+        scene->optimize();
+        return scene;
+    }
+    std::string error;
+    auto scene = loadScene(name, options.width, &error);
+    if (!scene) {
+        std::cerr << "Could not load " << error << std::endl;
+    }
+    return scene;
+}
+
+// Write a mesh of the objects of a scene with finite bounds. Returns false if it could not be written.
+bool WriteMesh(const Scene &scene, const std::string &path, const Options &options) {
+    std::vector<std::shared_ptr<sdf::Node>> objects;
+    for (auto &object : scene.getObjects()) {
+        if (object->bounds().isFinite()) {
+            objects.push_back(object);
+        }
+    }
+    if (objects.size() < scene.getObjects().size()) {
+        std::cout << "Leaving out " << scene.getObjects().size() - objects.size() << " unbounded objects" << std::endl;
+    }
+    if (objects.empty()) {
+        std::cerr << "Scene has no bounded objects to mesh" << std::endl;
+        return false;
+    }
+    auto writer = sdf::MeshWriter::open(path);
+    if (!writer) {
+        std::cerr << "Could not write " << path << ", meshes are written as .ply or .obj" << std::endl;
+        return false;
+    }
+    sdf::ops::UnionN root(objects);
+    sdf::DualContouring contouring(options.cells);
+    auto start = std::chrono::steady_clock::now();
+    if (!contouring.extract(root, *writer)) {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+    auto &stats = contouring.getStats();
+    std::cout << path << ": " << stats.vertices << " vertices, " << stats.triangles << " triangles in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms, "
+              << stats.cells << " cells in " << stats.chunks << " chunks" << std::endl;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    if (!ParseArguments(argc, argv, options)) {
+        return options.printed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+#ifdef _OPENMP
+    if (options.threads > 0) {
+        omp_set_num_threads(options.threads);
+    }
+#endif
+
+    Renderer renderer;
+    renderer.setTileSize(options.tileSize);
+    Framebuffer framebuffer(options.width, options.height);
+    PixelStatistics statistics;
+    RenderPass pass;
+    pass.antiAliasing.maxSamples = options.samples;
+    double totalMilliseconds = 0;
+    std::uint64_t totalRays = 0;
+
+    for (auto &name : options.scenes) {
+        auto scene = CreateScene(name, options);
+        if (!scene) {
+            return EXIT_FAILURE;
+        }
+        // Scene files are named after the file, without its directory and extension
+        std::string label = std::filesystem::path(name).stem().string();
+        if (!options.mesh.empty()) {
+            if (!WriteMesh(*scene, Replace(options.mesh, "{scene}", label), options)) {
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+        if (options.bake > 0) {
+            std::size_t bytes = scene->bakeDistanceCache(options.bake);
+            std::cout << label << ": " << static_cast<double>(bytes) / (1 << 20) << " MB of distance caches"
+                      << std::endl;
+        }
+        renderer.reset();
+
+        for (int frame = 0; frame < options.frames; ++frame) {
+            if (frame > 0) {
+                scene->getActiveCamera()->rotate(vec3{0, 1, 0}, glm::radians(options.orbit));
+            }
+            FrameStats stats = renderer.render(*scene, framebuffer, options.statistics.empty() ? nullptr : &statistics,
+                                               pass);
+            totalMilliseconds += stats.milliseconds;
+            totalRays += stats.march.rays;
+
+            auto expand = [&](const std::string &pattern) {
+                return Replace(Replace(pattern, "{scene}", label), "{frame}", std::to_string(frame));
+            };
+            std::string path = expand(options.output);
+            if (!framebuffer.save(path)) {
+                std::cerr << "Could not write " << path << std::endl;
+                return EXIT_FAILURE;
+            }
+            if (!options.statistics.empty()) {
+                std::string prefix = expand(options.statistics);
+                std::ofstream summary(prefix + ".json");
+                statistics.writeSummary(summary);
+                if (!summary || !statistics.saveHeatmaps(prefix)) {
+                    std::cerr << "Could not write statistics " << prefix << std::endl;
+                    return EXIT_FAILURE;
+                }
+            }
+            std::cout << label << " frame " << frame << ": " << stats.milliseconds << " ms, "
+                      << stats.primaryRaysPerSecond() / 1e6 << " M primary rays/s, "
+                      << stats.raysPerSecond() / 1e6 << " M marched rays/s, "
+                      << stats.march.stepsPerRay() << " steps per ray, "
+                      << stats.raysPerPixel() << " rays per pixel, "
+                      << stats.samplesPerPixel() << " samples per pixel -> " << path << std::endl;
+            if (!options.statistics.empty()) {
+                std::cout << "  steps " << statistics.total(&PixelStats::steps)
+                          << ", evaluations " << statistics.total(&PixelStats::evaluations)
+                          << ", shadow steps " << statistics.total(&PixelStats::shadowSteps)
+                          << ", out of steps " << statistics.count(&PixelStats::exhausted)
+                          << ", past distance " << statistics.count(&PixelStats::distanceLimit) << std::endl;
+            }
+        }
+    }
+
+    if (options.mesh.empty()) {
+        std::cout << "Total: " << totalMilliseconds << " ms, "
+                  << (totalMilliseconds > 0 ? static_cast<double>(totalRays) / totalMilliseconds / 1e3 : 0.0)
+                  << " M marched rays/s" << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -1,123 +1,222 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <iterator>
 #include <glm/glm.hpp>
 #include "SDLauxiliary.h"
 #include "scene.h"
+#include "renderer.h"
 #include "examples.h"
+#include "scenefile.h"
 
 // ----------------------------------------------------------------------------
 // GLOBAL VARIABLES
 
 constexpr int SCREEN_WIDTH = 720;
 constexpr int SCREEN_HEIGHT = 720;
+// Present through SDL_Flip on a hardware surface, if the video driver offers one
+constexpr bool DOUBLE_BUFFER = false;
+// Camera and light movement in units per second, and camera rotation in radians per second
+constexpr float MOVE_SPEED = 1.0f;
+constexpr float TURN_SPEED = 1.0f;
 SDL_Surface *screen;
 int t;
+// Time of the last change to the camera or lights
+int changed;
+// Time to copy the last frame to the screen, in milliseconds
+double presentTime;
+
+// Passes drawn after the camera or a light moved, from a quick preview to the full image
+const RenderPass PASSES[] = {
+        {.block = 8, .maxDepth = 0},
+        {.block = 4, .maxDepth = 0},
+        {.block = 2, .maxDepth = 0},
+        {.block = 1, .maxDepth = 0},
+        {.block = 1, .antiAliasing = {.maxSamples = 8}},
+};
+// Next pass to draw, past the last one once the image is complete
+std::size_t pass = 0;
+
+// Keys that move the camera or the light
+const SDLKey CONTROLS[] = {SDLK_UP, SDLK_DOWN, SDLK_LEFT, SDLK_RIGHT, SDLK_w, SDLK_s, SDLK_a, SDLK_d, SDLK_q, SDLK_e};
 
 
 std::unique_ptr<Scene> scene;
 
-std::vector<std::tuple<int, int, glm::vec3>> framebuffer;
+Framebuffer framebuffer;
+Renderer renderer;
 
 
 // ----------------------------------------------------------------------------
 // FUNCTIONS
 
-void Update();
+bool Update();
 
 void Draw();
 
+bool InputPending();
+
+PixelFormat GetPixelFormat(const SDL_Surface *surface);
+
 int main(int argc, char *argv[]) {
-    screen = InitializeSDL(SCREEN_WIDTH, SCREEN_HEIGHT);
+    screen = InitializeSDL(SCREEN_WIDTH, SCREEN_HEIGHT, false, DOUBLE_BUFFER);
     t = SDL_GetTicks();    // Set start value for timer.
+    changed = t;
 
-    framebuffer = std::vector<std::tuple<int, int, vec3>>(SCREEN_WIDTH * SCREEN_HEIGHT);
+    framebuffer = Framebuffer(SCREEN_WIDTH, SCREEN_HEIGHT);
 
-    scene = example::triangles(SCREEN_WIDTH, SCREEN_HEIGHT);
+    if (argc > 1) {
+        // Scene files come optimized, from their cache if it is up to date
+        std::string error;
+        scene = loadScene(argv[1], SCREEN_WIDTH, &error);
+        if (!scene) {
+            std::cerr << "Could not load " << error << std::endl;
+            return 1;
+        }
+    } else {
+        scene = example::triangles(SCREEN_WIDTH, SCREEN_HEIGHT);
+        auto stats = scene->optimize();
+        std::cout << "CSG nodes: " << stats.nodesBefore << " -> " << stats.nodesAfter << std::endl;
+    }
     //scene->setDebugProperties(DebugProperties{.depth = true});
 
-    Draw();
-    Update();
+    while (NoQuitMessageSDL()) {
+        if (Update()) {
+            pass = 0;
+        }
+        if (pass < std::size(PASSES)) {
+            Draw();
+        } else {
+            // The image is complete, wait for input
+            SDL_Delay(10);
+        }
+    }
 
     SDL_SaveBMP(screen, "screenshot.bmp");
     return 0;
 }
 
-void Update() {
+/* Move the camera and the light with the keys held down. Returns true if anything moved. */
+bool Update() {
     // Compute frame time:
     int t2 = SDL_GetTicks();
-    auto dt = float(t2 - t);
+    float dt = float(t2 - t) / 1000.0f;
     t = t2;
-    std::cout << "Render time: " << dt << " ms." << std::endl;
     auto keystate = SDL_GetKeyState(nullptr);
+    float move = MOVE_SPEED * dt;
+    float turn = TURN_SPEED * dt;
+    bool moved = false;
 
     auto camera = scene->getActiveCamera();
     if (keystate[SDLK_UP]) {
-        camera->translate(0, 0, -0.1f);
+        camera->translate(0, 0, -move);
+        moved = true;
     }
     if (keystate[SDLK_DOWN]) {
-        camera->translate(0, 0, 0.1f);
+        camera->translate(0, 0, move);
+        moved = true;
     }
     if (keystate[SDLK_LEFT]) {
-        camera->rotate(vec3{0, 1, 0}, -3);
+        camera->rotate(vec3{0, 1, 0}, -turn);
+        moved = true;
     }
     if (keystate[SDLK_RIGHT]) {
-        camera->rotate(vec3{0, 1, 0}, 3);
+        camera->rotate(vec3{0, 1, 0}, turn);
+        moved = true;
     }
 
     auto light = scene->getLight(0);
     if (light)
     {
+        vec3 position = light->position;
         // light: forward backward z
         if (keystate[SDLK_w]) {
-            light->position += vec3{0, 0, 0.1f};
+            light->position += vec3{0, 0, move};
         }
         if (keystate[SDLK_s]) {
-            light->position += vec3{0, 0, -0.1f};
+            light->position += vec3{0, 0, -move};
         }
 
         // light: left right x
         if (keystate[SDLK_a]) {
-            light->position += vec3{-0.1f, 0, 0};
+            light->position += vec3{-move, 0, 0};
         }
         if (keystate[SDLK_d]) {
-            light->position += vec3{0.1f, 0, 0};
+            light->position += vec3{move, 0, 0};
         }
 
         // light: up down y
         if (keystate[SDLK_q]) {
-            light->position += vec3{0, 0.1f, 0};
+            light->position += vec3{0, move, 0};
         }
         if (keystate[SDLK_e]) {
-            light->position += vec3{0, -0.1f, 0};
+            light->position += vec3{0, -move, 0};
         }
+        moved |= light->position != position;
     }
-}
 
-void SetFramebuffer(int x, int y, const glm::vec3 &color) {
-    framebuffer.at(y * screen->pitch / 4 + x) = std::make_tuple(x, y, color);
+    if (moved) {
+        changed = t2;
+    }
+    return moved;
 }
 
+/* Draw the next pass. Passes after the first are dropped as soon as there is new input, which starts over. */
 void Draw() {
-#pragma omp parallel for
-    for (int y = 0; y < SCREEN_HEIGHT; ++y) {
-#pragma omp parallel for
-        for (int x = 0; x < SCREEN_WIDTH; ++x) {
-            auto ray = Ray::fromView(x, y, SCREEN_WIDTH, SCREEN_HEIGHT, scene->getActiveCamera());
-
-            auto color = scene->trace(ray);
-            SetFramebuffer(x, y, color);
-        }
+    RenderPass settings = PASSES[pass];
+    if (pass > 0) {
+        settings.cancel = InputPending;
+    }
+    FrameStats frame = renderer.render(*scene, framebuffer, nullptr, settings);
+    if (frame.cancelled) {
+        return;
     }
 
+    auto start = std::chrono::steady_clock::now();
     if (SDL_MUSTLOCK(screen))
         SDL_LockSurface(screen);
 
-    for (auto &[x, y, color] : framebuffer) {
-        PutPixelSDL(screen, x, y, color);
-    }
+    // The video mode is set to 32 bits per pixel, so the frame is quantized straight into the surface
+    framebuffer.quantize(screen->pixels, screen->pitch, GetPixelFormat(screen));
 
     if (SDL_MUSTLOCK(screen))
         SDL_UnlockSurface(screen);
 
-    SDL_UpdateRect(screen, 0, 0, 0, 0);
+    if (screen->flags & SDL_DOUBLEBUF) {
+        SDL_Flip(screen);
+    } else {
+        SDL_UpdateRect(screen, 0, 0, 0, 0);
+    }
+    presentTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (++pass == std::size(PASSES)) {
+        std::cout << "Render time: " << SDL_GetTicks() - changed << " ms." << std::endl;
+        std::cout << "Prepass cones: " << frame.march.cones << ", steps: " << frame.march.coneSteps << std::endl;
+        std::cout << "Reprojected starts: " << frame.march.guesses << ", rejected: " << frame.march.rejected
+                  << std::endl;
+        std::cout << "Rays: " << frame.march.rays << ", steps per ray: " << frame.march.stepsPerRay()
+                  << ", rays per pixel: " << frame.raysPerPixel() << std::endl;
+        std::cout << "Samples per pixel: " << frame.samplesPerPixel() << ", anti-aliased pixels: "
+                  << frame.antiAliased << std::endl;
+        std::cout << "Present time: " << presentTime << " ms." << std::endl;
+    }
 }
 
+/* Whether keys or events are waiting that Update or NoQuitMessageSDL would act on. */
+bool InputPending() {
+    SDL_PumpEvents();
+    SDL_Event event;
+    if (SDL_PeepEvents(&event, 1, SDL_PEEKEVENT, SDL_QUITMASK | SDL_KEYDOWNMASK) > 0) {
+        return true;
+    }
+    auto keystate = SDL_GetKeyState(nullptr);
+    return std::any_of(std::begin(CONTROLS), std::end(CONTROLS), [&](SDLKey key) {
+        return keystate[key];
+    });
+}
+
+PixelFormat GetPixelFormat(const SDL_Surface *surface) {
+    const SDL_PixelFormat *format = surface->format;
+    // SDL_MapRGB sets the alpha bits, if any, to opaque
+    return {format->Rshift, format->Gshift, format->Bshift, format->Amask};
+}
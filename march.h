@@ -0,0 +1,318 @@
+#ifndef PROJECT_MARCH_H
+#define PROJECT_MARCH_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+#include "statistics.h"
+
+/* Schemes for marching rays towards surfaces. */
+enum class Marcher {
+    // Sphere tracing with a fixed hit threshold
+    Sphere,
+    // Over-relaxed sphere tracing with a hit threshold following the pixel footprint, and refined hits
+    Enhanced
+};
+
+/* Work done marching rays, for comparing marchers. */
+struct MarchStats {
+    std::uint64_t rays = 0;
+    std::uint64_t steps = 0;
+    std::uint64_t hits = 0;
+    // Rays that ran out of steps before hitting a surface or leaving the scene
+    std::uint64_t exhausted = 0;
+    // Over-relaxed steps that left the sphere known to be empty and were taken back
+    std::uint64_t backtracks = 0;
+    // Distance evaluations spent refining hits, not included in steps
+    std::uint64_t refinements = 0;
+    // Cones marched by the prepass of primary rays, and their steps
+    std::uint64_t cones = 0;
+    std::uint64_t coneSteps = 0;
+    // Rays that started at a guessed distance, and those whose guess lay within a surface
+    std::uint64_t guesses = 0;
+    std::uint64_t rejected = 0;
+    // Reflected and refracted rays traced, including those that miss the scene bounds and are never marched
+    std::uint64_t secondary = 0;
+
+    MarchStats &operator+=(const MarchStats &other) {
+        rays += other.rays;
+        steps += other.steps;
+        hits += other.hits;
+        exhausted += other.exhausted;
+        backtracks += other.backtracks;
+        refinements += other.refinements;
+        cones += other.cones;
+        coneSteps += other.coneSteps;
+        guesses += other.guesses;
+        rejected += other.rejected;
+        secondary += other.secondary;
+        return *this;
+    }
+
+    [[nodiscard]] double stepsPerRay() const {
+        return rays > 0 ? static_cast<double>(steps) / static_cast<double>(rays) : 0.0;
+    }
+};
+
+/* Distances primary rays can skip without passing a surface, for square blocks of pixels. */
+struct ConeDepth {
+    // Side length of the blocks in pixels
+    int block = 1;
+    int columns = 0;
+    int rows = 0;
+    // Distance for each block, row major
+    std::vector<float> t;
+
+    /* Distance for the pixel at x, y, or 0 if nothing is known. */
+    [[nodiscard]] float at(int x, int y) const {
+        return t.empty() ? 0.0f : t[(y / block) * columns + x / block];
+    }
+};
+
+/* Optional inputs and outputs per ray for tracing a packet of primary rays. */
+struct PrimaryRays {
+    // Distances the rays can skip without passing a surface
+    std::span<const float> starts;
+    // Distances to try starting from instead, if further. Verified before they are used.
+    std::span<const float> guesses;
+    // Receives the distance of each hit, or -1 for misses
+    std::span<float> depths;
+    // Receives the index of the object each ray hit, or -1 for misses
+    std::span<int> objects;
+    // Receives the ID of the main material at each hit, or -1 for misses. Tells apart parts of one object.
+    std::span<int> materials;
+    // Receives the work done for each ray and the rays it spawned
+    std::span<PixelStats> stats;
+    // Levels of reflection and refraction to trace, or -1 for SceneProperties::maxDepth
+    int maxDepth = -1;
+};
+
+/**
+ * Marching state of a single ray, advanced one distance evaluation at a time.
+ * @details
+ * Rays marched on their own and rays marched as part of a packet follow the same schedule this way.
+ * The enhanced scheme follows "Enhanced Sphere Tracing" by Keinert et al.: steps are lengthened by the relaxation
+ * factor for as long as consecutive unbounding spheres overlap, and a ray hits once the distance drops below the
+ * radius of its pixel cone. The hit is then moved onto the surface with a few secant steps.
+ */
+class RayMarch {
+public:
+    enum class Status {
+        Marching,
+        Hit,
+        Missed
+    };
+
+    /**
+     * @param pixelAngle Angle covered by a pixel, for the hit threshold of the enhanced scheme
+     * @param t Distance along the ray to start at
+     * @param limit Distance along the ray beyond which it misses
+     */
+    RayMarch(Marcher marcher, float relaxation, float pixelAngle, float t, float limit)
+            : marcher(marcher), omega(marcher == Marcher::Enhanced ? relaxation : 1.0f), pixelAngle(pixelAngle),
+              t(t), limit(limit), tPrevious(t) {}
+
+    /* Distance along the ray to evaluate the scene at next. */
+    [[nodiscard]] float position() const {
+        return t;
+    }
+
+    /* Object the last evaluation was nearest to. */
+    [[nodiscard]] int object() const {
+        return nearest;
+    }
+
+    [[nodiscard]] Status status() const {
+        return state;
+    }
+
+    /* Distance beyond which the ray misses. */
+    [[nodiscard]] float end() const {
+        return limit;
+    }
+
+    /**
+     * Start at a guessed distance beyond the current one, once it is verified that no surface lies in between.
+     * @details
+     * The first evaluation at the guess bounds the empty sphere around it, which reaches back to the guess minus its
+     * distance. If that covers the current distance, the ray goes on from the guess right away. Otherwise the ray
+     * marches from the current distance, and jumps to the guess as soon as the spheres it passes reach that one. A
+     * surface in between is found on the way, as if there had been no guess. Guesses within a surface are dropped.
+     */
+    void guess(float start) {
+        if (start > t && stats.steps == 0) {
+            fallback = t;
+            t = tPrevious = start;
+            ++stats.guesses;
+        }
+    }
+
+    /* Number of steps taken so far. */
+    [[nodiscard]] std::uint64_t steps() const {
+        return stats.steps;
+    }
+
+    /* Take the step for the signed distance `d` of the nearest object, evaluated at position(). */
+    Status step(float d, int object) {
+        ++stats.steps;
+        if (fallback >= 0) {
+            float start = fallback;
+            fallback = -1;
+            if (d <= 0) {
+                ++stats.rejected;
+                t = tPrevious = start;
+                return state = Status::Marching;
+            }
+            if (t - d > start) {
+                // Keep the guess until the march from the start reaches its empty sphere
+                target = {t, d, object};
+                t = tPrevious = start;
+                return state = Status::Marching;
+            }
+        }
+        nearest = object;
+        return advance(d);
+    }
+
+    /**
+     * Move a hit of the enhanced scheme onto the surface with secant steps between the last two positions, keeping
+     * the position nearest to the surface.
+     * @param distance Returns the nearest object and its signed distance at a distance along the ray
+     */
+    template<class Distance>
+    void refine(Distance &&distance) {
+        if (marcher != Marcher::Enhanced || state != Status::Hit) {
+            return;
+        }
+        float t0 = tPrevious, r0 = radius;
+        float t1 = t, r1 = last;
+        float best = glm::abs(r1);
+        // The cone of a grazing ray reaches the surface well before the ray does, so the surface may be far ahead.
+        // Nothing lies before the last sphere though.
+        const float start = tPrevious;
+        for (int i = 0; i < RefineSteps && best > MinThreshold; ++i) {
+            float next = t0 != t1 && r0 != r1 ? t1 - r1 * (t1 - t0) / (r1 - r0) : t1 + r1;
+            if (r0 * r1 > 0 && r1 > 0) {
+                // Not bracketed yet, and a sphere step never passes the surface
+                next = glm::max(next, t1 + r1);
+            }
+            next = glm::clamp(next, start, limit);
+            auto[object, d] = distance(next);
+            ++stats.refinements;
+            float r = side * d;
+            if (glm::abs(r) < best) {
+                best = glm::abs(r);
+                t = next;
+                nearest = object;
+            }
+            // Keep the surface bracketed once it has been crossed
+            if (!(r0 * r1 < 0 && r * r0 < 0)) {
+                t0 = t1;
+                r0 = r1;
+            }
+            t1 = next;
+            r1 = r;
+        }
+    }
+
+    /* Add the work done on this ray to the given statistics. Call once the ray is done. */
+    void report(MarchStats &total) const {
+        total.rays += 1;
+        total.steps += stats.steps;
+        total.hits += state == Status::Hit;
+        total.exhausted += state == Status::Marching;
+        total.backtracks += stats.backtracks;
+        total.refinements += stats.refinements;
+        total.guesses += stats.guesses;
+        // Rays that found a surface before they could verify their guess did not use it either
+        total.rejected += stats.rejected + (target.t >= 0);
+    }
+
+private:
+    static constexpr float MinThreshold = 10e-6;
+    static constexpr int RefineSteps = 4;
+
+    /* Move on from position(), where the signed distance is `d`. */
+    Status advance(float d) {
+        if (marcher == Marcher::Sphere) {
+            float r = glm::abs(d);
+            if (r < MinThreshold) {
+                return state = Status::Hit;
+            }
+            if (reached(d)) {
+                return advance(resume());
+            }
+            t += r;
+            return state = t > limit ? Status::Missed : Status::Marching;
+        }
+
+        // Distances are measured on the side of the surface the ray started on
+        if (side == 0) {
+            side = d < 0 ? -1.0f : 1.0f;
+        }
+        float r = side * d;
+        if (omega > 1 && glm::abs(r) + radius < length) {
+            // The relaxed step left the sphere known to be empty, go back and continue with plain steps
+            ++stats.backtracks;
+            omega = 1;
+            t = tPrevious + radius;
+            length = radius;
+            return state = Status::Marching;
+        }
+        if (r < glm::max(MinThreshold, t * pixelAngle)) {
+            last = r;
+            return state = Status::Hit;
+        }
+        if (reached(d)) {
+            return advance(resume());
+        }
+        tPrevious = t;
+        radius = r;
+        length = r * omega;
+        t += length;
+        return state = t > limit ? Status::Missed : Status::Marching;
+    }
+
+    /* Whether the empty sphere at position(), outside of surfaces, reaches the one of the guess yet to be verified. */
+    [[nodiscard]] bool reached(float d) const {
+        return target.t >= 0 && d > 0 && t + d >= target.t - target.d;
+    }
+
+    /* Continue from the verified guess, returning the distance evaluated there. */
+    float resume() {
+        t = tPrevious = target.t;
+        radius = length = 0;
+        nearest = target.object;
+        target.t = -1;
+        return target.d;
+    }
+
+    Marcher marcher;
+    float omega;
+    float pixelAngle;
+    float t;
+    float limit;
+    Status state = Status::Marching;
+    int nearest = -1;
+    MarchStats stats;
+
+    // Sign of the distance where the ray started, 0 until the first step
+    float side = 0;
+    // Position and distance of the last step that was not taken back, and the length of the step taken from there
+    float tPrevious;
+    float radius = 0;
+    float length = 0;
+    // Distance at the hit
+    float last = 0;
+    // Where to start over if the guessed start is rejected, or -1 once the guess was evaluated
+    float fallback = -1;
+    // Guess waiting for the march from the start to reach its empty sphere, with the distance and object there
+    struct Target {
+        float t = -1;
+        float d = 0;
+        int object = -1;
+    } target;
+};
+
+#endif //PROJECT_MARCH_H
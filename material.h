@@ -5,6 +5,9 @@
 #ifndef PROJECT_MATERIAL_H
 #define PROJECT_MATERIAL_H
 
+#include <array>
+#include <cstdint>
+#include <vector>
 #include <glm/glm.hpp>
 
 class Material {
@@ -80,6 +83,131 @@ public:
             .kd = 0.8
         };
     }
+
+    bool operator==(const Material &) const = default;
+};
+
+/* Index of a material in a MaterialTable. */
+using MaterialId = std::uint16_t;
+
+/**
+ * Materials present at a point, as IDs with weights summing to one.
+ * @details
+ * Blends of more than MaxMaterials materials keep the ones with the largest weights.
+ */
+struct MaterialBlend {
+    static constexpr int MaxMaterials = 4;
+
+    std::array<MaterialId, MaxMaterials> ids{};
+    std::array<float, MaxMaterials> weights{};
+    int count = 0;
+
+    static MaterialBlend of(MaterialId id) {
+        MaterialBlend blend;
+        blend.ids[0] = id;
+        blend.weights[0] = 1;
+        blend.count = 1;
+        return blend;
+    }
+
+    /* ID of the material with the largest weight, -1 for an empty blend. */
+    [[nodiscard]] int dominant() const {
+        int best = -1;
+        for (int i = 0; i < count; ++i) {
+            if (best < 0 || weights[i] > weights[best]) {
+                best = i;
+            }
+        }
+        return best < 0 ? -1 : ids[best];
+    }
+
+    // Linearly interpolate between blends, like Material::mix
+    static MaterialBlend mix(const MaterialBlend &a, const MaterialBlend &b, float factor) {
+        if (factor <= 0 || b.count == 0) {
+            return a;
+        }
+        if (factor >= 1 || a.count == 0) {
+            return b;
+        }
+        MaterialBlend mixed = a;
+        for (int i = 0; i < mixed.count; ++i) {
+            mixed.weights[i] *= 1 - factor;
+        }
+        for (int i = 0; i < b.count; ++i) {
+            mixed.add(b.ids[i], b.weights[i] * factor);
+        }
+        return mixed;
+    }
+
+private:
+    void add(MaterialId id, float weight) {
+        for (int i = 0; i < count; ++i) {
+            if (ids[i] == id) {
+                weights[i] += weight;
+                return;
+            }
+        }
+        if (count < MaxMaterials) {
+            ids[count] = id;
+            weights[count++] = weight;
+            return;
+        }
+        // Full, replace the lightest material and renormalize
+        int lightest = 0;
+        for (int i = 1; i < count; ++i) {
+            if (weights[i] < weights[lightest]) {
+                lightest = i;
+            }
+        }
+        if (weight <= weights[lightest]) {
+            return;
+        }
+        float total = 1 - weights[lightest] + weight;
+        ids[lightest] = id;
+        weights[lightest] = weight;
+        for (int i = 0; i < count; ++i) {
+            weights[i] /= total;
+        }
+    }
+};
+
+/* Materials of a scene, referenced by SDF nodes through their ID. Identical materials share an ID. */
+class MaterialTable {
+public:
+    MaterialId add(const Material &material) {
+        for (std::size_t i = 0; i < materials.size(); ++i) {
+            if (materials[i] == material) {
+                return static_cast<MaterialId>(i);
+            }
+        }
+        materials.push_back(material);
+        return static_cast<MaterialId>(materials.size() - 1);
+    }
+
+    [[nodiscard]] const Material &operator[](MaterialId id) const {
+        return materials[id];
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return materials.size();
+    }
+
+    /* Material at a point, mixing the materials of a blend by their weights. */
+    [[nodiscard]] Material resolve(const MaterialBlend &blend) const {
+        if (blend.count == 0) {
+            return {};
+        }
+        Material material = materials[blend.ids[0]];
+        float total = blend.weights[0];
+        for (int i = 1; i < blend.count; ++i) {
+            total += blend.weights[i];
+            material = Material::mix(material, materials[blend.ids[i]], blend.weights[i] / total);
+        }
+        return material;
+    }
+
+private:
+    std::vector<Material> materials;
 };
 
 #endif //PROJECT_MATERIAL_H
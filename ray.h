@@ -8,6 +8,7 @@
 #include <glm/glm.hpp>
 #include "camera.h"
 #include "material.h"
+#include <optional>
 #include <vector>
 
 using glm::vec3;
@@ -23,10 +24,23 @@ public:
         return start + t * dir;
     }
 
-    static Ray fromView(int x, int y, int w, int h, const std::shared_ptr<Camera>& camera) {
+    static Ray fromView(float x, float y, int w, int h, const std::shared_ptr<Camera>& camera) {
         auto d = vec3 (camera->rot() * vec4(x - w / 2.f, y - h / 2.f, camera->focalLength(), 0)) - camera->pos();
         return Ray(camera->pos(), glm::normalize(d));
     }
+
+    /* Inverse of fromView: the pixel coordinates of the ray through p, if p lies ahead of the camera. */
+    static std::optional<glm::vec2> toView(const vec3 &p, int w, int h, const std::shared_ptr<Camera> &camera) {
+        // fromView aims rays at the image plane, rotated and then shifted by minus the position
+        mat3 inverse = glm::transpose(mat3(camera->rot()));
+        vec3 shift = inverse * camera->pos();
+        vec3 q = inverse * (p - camera->pos());
+        float scale = (camera->focalLength() - shift.z) / q.z;
+        if (!(scale > 0)) {
+            return std::nullopt;
+        }
+        return glm::vec2(q.x * scale + shift.x + w / 2.f, q.y * scale + shift.y + h / 2.f);
+    }
 public:
     const vec3 start;
     const vec3 dir;
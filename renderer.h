@@ -0,0 +1,394 @@
+#ifndef PROJECT_RENDERER_H
+#define PROJECT_RENDERER_H
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "scene.h"
+#include "framebuffer.h"
+#include "reprojection.h"
+#include "scheduler.h"
+
+/* Time and work of rendering a frame. */
+struct FrameStats {
+    double milliseconds = 0;
+    // Rays through the pixels, including the extra samples of anti-aliasing
+    std::uint64_t primaryRays = 0;
+    // Pixels of the frame, and those that received more than one sample
+    std::uint64_t pixels = 0;
+    std::uint64_t antiAliased = 0;
+    // Work of all rays marched for hits, primary and secondary. Rays that miss the scene bounds are not marched.
+    MarchStats march;
+    // Threads rendering tiles, and how often one ran out of tiles and took some from another
+    int threads = 1;
+    std::uint64_t steals = 0;
+    // Whether the frame was cancelled before all tiles were rendered
+    bool cancelled = false;
+
+    [[nodiscard]] double raysPerSecond() const {
+        return milliseconds > 0 ? static_cast<double>(march.rays) * 1000.0 / milliseconds : 0.0;
+    }
+
+    [[nodiscard]] double primaryRaysPerSecond() const {
+        return milliseconds > 0 ? static_cast<double>(primaryRays) * 1000.0 / milliseconds : 0.0;
+    }
+
+    [[nodiscard]] double samplesPerPixel() const {
+        return pixels > 0 ? static_cast<double>(primaryRays) / static_cast<double>(pixels) : 0.0;
+    }
+
+    /* Primary and secondary rays traced per pixel. */
+    [[nodiscard]] double raysPerPixel() const {
+        return pixels > 0 ? static_cast<double>(primaryRays + march.secondary) / static_cast<double>(pixels) : 0.0;
+    }
+};
+
+/**
+ * Adaptive anti-aliasing, which adds jittered samples only to pixels on edges.
+ * @details
+ * A pixel is on an edge if a neighbour hit another object or material, lies at a clearly different depth or differs
+ * in color. Those pixels receive samples in rounds, until their colors agree or the pixel has maxSamples.
+ */
+struct AntiAliasing {
+    // Samples per pixel at most, 1 to turn anti-aliasing off
+    int maxSamples = 1;
+    // Samples added to a pixel per round
+    int round = 4;
+    // Largest difference of a color channel to a neighbour that is not an edge
+    float colorThreshold = 0.1f;
+    // Largest difference in depth to a neighbour that is not an edge, relative to the depth
+    float depthThreshold = 0.05f;
+    // Standard deviation of a color channel over the samples of a pixel, below which it gets no more samples
+    float varianceThreshold = 0.02f;
+};
+
+/* How much of a frame to render, for quick previews that are refined later. */
+struct RenderPass {
+    // Side length of the blocks of pixels that share the color of their top left pixel
+    int block = 1;
+    // Levels of reflection and refraction to trace, or -1 for SceneProperties::maxDepth
+    int maxDepth = -1;
+    // Extra samples on edges, only applied at full resolution
+    AntiAliasing antiAliasing;
+    // Called between tiles on the thread calling render, if given. The frame stops early once it returns true.
+    std::function<bool()> cancel;
+};
+
+/**
+ * Renders frames of a scene from its active camera into a framebuffer.
+ * @details
+ * The image is split into square tiles, which TileScheduler hands out to threads. Primary rays of a tile are traced
+ * in smaller squares as packets. Each frame starts with the cone prepass, and rays also try to start where the
+ * previous frame hit. Call reset when switching to another scene.
+ *
+ * Interactive views can render a coarse pass first and refine it with later ones, see RenderPass. Passes at full
+ * resolution can add samples on edges, see AntiAliasing.
+ */
+class Renderer {
+public:
+    // Side length of the squares of primary rays traced together as a packet
+    static constexpr int PacketSize = 8;
+
+    [[nodiscard]] int getTileSize() const {
+        return tileSize;
+    }
+
+    /* Side length of the tiles handed to threads, in pixels. Best a multiple of PacketSize. */
+    void setTileSize(int size) {
+        tileSize = std::max(size, 1);
+    }
+
+    /**
+     * @param statistics Receives the work done per pixel, if given. Resized to the framebuffer. Only the top left
+     * pixel of each block of a coarse pass receives its work.
+     * @param pass Resolution and depth to render at. Only complete passes at full resolution are reprojected to
+     * later frames, and a cancelled pass leaves the pixels of the tiles it skipped as they were.
+     */
+    FrameStats render(Scene &scene, Framebuffer &target, PixelStatistics *statistics = nullptr,
+                      const RenderPass &pass = {}) {
+        const int width = target.width();
+        const int height = target.height();
+        auto camera = scene.getActiveCamera();
+        // Threads of the tiles below only read the lights
+        scene.ensureLight();
+
+        scene.resetMarchStats();
+        auto start = std::chrono::steady_clock::now();
+
+        // Skip the empty space in front of the scene
+        ConeDepth depth = scene.conePrepass(width, height);
+        // and guess how much more from the last frame
+        std::vector<float> guesses;
+        if (!history.empty()) {
+            guesses = history.reproject(camera);
+        }
+        std::vector<float> depths(static_cast<std::size_t>(width) * height);
+        const bool antiAlias = pass.antiAliasing.maxSamples > 1 && pass.block <= 1;
+        std::vector<int> objects(antiAlias ? depths.size() : 0);
+        std::vector<int> materials(antiAlias ? depths.size() : 0);
+        if (statistics && (statistics->width() != width || statistics->height() != height)) {
+            *statistics = PixelStatistics(width, height);
+        }
+
+        scheduler.plan(width, height, tileSize);
+        if (scratch.size() < static_cast<std::size_t>(TileScheduler::maxThreads())) {
+            scratch.resize(TileScheduler::maxThreads());
+        }
+
+        FrameStats stats;
+        stats.threads = TileScheduler::maxThreads();
+        const int block = std::max(pass.block, 1);
+        std::atomic<std::uint64_t> rays = 0;
+        auto result = scheduler.run([&](const TileScheduler::Tile &tile, int thread) {
+            Scratch &packet = scratch[thread];
+            for (int y0 = tile.y0; y0 < tile.y1; y0 += PacketSize * block) {
+                for (int x0 = tile.x0; x0 < tile.x1; x0 += PacketSize * block) {
+                    int x1 = std::min(x0 + PacketSize * block, tile.x1);
+                    int y1 = std::min(y0 + PacketSize * block, tile.y1);
+                    packet.clear();
+                    for (int y = y0; y < y1; y += block) {
+                        for (int x = x0; x < x1; x += block) {
+                            packet.rays.push_back(Ray::fromView(x, y, width, height, camera));
+                            packet.starts.push_back(depth.at(x, y));
+                            if (!guesses.empty()) {
+                                packet.guesses.push_back(guesses[y * width + x]);
+                            }
+                        }
+                    }
+
+                    std::size_t n = packet.rays.size();
+                    packet.colors.resize(n);
+                    packet.depths.resize(n);
+                    packet.objects.resize(antiAlias ? n : 0);
+                    packet.materials.resize(antiAlias ? n : 0);
+                    packet.stats.assign(statistics ? n : 0, PixelStats{});
+                    scene.trace(packet.rays, packet.colors, {packet.starts, packet.guesses, packet.depths,
+                                                             packet.objects, packet.materials, packet.stats,
+                                                             pass.maxDepth});
+                    rays += n;
+
+                    for (int y = y0, i = 0; y < y1; y += block) {
+                        for (int x = x0; x < x1; x += block, ++i) {
+                            for (int by = y; by < std::min(y + block, y1); ++by) {
+                                for (int bx = x; bx < std::min(x + block, x1); ++bx) {
+                                    target.set(bx, by, packet.colors[i]);
+                                }
+                            }
+                            depths[y * width + x] = packet.depths[i];
+                            if (antiAlias) {
+                                objects[y * width + x] = packet.objects[i];
+                                materials[y * width + x] = packet.materials[i];
+                            }
+                            if (statistics) {
+                                statistics->at(x, y) = packet.stats[i];
+                            }
+                        }
+                    }
+                }
+            }
+        }, pass.cancel);
+        stats.steals = result.steals;
+        stats.cancelled = result.cancelled;
+        stats.primaryRays = rays;
+        stats.pixels = static_cast<std::uint64_t>(width) * height;
+
+        if (antiAlias && !stats.cancelled) {
+            auto edges = findEdges(target, depths, objects, materials, pass.antiAliasing);
+            std::atomic<std::uint64_t> samples = 0, pixels = 0;
+            result = scheduler.run([&](const TileScheduler::Tile &tile, int thread) {
+                auto [tileSamples, tilePixels] = antiAliasTile(scene, target, statistics, pass, edges, tile,
+                                                               scratch[thread]);
+                samples += tileSamples;
+                pixels += tilePixels;
+            }, pass.cancel);
+            stats.steals += result.steals;
+            stats.cancelled = result.cancelled;
+            stats.primaryRays += samples;
+            stats.antiAliased = pixels;
+        }
+        if (block == 1 && !stats.cancelled) {
+            history.record(*camera, width, height, std::move(depths));
+        }
+
+        stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        stats.march = scene.getMarchStats();
+        return stats;
+    }
+
+    /* Forget the previous frame. */
+    void reset() {
+        history = Reprojection();
+    }
+
+private:
+    // Inputs and outputs of the packet a thread traces, kept to reuse their memory for every packet and frame
+    struct Scratch {
+        std::vector<Ray> rays;
+        std::vector<float> starts;
+        std::vector<float> guesses;
+        std::vector<glm::vec3> colors;
+        std::vector<float> depths;
+        std::vector<int> objects;
+        std::vector<int> materials;
+        std::vector<PixelStats> stats;
+
+        void clear() {
+            rays.clear();
+            starts.clear();
+            guesses.clear();
+        }
+    };
+
+    // Color samples of a pixel being anti-aliased
+    struct Accumulator {
+        int x, y;
+        glm::vec3 sum;
+        glm::vec3 squares;
+        int samples;
+    };
+
+    /* Mark the pixels whose object, material, depth or color differs from one of their neighbours. */
+    static std::vector<std::uint8_t> findEdges(const Framebuffer &target, const std::vector<float> &depths,
+                                               const std::vector<int> &objects, const std::vector<int> &materials,
+                                               const AntiAliasing &settings) {
+        const int width = target.width();
+        const int height = target.height();
+        std::vector<std::uint8_t> edges(depths.size());
+        auto differ = [&](int x0, int y0, int x1, int y1) {
+            std::size_t a = static_cast<std::size_t>(y0) * width + x0;
+            std::size_t b = static_cast<std::size_t>(y1) * width + x1;
+            if (objects[a] != objects[b] || materials[a] != materials[b]) {
+                return true;
+            }
+            float near = std::min(depths[a], depths[b]);
+            if (objects[a] >= 0 && std::abs(depths[a] - depths[b]) > settings.depthThreshold * near) {
+                return true;
+            }
+            glm::vec3 difference = glm::abs(target.at(x0, y0) - target.at(x1, y1));
+            return glm::max(difference.r, glm::max(difference.g, difference.b)) > settings.colorThreshold;
+        };
+
+        // Both pixels of a differing pair are marked, so each pair is compared once
+        #pragma omp parallel for
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                std::size_t i = static_cast<std::size_t>(y) * width + x;
+                if ((x > 0 && differ(x, y, x - 1, y)) || (x + 1 < width && differ(x, y, x + 1, y))
+                    || (y > 0 && differ(x, y, x, y - 1)) || (y + 1 < height && differ(x, y, x, y + 1))) {
+                    edges[i] = 1;
+                }
+            }
+        }
+        return edges;
+    }
+
+    /**
+     * Add samples to the edge pixels of a tile, and replace their colors by the mean of all their samples.
+     * @return Samples added, and pixels that received any
+     */
+    std::pair<std::uint64_t, std::uint64_t> antiAliasTile(Scene &scene, Framebuffer &target,
+                                                          PixelStatistics *statistics, const RenderPass &pass,
+                                                          const std::vector<std::uint8_t> &edges,
+                                                          const TileScheduler::Tile &tile, Scratch &packet) {
+        const int width = target.width();
+        const int height = target.height();
+        const AntiAliasing &settings = pass.antiAliasing;
+        const int perRound = std::max(settings.round, 1);
+        auto camera = scene.getActiveCamera();
+
+        // The first sample is the one traced through the pixel already
+        std::vector<Accumulator> pixels;
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            for (int x = tile.x0; x < tile.x1; ++x) {
+                if (edges[static_cast<std::size_t>(y) * width + x]) {
+                    glm::vec3 color = target.at(x, y);
+                    pixels.push_back({x, y, color, color * color, 1});
+                }
+            }
+        }
+
+        std::uint64_t added = 0;
+        std::vector<std::size_t> active(pixels.size());
+        for (std::size_t i = 0; i < active.size(); ++i) {
+            active[i] = i;
+        }
+        const std::size_t packetRays = PacketSize * PacketSize;
+        while (!active.empty()) {
+            // Samples of the round in the order of the active pixels, traced in packets. Rays of a jittered
+            // sample may leave the cones of the prepass, so they start at the camera.
+            std::vector<std::pair<std::size_t, int>> round;
+            for (std::size_t p : active) {
+                int count = std::min(perRound, settings.maxSamples - pixels[p].samples);
+                for (int k = 0; k < count; ++k) {
+                    round.emplace_back(p, pixels[p].samples + k);
+                }
+            }
+            for (std::size_t first = 0; first < round.size(); first += packetRays) {
+                std::size_t n = std::min(packetRays, round.size() - first);
+                packet.clear();
+                for (std::size_t i = 0; i < n; ++i) {
+                    auto [p, sample] = round[first + i];
+                    glm::vec2 offset = jitter(pixels[p].x, pixels[p].y, sample);
+                    packet.rays.push_back(Ray::fromView(static_cast<float>(pixels[p].x) + offset.x,
+                                                        static_cast<float>(pixels[p].y) + offset.y,
+                                                        width, height, camera));
+                }
+                packet.colors.resize(n);
+                packet.stats.assign(statistics ? n : 0, PixelStats{});
+                scene.trace(packet.rays, packet.colors, {{}, {}, {}, {}, {}, packet.stats, pass.maxDepth});
+                for (std::size_t i = 0; i < n; ++i) {
+                    Accumulator &pixel = pixels[round[first + i].first];
+                    pixel.sum += packet.colors[i];
+                    pixel.squares += packet.colors[i] * packet.colors[i];
+                    ++pixel.samples;
+                    if (statistics) {
+                        statistics->at(pixel.x, pixel.y).add(packet.stats[i]);
+                    }
+                }
+                added += n;
+            }
+
+            // Keep sampling pixels whose samples still disagree
+            std::erase_if(active, [&](std::size_t p) {
+                const Accumulator &pixel = pixels[p];
+                auto n = static_cast<float>(pixel.samples);
+                glm::vec3 mean = pixel.sum / n;
+                glm::vec3 variance = glm::max(pixel.squares / n - mean * mean, glm::vec3(0.0f));
+                float deviation = std::sqrt(glm::max(variance.r, glm::max(variance.g, variance.b)));
+                return pixel.samples >= settings.maxSamples || deviation < settings.varianceThreshold;
+            });
+        }
+
+        for (const Accumulator &pixel : pixels) {
+            target.set(pixel.x, pixel.y, pixel.sum / static_cast<float>(pixel.samples));
+        }
+        return {added, pixels.size()};
+    }
+
+    /**
+     * Offset of a sample from the center of its pixel, within half a pixel. Samples follow the R2 sequence, shifted
+     * by a hash of the pixel so that neighbouring pixels do not share a pattern. Sample 0 is the center.
+     */
+    static glm::vec2 jitter(int x, int y, int sample) {
+        if (sample == 0) {
+            return {0, 0};
+        }
+        std::uint32_t hash = static_cast<std::uint32_t>(x) * 0x8da6b343u ^ static_cast<std::uint32_t>(y) * 0xd8163841u;
+        hash = (hash ^ (hash >> 16)) * 0x7feb352du;
+        hash ^= hash >> 15;
+        glm::vec2 shift{static_cast<float>(hash & 0xffff) / 65536.0f, static_cast<float>(hash >> 16) / 65536.0f};
+        glm::vec2 point = glm::fract(shift + static_cast<float>(sample) * glm::vec2{0.7548776662f, 0.5698402910f});
+        return point - 0.5f;
+    }
+
+    // Hit distances of the last frame, to start primary rays of the next one
+    Reprojection history;
+    TileScheduler scheduler;
+    int tileSize = 32;
+    // One per thread
+    std::vector<Scratch> scratch;
+};
+
+#endif //PROJECT_RENDERER_H
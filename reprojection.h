@@ -0,0 +1,94 @@
+#ifndef PROJECT_REPROJECTION_H
+#define PROJECT_REPROJECTION_H
+
+#include <limits>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "camera.h"
+#include "ray.h"
+
+/**
+ * Hit distances of the previous frame, reprojected to guess where the primary rays of the next frame can start.
+ * @details
+ * Hits are moved into the new view and splatted into the nearest pixels, keeping the nearest one. Each pixel guesses
+ * the nearest hit around it, minus a margin. Pixels that no hit lands near, like those disoccluded at the edges of
+ * the view, guess nothing. Guesses are not conservative: the marcher only takes one once the empty spheres around it
+ * and around a safe distance cover the part of the ray in between, see RayMarch::guess.
+ */
+class Reprojection {
+public:
+    /* Keep the hit distances of a frame rendered from the given camera, -1 for misses. */
+    void record(const Camera &camera, int width, int height, std::vector<float> depths) {
+        previous = std::make_shared<Camera>(camera);
+        w = width;
+        h = height;
+        hits = std::move(depths);
+    }
+
+    [[nodiscard]] bool empty() const {
+        return previous == nullptr;
+    }
+
+    /**
+     * Guess the start distance of each pixel for the same resolution, seen from the given camera.
+     * @return One guess per pixel, row major, or 0 where the previous frame tells nothing
+     */
+    [[nodiscard]] std::vector<float> reproject(const std::shared_ptr<Camera> &camera) const {
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        std::vector<float> splat(hits.size(), inf);
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                float t = hits[y * w + x];
+                if (t < 0) {
+                    continue;
+                }
+                vec3 p = Ray::fromView(float(x), float(y), w, h, previous).at(t);
+                auto pixel = Ray::toView(p, w, h, camera);
+                if (!pixel) {
+                    continue;
+                }
+                float depth = glm::distance(p, camera->pos());
+                // Hits spread apart when the camera moves closer, so cover all pixels the hit lies between
+                int x0 = int(glm::floor(pixel->x)), y0 = int(glm::floor(pixel->y));
+                for (int sy = y0; sy <= y0 + 1; ++sy) {
+                    for (int sx = x0; sx <= x0 + 1; ++sx) {
+                        if (sx >= 0 && sx < w && sy >= 0 && sy < h) {
+                            float &s = splat[sy * w + sx];
+                            s = glm::min(s, depth);
+                        }
+                    }
+                }
+            }
+        }
+
+        // Surfaces slope away from the hits, and rays between hits may see nearer ones
+        std::vector<float> guesses(hits.size(), 0.0f);
+        #pragma omp parallel for
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                float nearest = inf;
+                for (int sy = glm::max(y - 1, 0); sy <= glm::min(y + 1, h - 1); ++sy) {
+                    for (int sx = glm::max(x - 1, 0); sx <= glm::min(x + 1, w - 1); ++sx) {
+                        nearest = glm::min(nearest, splat[sy * w + sx]);
+                    }
+                }
+                if (nearest < inf) {
+                    guesses[y * w + x] = nearest * (1 - Margin);
+                }
+            }
+        }
+        return guesses;
+    }
+
+private:
+    // Fraction of the reprojected distance that rays keep in front of it
+    static constexpr float Margin = 0.02f;
+
+    std::shared_ptr<Camera> previous;
+    int w = 0;
+    int h = 0;
+    std::vector<float> hits;
+};
+
+#endif //PROJECT_REPROJECTION_H
@@ -6,7 +6,12 @@
 #include "ray.h"
 #include "light.h"
 #include "sdf/sdf.h"
+#include "bvh.h"
+#include "march.h"
+#include <atomic>
 #include <numbers>
+#include <numeric>
+#include <span>
 
 struct SceneProperties {
     vec3 backgroundColor = vec3{0};
@@ -18,11 +23,19 @@ struct SceneProperties {
     int maxRaymarchSteps = 500;
     float maxRaymarchDist = 20.f;
     int maxDepth = 4;
+    // Reflected and refracted rays are not traced once their weight in the color of the pixel falls below this. Colors
+    // are clamped to [0, 1] at every bounce, so leaving out a ray changes the pixel by at most its weight.
+    float minContribution = 1.0f / 512;
+    Marcher marcher = Marcher::Sphere;
+    // Step multiplier of the enhanced marcher, between 1 and 2
+    float relaxation = 1.6f;
 };
 
 struct DebugProperties {
     bool normals = false;
     bool depth = false;
+    // Color primary rays by the march steps of their pixel, see PixelStats
+    bool steps = false;
 };
 
 class Scene {
@@ -31,10 +44,38 @@ public:
 
     vec3 trace(const Ray &ray);
 
+    /**
+     * Trace a packet of coherent rays, such as the primary rays of a screen tile, writing one color per ray.
+     * @details
+     * The rays are marched together, evaluating every active ray in batches at each step. Once fewer rays than fit in
+     * a batch remain active, they are finished individually. Unlike a single ray, the packet adds no default light, so
+     * that threads can trace packets of the same scene at once.
+     */
+    void trace(std::span<const Ray> rays, std::span<vec3> colors, const PrimaryRays &primary = {});
+
+    /**
+     * Find how far the primary rays of the active camera can go before they may meet a surface, by marching one cone
+     * per block of pixels that contains all rays of the block.
+     * @details
+     * Each level of blocks refines the previous one, starting its cones where the cone of the enclosing block
+     * stopped. Levels should go from coarse to fine, each block size dividing the previous one. The result can be
+     * passed per ray as PrimaryRays::starts to trace.
+     * @param blocks Side lengths in pixels of the blocks of each level
+     * @return Distances for the blocks of the last level
+     */
+    ConeDepth conePrepass(int width, int height, const std::vector<int> &blocks = {8, 4});
+
     void addLight(const std::shared_ptr<Light> &light) {
         lights.push_back(light);
     }
 
+    /* Add the default light if the scene has none, before tracing packets of it from several threads. */
+    void ensureLight() {
+        if (lights.empty()) {
+            addDefaultLight();
+        }
+    }
+
     void addCamera(const std::shared_ptr<Camera> &camera) {
         cameras.push_back(camera);
     }
@@ -65,29 +106,215 @@ public:
         return lights.at(index);
     }
 
+    /* Root nodes of the objects in the scene. */
+    [[nodiscard]] const std::vector<std::shared_ptr<sdf::Node>> &getObjects() const {
+        return sdfNodes;
+    }
+
+    /* Add one object, rebuilding the BVH over all objects. Scenes of many objects should add them with addSDFObjects. */
     void addSDFObject(const std::shared_ptr<sdf::Node> &sdf) {
-        sdfNodes.push_back(sdf);
+        addSDFObjects({sdf});
+    }
+
+    /* Add several objects at once, building the BVH over all objects only once. */
+    void addSDFObjects(const std::vector<std::shared_ptr<sdf::Node>> &objects) {
+        for (auto &sdf : objects) {
+            sdf->bindMaterials(materials);
+            sdfNodes.push_back(sdf);
+            tapes.push_back(sdf::Tape::compile(*sdf));
+            caches.emplace_back();
+        }
+        buildBVH();
+    }
+
+    /**
+     * Simplify the CSG trees of all objects and recompile them. Meant to be called once the scene is complete.
+     * @return What the optimizer did, e.g. the number of nodes before and after
+     */
+    sdf::OptimizeStats optimize() {
+        sdf::Optimizer optimizer;
+        std::vector<std::shared_ptr<sdf::Node>> optimized;
+        for (auto &node : sdfNodes) {
+            optimized.push_back(optimizer.run(node));
+        }
+        sdfNodes = std::move(optimized);
+
+        tapes.clear();
+        for (auto &node : sdfNodes) {
+            tapes.push_back(sdf::Tape::compile(*node));
+        }
+        caches.assign(sdfNodes.size(), {});
+        buildBVH();
+        return optimizer.getStats();
+    }
+
+    /**
+     * Bake the distance field of every bounded object into a brick map, which marching uses away from surfaces.
+     * Meant for static scenes, once they are complete. Optimizing the scene drops the caches.
+     * @param voxelSize Spacing of the cached samples. Marching switches to the exact field a few voxels from surfaces.
+     * @return Memory used by the caches in bytes
+     */
+    std::size_t bakeDistanceCache(float voxelSize = 0.01f) {
+        std::size_t bytes = 0;
+        for (std::size_t i = 0; i < sdfNodes.size(); ++i) {
+            sdf::AABB bounds = bvh.bounds(static_cast<int>(i));
+            caches[i] = bounds.isFinite() ? sdf::BrickMap(tapes[i], bounds, voxelSize) : sdf::BrickMap();
+            bytes += caches[i].bytes();
+        }
+        return bytes;
     }
 
     void setDebugProperties(const DebugProperties& properties) {
         debug = properties;
     }
 
+    /* Work done marching all rays traced since the last reset, including secondary rays. */
+    MarchStats getMarchStats() const {
+        MarchStats stats;
+        stats.rays = marchCounters.rays;
+        stats.steps = marchCounters.steps;
+        stats.hits = marchCounters.hits;
+        stats.exhausted = marchCounters.exhausted;
+        stats.backtracks = marchCounters.backtracks;
+        stats.refinements = marchCounters.refinements;
+        stats.cones = marchCounters.cones;
+        stats.coneSteps = marchCounters.coneSteps;
+        stats.guesses = marchCounters.guesses;
+        stats.rejected = marchCounters.rejected;
+        stats.secondary = marchCounters.secondary;
+        return stats;
+    }
+
+    void resetMarchStats() {
+        for (auto *counter : {&marchCounters.rays, &marchCounters.steps, &marchCounters.hits,
+                              &marchCounters.exhausted, &marchCounters.backtracks, &marchCounters.refinements,
+                              &marchCounters.cones, &marchCounters.coneSteps, &marchCounters.guesses,
+                              &marchCounters.rejected, &marchCounters.secondary}) {
+            *counter = 0;
+        }
+    }
+
 private:
+    // Measures the parts of the tracer
+    friend class Benchmark;
+    // Writes scenes as they are
+    friend class SceneCache;
+
     SceneProperties scene;
     DebugProperties debug;
 
     std::vector<std::shared_ptr<sdf::Node>> sdfNodes;
+    // Materials of all objects, referenced by ID from the samples of their nodes
+    MaterialTable materials;
+    // Compiled distance evaluators, one per entry of sdfNodes
+    std::vector<sdf::Tape> tapes;
+    // Optional distance caches, one per entry of sdfNodes
+    std::vector<sdf::BrickMap> caches;
+    BVH bvh;
     std::vector<std::shared_ptr<Light>> lights;
     std::vector<std::shared_ptr<Camera>> cameras;
     int activeCamIndex = 0;
 
-    std::pair<vec3, vec3> computeLightingModel(const vec3 &p, const vec3 &N, const vec3 &V, const Material &material);
+    // Statistics of the pixel the calling thread traces rays for, if they are recorded
+    static inline thread_local PixelStats *recording = nullptr;
+    // Depth the primary ray of that pixel started with
+    static inline thread_local int recordingDepth = 0;
+
+    // Objects with shorter tapes are marched with their full tape, as specializing them costs more than it saves
+    static constexpr std::size_t MinSpecializedSize = 16;
+    // Ratio of the far to the near distance of the frustum slabs tapes are specialized to. Positions nearer than the
+    // minimum all fall into the nearest slab.
+    static constexpr float SlabRatio = 1.1f;
+    static constexpr float MinSlabDistance = 0.25f;
+
+    // Shadow rays start this far off the surface, along its normal
+    static constexpr float ShadowBias = 0.1f;
+    // Shadow rays stop once they let through less light than this, as the rest of the march can only darken them
+    static constexpr float ShadowSaturation = 1.0f / 1024;
+
+    /* Nodes of the scene BVH that may darken shadow rays starting within a box, one selection per light. */
+    struct TileShadows {
+        sdf::AABB receivers;
+        std::vector<std::vector<char>> lights;
+    };
+    // Shadow casters for the primary hits of the tile the calling thread shades, if shadows are on
+    static inline thread_local const TileShadows *tileShadows = nullptr;
+
+    // Work of the packet the calling thread traces, added to marchCounters once when it is done rather than per ray
+    static inline thread_local MarchStats *packetStats = nullptr;
+
+    // MarchStats gathered from all threads
+    struct {
+        std::atomic<std::uint64_t> rays{0}, steps{0}, hits{0}, exhausted{0}, backtracks{0}, refinements{0};
+        std::atomic<std::uint64_t> cones{0}, coneSteps{0}, guesses{0}, rejected{0}, secondary{0};
+    } marchCounters;
+
+    /* A ray of the tree traced for a primary ray by shade, with the parts of its color once shaded. */
+    struct Bounce {
+        Ray ray;
+        int object;
+        float t;
+        // Bounces left below this ray
+        int depth;
+        // Weight of the ray in the color of the pixel
+        float throughput;
+        // Ray that spawned this one, -1 for the primary ray, and whether as its refraction or its reflection
+        int parent;
+        bool refracted;
+
+        // Whether the color is lit from the parts below, or given directly for misses and debug views
+        bool lit = false;
+        // ID of the main material at the hit, -1 for misses
+        int materialId = -1;
+        Material material;
+        vec3 diffuse{0}, specular{0}, reflection{0}, refraction{0};
+        float kr = 0.5f;
+        vec3 color{0};
+    };
+
+    /* Add the work of rays to the packet the calling thread traces, or to the shared counters outside of one. */
+    void record(const MarchStats &stats) {
+        if (packetStats) {
+            *packetStats += stats;
+            return;
+        }
+        marchCounters.rays += stats.rays;
+        marchCounters.steps += stats.steps;
+        marchCounters.hits += stats.hits;
+        marchCounters.exhausted += stats.exhausted;
+        marchCounters.backtracks += stats.backtracks;
+        marchCounters.refinements += stats.refinements;
+        marchCounters.cones += stats.cones;
+        marchCounters.coneSteps += stats.coneSteps;
+        marchCounters.guesses += stats.guesses;
+        marchCounters.rejected += stats.rejected;
+        marchCounters.secondary += stats.secondary;
+    }
+
+    void buildBVH() {
+        std::vector<sdf::AABB> bounds;
+        for (auto &node : sdfNodes) {
+            bounds.push_back(node->bounds());
+        }
+        bvh = BVH(bounds);
+    }
 
-    std::pair<std::shared_ptr<sdf::Node>, float> raycast(const Ray &ray);
-    std::pair<std::shared_ptr<sdf::Node>, float> minimumSurface(const vec3 &p);
+    std::pair<vec3, vec3> computeLightingModel(const vec3 &p, const vec3 &N, const vec3 &V, const Material &material);
 
-    float computeShadow(const Ray &r, float k);
+    std::pair<int, float> raycast(const Ray &ray);
+    RayMarch startMarch(float t, float limit);
+    std::pair<int, float> march(const Ray &ray, RayMarch &state);
+    std::pair<int, float> finish(const Ray &ray, RayMarch &state, MarchStats &stats);
+    std::pair<float, float> clip(const Ray &ray);
+    void raycast(std::span<const Ray> rays, std::span<std::pair<int, float>> hits, const PrimaryRays &primary,
+                 std::span<PixelStats> pixels);
+    std::pair<int, float> minimumSurface(const vec3 &p);
+    std::pair<int, float> minimumBound(const vec3 &p);
+
+    void findShadows(TileShadows &shadows);
+    static float shadowSpread(const sdf::AABB &receivers, const vec3 &light, float k);
+    static bool mayShadow(const sdf::AABB &box, const sdf::AABB &receivers, const vec3 &light, float spread);
+    float computeShadow(const Ray &r, float k, float length, const std::vector<char> *casters = nullptr);
 
     float computeFresnel(const vec3 &I, const vec3 &N, float etai, float etat = 1);
 
@@ -102,6 +329,8 @@ private:
     }
 
     vec3 trace(const Ray &ray, int depth);
+    vec3 shade(const Ray &ray, int object, float t, int depth, int *material = nullptr);
+    void bounce(std::vector<Bounce> &tree, std::size_t index);
 };
 
 // Phong lighting model.
@@ -109,9 +338,10 @@ std::pair<vec3, vec3>
 Scene::computeLightingModel(const vec3 &p, const vec3 &N, const vec3 &V, const Material &material) {
     vec3 I_D{0, 0, 0}, I_S{0, 0, 0};
 
-    vec3 sBias = N * 0.1f;
+    vec3 sBias = N * ShadowBias;
 
-    for (auto &light : lights) {
+    for (std::size_t i = 0; i < lights.size(); ++i) {
+        const auto &light = lights[i];
         const vec3 L = glm::normalize(light->position - p);
         const vec3 R = glm::normalize(glm::reflect(-L, N));
 
@@ -125,7 +355,11 @@ Scene::computeLightingModel(const vec3 &p, const vec3 &N, const vec3 &V, const M
             const vec3 pos = p + sBias;
 
             const Ray r(pos, L);
-            float shadowFactor = computeShadow(r, scene.shadowIntensity);
+            const std::vector<char> *casters = nullptr;
+            if (tileShadows && tileShadows->receivers.distance(pos) == 0) {
+                casters = &tileShadows->lights[i];
+            }
+            float shadowFactor = computeShadow(r, scene.shadowIntensity, glm::length(light->position - pos), casters);
 
             D *= shadowFactor;
             S *= shadowFactor;
@@ -139,32 +373,82 @@ Scene::computeLightingModel(const vec3 &p, const vec3 &N, const vec3 &V, const M
 }
 
 vec3 Scene::trace(const Ray &ray, int depth) {
+    auto[object, t] = raycast(ray);
+    return shade(ray, object, t, depth);
+}
 
-    auto[node, t] = raycast(ray);
+/**
+ * Shade the hit of a ray with the given object at distance t, or the background for a miss, following reflected and
+ * refracted rays for up to `depth` bounces.
+ * @details
+ * The rays form a binary tree, traced without recursion. Spawned rays are appended to a list and shaded in turn, then
+ * colors are combined from the last ray back to the first, as every ray comes after the one that spawned it. Each ray
+ * carries its weight in the pixel, the product of the Fresnel weights along its path, and rays whose weight would
+ * fall below SceneProperties::minContribution are not spawned.
+ */
+vec3 Scene::shade(const Ray &ray, int object, float t, int depth, int *material) {
+    thread_local std::vector<Bounce> tree;
+    tree.clear();
+    tree.push_back({ray, object, t, depth, 1.0f, -1, false});
+    for (std::size_t i = 0; i < tree.size(); ++i) {
+        bounce(tree, i);
+    }
+    for (std::size_t i = tree.size(); i-- > 0;) {
+        Bounce &b = tree[i];
+        if (b.lit) {
+            b.color = finalColor(b.material, b.diffuse, b.specular, b.refraction, b.reflection, b.kr);
+        }
+        if (b.parent >= 0) {
+            (b.refracted ? tree[b.parent].refraction : tree[b.parent].reflection) = b.color;
+        }
+    }
+    if (tree.size() > 1) {
+        MarchStats stats;
+        stats.secondary = tree.size() - 1;
+        record(stats);
+    }
+    if (material) {
+        *material = tree.front().materialId;
+    }
+    return tree.front().color;
+}
 
+// Shade one ray of the tree traced by shade, and append the reflected and refracted rays it spawns, marched already.
+void Scene::bounce(std::vector<Bounce> &tree, std::size_t index) {
+    // Appending rays moves the tree, so the ray is read up front and its color parts stored before
+    const Ray ray = tree[index].ray;
+    const int depth = tree[index].depth;
+    const float throughput = tree[index].throughput;
+    const float t = tree[index].t;
+    if (recording) {
+        recording->depth = std::max(recording->depth, static_cast<std::uint32_t>(glm::max(recordingDepth - depth, 0)));
+    }
     if (t < 0) {
-        return scene.backgroundColor;
+        tree[index].color = scene.backgroundColor;
+        return;
     }
 
     vec3 p = ray.at(t);
 
-    auto sample = node->sampleAt(p);
-    vec3 N = node->normal(p, 1e-4f);
+    auto sample = sdfNodes[tree[index].object]->sampleAt(p);
+    tree[index].materialId = sample.materials.dominant();
+    vec3 N = sdfNodes[tree[index].object]->normal(p);
 
     bool inside = glm::dot(N, -ray.dir) < 0;
     vec3 facingNormal = inside ? -N : N;
 
     vec3 diffuse{0}, specular{0};
-    Material material = sample.material;
+    Material material = materials.resolve(sample.materials);
 
     if (debug.normals) {
-        return N * 0.5f + 0.5f;
+        tree[index].color = N * 0.5f + 0.5f;
+        return;
     }
 
     if (debug.depth) {
         vec3 c = p - getActiveCamera()->pos();
-        vec3 col = vec3{1.0f / c.z};
-        return col;
+        tree[index].color = vec3{1.0f / c.z};
+        return;
     }
 
     if (scene.illumination) {
@@ -174,7 +458,7 @@ vec3 Scene::trace(const Ray &ray, int depth) {
     }
 
     float kr = 0.5f;
-    vec3 refraction{0}, reflection{0}, absorption{0, 0, 0};
+    std::optional<Ray> reflected, transmitted;
     if (scene.fresnel && depth > 0) {
         vec3 R = glm::normalize(glm::reflect(ray.dir, facingNormal));
 
@@ -189,32 +473,32 @@ vec3 Scene::trace(const Ray &ray, int depth) {
 
         kr = computeFresnel(ray.dir, facingNormal, etai, etat);
 
-        // reflection
-        if (material.ks > 0) {
-            vec3 bias = facingNormal * 1e-4f;
-            vec3 rlPos = p + bias;
-
-            reflection = trace(Ray(rlPos, R), depth - 1);
+        vec3 bias = facingNormal * 1e-4f;
+        if (material.ks > 0 && throughput * kr * material.ks >= scene.minContribution) {
+            reflected.emplace(p + bias, R);
         }
-
-        // refraction
-        if (kr < 1 && material.transmittance > 0 && material.ks > 0) {
-            vec3 bias = facingNormal * 1e-4f;
-            vec3 rfPos = p - bias;
-
-            Ray transmitted(rfPos, T);
-
-            if (scene.absorption) {
-                auto[inner, dist] = raycast(transmitted);
-                absorption = material.albedo * (1.0f / glm::pow((dist + 1), 1.f)) * material.absorption;
-            }
-
-            refraction = trace(transmitted, depth - 1);
+        if (kr < 1 && material.transmittance > 0 && material.ks > 0
+            && throughput * (1 - kr) * material.transmittance >= scene.minContribution) {
+            transmitted.emplace(p - bias, T);
         }
     }
 
-    vec3 final = finalColor(material, diffuse, specular, refraction, reflection, kr);
-    return final;
+    Bounce &b = tree[index];
+    b.lit = true;
+    b.material = material;
+    b.diffuse = diffuse;
+    b.specular = specular;
+    b.kr = kr;
+    auto parent = static_cast<int>(index);
+    if (reflected) {
+        auto[object, distance] = raycast(*reflected);
+        tree.push_back({*reflected, object, distance, depth - 1, throughput * kr * material.ks, parent, false});
+    }
+    if (transmitted) {
+        auto[object, distance] = raycast(*transmitted);
+        tree.push_back({*transmitted, object, distance, depth - 1, throughput * (1 - kr) * material.transmittance,
+                        parent, true});
+    }
 }
 
 vec3 Scene::finalColor(const Material &material, const vec3 &diffuse, const vec3 &specular, const vec3 &refraction,
@@ -231,40 +515,83 @@ vec3 Scene::finalColor(const Material &material, const vec3 &diffuse, const vec3
     return glm::clamp(local + fresnel, 0.f, 1.f);
 }
 
-// Find the Node that produces the smallest signed distance out of all nodes.
-std::pair<std::shared_ptr<sdf::Node>, float> Scene::minimumSurface(const vec3 &p) {
+// Find the index of the object that produces the smallest signed distance out of all objects.
+std::pair<int, float> Scene::minimumSurface(const vec3 &p) {
 
-    float min = std::numeric_limits<float>::infinity();
-    std::shared_ptr<sdf::Node> minNode;
-    for (auto &node : sdfNodes) {
-        float d = node->signedDistance(p);
-        if (d < min) {
-            min = d;
-            minNode = node;
+    return bvh.nearest(p, [&](int object) {
+        if (recording) {
+            ++recording->evaluations;
         }
-    }
-    return std::make_pair(minNode, min);
+        return tapes[object].signedDistance(p);
+    });
 }
 
-// Implementation of Sphere Casting, adapted for negative distances.
-std::pair<std::shared_ptr<sdf::Node>, float> Scene::raycast(const Ray &ray) {
-    float t = 0.0f;
-
-    std::shared_ptr<sdf::Node> hit;
-    for (int i = 0; i < scene.maxRaymarchSteps; ++i) {
-        float min = std::numeric_limits<float>::infinity();
-        std::tie(hit, min) = minimumSurface(ray.at(t));
-        min = glm::abs(min);
-        if (min < 10e-6) {
-            break;
+// Like minimumSurface, but takes bounds from the distance caches where they are available. Distances are only exact
+// near surfaces, which is all marching needs to find them.
+std::pair<int, float> Scene::minimumBound(const vec3 &p) {
+    return bvh.nearest(p, [&](int object) {
+        if (recording) {
+            ++recording->evaluations;
         }
-        t += min;
-        if (t > scene.maxRaymarchDist) {
-            t = -1;
-            break;
+        if (auto bound = caches[object].lookup(p)) {
+            return *bound;
         }
+        return tapes[object].signedDistance(p);
+    });
+}
+
+// Range of distances along the ray that lie within the scene bounds and the maximum raymarching distance.
+std::pair<float, float> Scene::clip(const Ray &ray) {
+    auto[enter, exit] = bvh.bounds().intersect(ray.start, ray.dir);
+    return {glm::max(enter, 0.0f), glm::min(exit, scene.maxRaymarchDist)};
+}
+
+std::pair<int, float> Scene::raycast(const Ray &ray) {
+    auto[enter, exit] = clip(ray);
+    if (enter > exit) {
+        return std::make_pair(-1, -1.0f);
+    }
+    RayMarch state = startMarch(enter, exit);
+    return march(ray, state);
+}
+
+// Marching state for a ray entering the scene at distance t and leaving it at `limit`, with the configured marcher.
+RayMarch Scene::startMarch(float t, float limit) {
+    // Rays diverge by about a pixel per focal length
+    float pixelAngle = cameras.empty() ? 0.0f : 1.0f / cameras[activeCamIndex]->focalLength();
+    return {scene.marcher, scene.relaxation, pixelAngle, t, limit};
+}
+
+// Implementation of Sphere Casting, adapted for negative distances. Continues the march of a ray from its current
+// state until it hits, misses, or runs out of steps.
+std::pair<int, float> Scene::march(const Ray &ray, RayMarch &state) {
+    while (state.status() == RayMarch::Status::Marching && state.steps() < scene.maxRaymarchSteps) {
+        auto[object, d] = minimumBound(ray.at(state.position()));
+        state.step(d, object);
     }
-    return std::make_pair(hit, t);
+    MarchStats stats;
+    auto hit = finish(ray, state, stats);
+    record(stats);
+    return hit;
+}
+
+// Refine the hit of a ray that is done marching and report its work. Rays out of steps stop where they are, misses
+// report no object.
+std::pair<int, float> Scene::finish(const Ray &ray, RayMarch &state, MarchStats &stats) {
+    state.refine([&](float t) {
+        return minimumSurface(ray.at(t));
+    });
+    state.report(stats);
+    if (recording) {
+        recording->steps += static_cast<std::uint32_t>(state.steps());
+        recording->exhausted |= state.status() == RayMarch::Status::Marching;
+        recording->distanceLimit |= state.status() == RayMarch::Status::Missed && state.end() >= scene.maxRaymarchDist;
+    }
+    if (state.status() == RayMarch::Status::Missed) {
+        // The last nearest object was not hit
+        return {-1, -1.0f};
+    }
+    return {state.object(), state.position()};
 }
 
 float Scene::computeFresnel(const vec3 &I, const vec3 &N, float etai, float etat) {
@@ -289,14 +616,97 @@ float Scene::computeFresnel(const vec3 &I, const vec3 &N, float etai, float etat
     return kr;
 }
 
-// Soft shadows for SDFs. https://iquilezles.org/www/articles/rmshadows/rmshadows.htm
-float Scene::computeShadow(const Ray &r, float k) {
+/* Select the casters of each light for shadow rays that start within the receivers, from the scene BVH. */
+void Scene::findShadows(TileShadows &shadows) {
+    shadows.lights.resize(lights.size());
+    for (std::size_t i = 0; i < lights.size(); ++i) {
+        const vec3 &light = lights[i]->position;
+        const float spread = shadowSpread(shadows.receivers, light, scene.shadowIntensity);
+        bvh.select([&](const sdf::AABB &box) {
+            return mayShadow(box, shadows.receivers, light, spread);
+        }, shadows.lights[i]);
+    }
+}
+
+/**
+ * Distance a bound needs to keep from the shadow rays that start within a box of receivers and end at a light, for
+ * the shadow factor of computeShadow to stay 1, see mayShadow.
+ * @details
+ * A surface lowers the shadow factor below 1 only if it comes nearer than t / k to the point at distance t along the
+ * ray. Twice the furthest reach from the light, plus the distance that counts as a hit, covers that for every ray.
+ */
+float Scene::shadowSpread(const sdf::AABB &receivers, const vec3 &light, float k) {
+    float reach = glm::length(glm::max(glm::abs(receivers.min - light), glm::abs(receivers.max - light)));
+    return 2.0f * reach / k + 0.001f;
+}
+
+/**
+ * Whether a bound may darken the shadow rays that start within a box of receivers and end at a light.
+ * @details
+ * The bound can be left out if it lies beyond a plane along one of the axes, by `spread` at the light and by the hit
+ * distance at the receivers. That holds for every point of the rays, as gaps along an axis change linearly along
+ * them. Bounds within a bound that can be left out can be left out as well.
+ */
+bool Scene::mayShadow(const sdf::AABB &box, const sdf::AABB &receivers, const vec3 &light, float spread) {
+    if (box.isEmpty()) {
+        return false;
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (box.min[i] - receivers.max[i] >= 0.001f && box.min[i] - light[i] >= spread) {
+            return false;
+        }
+        if (receivers.min[i] - box.max[i] >= 0.001f && light[i] - box.max[i] >= spread) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Soft shadows for SDFs. https://iquilezles.org/www/articles/rmshadows/rmshadows.htm
+ * @details
+ * The ray is marched up to the light, `length` away, over the given casters of the scene BVH or else all of it.
+ * Unbounded objects, such as the ground, are left out for the ray by itself, as they are few and rarely
+ * lie between the surface and the light. The march stops early once the shadow factor drops below ShadowSaturation.
+ */
+float Scene::computeShadow(const Ray &r, float k, float length, const std::vector<char> *casters) {
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    if (bvh.bounds().isEmpty()) {
+        return 1.0f;
+    }
+    const sdf::AABB start{r.start, r.start};
+    const vec3 light = r.at(length);
+    // Unbounded objects that cannot darken the ray
+    thread_local std::vector<int> skipped;
+    skipped.clear();
+    for (int i : bvh.getUnbounded()) {
+        if (!mayShadow(bvh.bounds(i), start, light, shadowSpread(start, light, k))) {
+            skipped.push_back(i);
+        }
+    }
+
+    length = glm::min(length, scene.maxRaymarchDist);
     float res = 1.0f;
     float ph = std::numeric_limits<float>::max();
     float t = 0.0f;
     for (int i = 0; i < scene.maxRaymarchSteps; ++i) {
         vec3 p = r.at(t);
-        auto[closest, h] = minimumSurface(p);
+        float h = inf;
+        bvh.traverse([&](const sdf::AABB &box) {
+            float d = box.distance(p);
+            return d < h ? d : inf;
+        }, [&](int object) {
+            if (std::find(skipped.begin(), skipped.end(), object) != skipped.end()) {
+                return;
+            }
+            if (recording) {
+                ++recording->evaluations;
+            }
+            h = glm::min(h, tapes[object].signedDistance(p));
+        }, casters);
+        if (recording) {
+            ++recording->shadowSteps;
+        }
 
         if (h < 0.001) {
             return 0.0f;
@@ -305,9 +715,12 @@ float Scene::computeShadow(const Ray &r, float k) {
         float y = h * h / (2.0f * ph);
         float d = glm::sqrt(glm::abs(h * h - y * y));
         res = glm::min(res, k * d / glm::max(0.0001f, t - y));
+        if (res < ShadowSaturation) {
+            break;
+        }
         ph = h;
         t += h;
-        if (t > scene.maxRaymarchDist) {
+        if (t > length) {
             break;
         }
     }
@@ -315,11 +728,268 @@ float Scene::computeShadow(const Ray &r, float k) {
 }
 
 vec3 Scene::trace(const Ray &ray) {
-    if (lights.empty()) {
-        addDefaultLight();
-    }
+    ensureLight();
     return trace(ray, scene.maxDepth);
 }
 
+// Packet version of raycast. Every active ray takes the same step of the schedule in raycast at once. Rays start no
+// nearer than their entry in `starts` and try their guess, if given. Work per ray is added to `pixels`, if given.
+void Scene::raycast(std::span<const Ray> rays, std::span<std::pair<int, float>> hits, const PrimaryRays &primary,
+                    std::span<PixelStats> pixels) {
+    const std::size_t n = rays.size();
+    std::vector<RayMarch> states;
+    states.reserve(n);
+    std::vector<std::size_t> active;
+    for (std::size_t r = 0; r < n; ++r) {
+        auto[enter, exit] = clip(rays[r]);
+        if (!primary.starts.empty()) {
+            enter = glm::max(enter, primary.starts[r]);
+        }
+        states.push_back(startMarch(enter, exit));
+        if (enter > exit) {
+            hits[r] = {-1, -1.0f};
+            continue;
+        }
+        if (!primary.guesses.empty() && primary.guesses[r] < exit) {
+            states.back().guess(primary.guesses[r]);
+        }
+        active.push_back(r);
+    }
+
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> x(n), y(n), z(n), d(n), min(n);
+    std::vector<int> minObject(n);
+    // Rays of the packet that need the exact field of a cached object
+    std::vector<float> ex(n), ey(n), ez(n), ed(n);
+    std::vector<std::size_t> exact(n);
+
+    // Tapes of large objects specialized to slabs of the frustum of the packet, which leaves out the parts of their
+    // trees that cannot be nearest there. Slabs deepen with the distance like the frustum widens, and each step takes
+    // the tape of the slabs the positions of its rays span, so a tape is specialized once per packet and slab range.
+    struct Specialized {
+        int object;
+        int first, last;
+        sdf::Tape tape;
+    };
+    std::vector<Specialized> specialized;
+    auto slab = [](float t) {
+        return static_cast<int>(std::floor(std::log(glm::max(t, MinSlabDistance)) / std::log(SlabRatio)));
+    };
+    auto slabStart = [&](int i) {
+        return i <= slab(MinSlabDistance) ? 0.0f : std::pow(SlabRatio, static_cast<float>(i));
+    };
+    int first = 0, last = 0;
+    auto tapeFor = [&](int object) -> const sdf::Tape & {
+        const sdf::Tape &full = tapes[object];
+        if (full.size() < MinSpecializedSize) {
+            return full;
+        }
+        auto it = std::find_if(specialized.begin(), specialized.end(), [&](const Specialized &s) {
+            return s.object == object && s.first == first && s.last == last;
+        });
+        if (it == specialized.end()) {
+            // Segments of the rays within the slabs, which every position of this step lies on, with some room for
+            // rounding of the logarithm
+            float start = slabStart(first) * 0.999f, end = slabStart(last + 1) * 1.001f;
+            sdf::AABB region;
+            for (const auto &ray : rays) {
+                region = region.merge({ray.at(start), ray.at(start)}).merge({ray.at(end), ray.at(end)});
+            }
+            it = specialized.insert(specialized.end(), {object, first, last, full.specialize(region)});
+        }
+        return it->tape.size() < full.size() ? it->tape : full;
+    };
+
+    MarchStats stats;
+    for (int step = 0; step < scene.maxRaymarchSteps && active.size() >= sdf::simd::Width; ++step) {
+        const std::size_t m = active.size();
+        float tNear = inf, tFar = 0;
+        for (std::size_t j = 0; j < m; ++j) {
+            float t = states[active[j]].position();
+            vec3 p = rays[active[j]].at(t);
+            x[j] = p.x;
+            y[j] = p.y;
+            z[j] = p.z;
+            tNear = glm::min(tNear, t);
+            tFar = glm::max(tFar, t);
+        }
+        first = slab(tNear);
+        last = slab(tFar);
+
+        // Objects are evaluated for the whole packet if their bounds are nearer than the best distance of any ray
+        std::fill_n(min.begin(), m, inf);
+        std::fill_n(minObject.begin(), m, -1);
+        bvh.traverse([&](const sdf::AABB &box) {
+            float nearest = inf;
+            for (std::size_t j = 0; j < m; ++j) {
+                float b = box.distance(vec3{x[j], y[j], z[j]});
+                if (b < min[j]) {
+                    nearest = glm::min(nearest, b);
+                }
+            }
+            return nearest;
+        }, [&](int object) {
+            const sdf::Tape &tape = tapeFor(object);
+            if (caches[object].empty()) {
+                tape.signedDistances(x.data(), y.data(), z.data(), d.data(), m);
+            } else {
+                std::size_t e = 0;
+                for (std::size_t j = 0; j < m; ++j) {
+                    if (auto bound = caches[object].lookup(vec3{x[j], y[j], z[j]})) {
+                        d[j] = *bound;
+                    } else {
+                        ex[e] = x[j];
+                        ey[e] = y[j];
+                        ez[e] = z[j];
+                        exact[e++] = j;
+                    }
+                }
+                tape.signedDistances(ex.data(), ey.data(), ez.data(), ed.data(), e);
+                for (std::size_t j = 0; j < e; ++j) {
+                    d[exact[j]] = ed[j];
+                }
+            }
+            for (std::size_t j = 0; j < m; ++j) {
+                if (d[j] < min[j]) {
+                    min[j] = d[j];
+                    minObject[j] = object;
+                }
+            }
+            if (!pixels.empty()) {
+                for (std::size_t j = 0; j < m; ++j) {
+                    ++pixels[active[j]].evaluations;
+                }
+            }
+        });
+
+        // Retire rays that hit or escaped, keeping the remaining ones packed at the front
+        std::size_t remaining = 0;
+        for (std::size_t j = 0; j < m; ++j) {
+            std::size_t r = active[j];
+            if (states[r].step(min[j], minObject[j]) == RayMarch::Status::Marching) {
+                active[remaining++] = r;
+            } else {
+                recording = pixels.empty() ? nullptr : &pixels[r];
+                hits[r] = finish(rays[r], states[r], stats);
+            }
+        }
+        active.resize(remaining);
+    }
+    record(stats);
+
+    // The packet diverged or ran out of steps, finish the stragglers one at a time
+    for (std::size_t r : active) {
+        recording = pixels.empty() ? nullptr : &pixels[r];
+        hits[r] = march(rays[r], states[r]);
+    }
+    recording = nullptr;
+}
+
+void Scene::trace(std::span<const Ray> rays, std::span<vec3> colors, const PrimaryRays &primary) {
+    // The steps view needs statistics even if the caller does not
+    std::span<PixelStats> pixels = primary.stats;
+    std::vector<PixelStats> steps;
+    if (debug.steps && pixels.empty()) {
+        steps.resize(rays.size());
+        pixels = steps;
+    }
+
+    MarchStats stats;
+    packetStats = &stats;
+    std::vector<std::pair<int, float>> hits(rays.size());
+    raycast(rays, hits, primary, pixels);
+
+    // Shadow casters are found once per tile for the points its primary rays hit, reflections may land elsewhere
+    thread_local TileShadows shadows;
+    if (scene.shadowing && scene.illumination) {
+        sdf::AABB receivers;
+        for (std::size_t i = 0; i < rays.size(); ++i) {
+            if (hits[i].second >= 0) {
+                vec3 p = rays[i].at(hits[i].second);
+                receivers = receivers.merge({p, p});
+            }
+        }
+        if (!receivers.isEmpty()) {
+            shadows.receivers = receivers.expand(ShadowBias * 1.01f);
+            findShadows(shadows);
+            tileShadows = &shadows;
+        }
+    }
+    const int maxDepth = primary.maxDepth < 0 ? scene.maxDepth : primary.maxDepth;
+    recordingDepth = maxDepth;
+    for (std::size_t i = 0; i < rays.size(); ++i) {
+        if (!primary.depths.empty()) {
+            primary.depths[i] = hits[i].second;
+        }
+        if (!primary.objects.empty()) {
+            primary.objects[i] = hits[i].second < 0 ? -1 : hits[i].first;
+        }
+        recording = pixels.empty() ? nullptr : &pixels[i];
+        if (recording) {
+            ++recording->samples;
+        }
+        colors[i] = shade(rays[i], hits[i].first, hits[i].second, maxDepth,
+                          primary.materials.empty() ? nullptr : &primary.materials[i]);
+        if (debug.steps) {
+            colors[i] = heatmapColor(static_cast<float>(pixels[i].steps) / static_cast<float>(scene.maxRaymarchSteps));
+        }
+    }
+    recording = nullptr;
+    tileShadows = nullptr;
+    packetStats = nullptr;
+    record(stats);
+}
+
+ConeDepth Scene::conePrepass(int width, int height, const std::vector<int> &blocks) {
+    auto camera = getActiveCamera();
+    ConeDepth depth;
+    std::uint64_t cones = 0, steps = 0;
+    for (int block : blocks) {
+        ConeDepth level{block, (width + block - 1) / block, (height + block - 1) / block, {}};
+        level.t.resize(static_cast<std::size_t>(level.columns) * level.rows);
+
+        #pragma omp parallel for schedule(dynamic) reduction(+ : steps)
+        for (int i = 0; i < level.columns * level.rows; ++i) {
+            int x0 = (i % level.columns) * block;
+            int y0 = (i / level.columns) * block;
+            int x1 = glm::min(x0 + block, width) - 1;
+            int y1 = glm::min(y0 + block, height) - 1;
+
+            // All rays start at the camera, so a ray is never further than t * spread from the axis at distance t.
+            // Rays of the block lie within the rays through its corners.
+            Ray axis = Ray::fromView(0.5f * float(x0 + x1), 0.5f * float(y0 + y1), width, height, camera);
+            float spread = 0;
+            for (auto[x, y] : {std::pair{x0, y0}, {x1, y0}, {x0, y1}, {x1, y1}}) {
+                Ray corner = Ray::fromView(float(x), float(y), width, height, camera);
+                spread = glm::max(spread, glm::length(corner.dir - axis.dir));
+            }
+            spread = spread * 1.01f + 1e-6f;
+
+            // Every ray stays within the empty sphere at the axis for as long as the step below, and the cone stops
+            // once steps get shorter than its width
+            float t = depth.at(x0, y0);
+            for (int step = 0; step < scene.maxRaymarchSteps; ++step) {
+                ++steps;
+                float d = minimumBound(axis.at(t)).second;
+                float advance = (d - t * spread) / (1 + spread);
+                if (advance > 0) {
+                    t = glm::min(t + advance, scene.maxRaymarchDist);
+                }
+                if (advance < t * spread + 10e-6 || t >= scene.maxRaymarchDist) {
+                    break;
+                }
+            }
+            level.t[i] = t;
+        }
+        cones += level.t.size();
+        depth = std::move(level);
+    }
+
+    MarchStats stats;
+    stats.cones = cones;
+    stats.coneSteps = steps;
+    record(stats);
+    return depth;
+}
 
 #endif //SECONDLAB_SCENE_H
@@ -0,0 +1,1153 @@
+#ifndef PROJECT_SCENEFILE_H
+#define PROJECT_SCENEFILE_H
+
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "scene.h"
+#include "camera.h"
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Read-only contents of a whole file, memory mapped where the platform allows it and read into memory otherwise. */
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path &path) {
+#if __has_include(<sys/mman.h>)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info{};
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            void *view = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED) {
+                bytes = static_cast<const char *>(view);
+                length = static_cast<std::size_t>(info.st_size);
+                mapped = true;
+            }
+        }
+        ::close(fd);
+        if (mapped) {
+            open = true;
+            return;
+        }
+#endif
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return;
+        }
+        copy.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        bytes = copy.data();
+        length = copy.size();
+        open = true;
+    }
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#if __has_include(<sys/mman.h>)
+        if (mapped) {
+            ::munmap(const_cast<char *>(bytes), length);
+        }
+#endif
+    }
+
+    [[nodiscard]] bool isOpen() const {
+        return open;
+    }
+
+    [[nodiscard]] const char *data() const {
+        return bytes;
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return length;
+    }
+
+private:
+    const char *bytes = nullptr;
+    std::size_t length = 0;
+    bool open = false;
+    bool mapped = false;
+    // Contents of the file where it could not be mapped
+    std::vector<char> copy;
+};
+
+/**
+ * Reads scenes from their text description.
+ * @details
+ * A scene file is a list of statements, each a keyword followed by its arguments. `#` starts a comment.
+ *
+ *     scene { background 0.2 0.2 0.25  illumination true  maxDepth 6  marcher enhanced }
+ *     material glass { albedo 0.75 0.75 0.1  ks 1  p 36  ior 1.45  transmittance 0.8 }
+ *     light { position -0.4 -1 -0.7  color 1 1 1  intensity 10 }
+ *     camera { position 0 0 -3  up 0 1 0  focal 1  active }
+ *     define dot transform position 0.25 0.51 0 { sphere 0.1 material glass }
+ *     object difference smooth 0.01 { box 0.5 0.5 0.5 material glass  use dot }
+ *
+ * Nodes are the primitives of sdf/shapes.h and the operations of sdf/ops.h:
+ *  - `sphere r`, `plane nx ny nz h`, `torus R r`, `box x y z`, `triangle x0 y0 z0 x1 y1 z1 x2 y2 z2`,
+ *    `mesh "file.obj"` and `empty`. Primitives may be followed by `material name`.
+ *  - `union`, `difference` and `intersection`, optionally followed by `smooth k`, then their operands in braces.
+ *    Smooth unions of more than two operands blend them in order, like `a + b + c` in sdf/utils.h.
+ *  - `transform [position x y z] [rotation x y z] [scale s | scale x y z] { node }`, rotating by degrees.
+ *  - `elongate x y z { node }`, `round r [fixed] { node }` and `onion t { node }`. Fixed rounding is never absorbed
+ *    into the smoothness of a parent, like operator%= in sdf/utils.h.
+ *  - `use name`, for a node named by `define` before. All uses share the same node.
+ * A scene needs at least one camera, the first one is active unless another is marked `active`. Materials need to be
+ * defined before they are used. Focal lengths are in image widths, and mesh paths relative to the scene file.
+ *
+ * The text is read in a single pass, building nodes as soon as they are parsed.
+ */
+class SceneParser {
+public:
+    /* @param width Width of the rendered images in pixels, which focal lengths are relative to */
+    explicit SceneParser(int width) : width(width) {}
+
+    /* Read a scene file. nullptr if the file cannot be read or is invalid, see getError. */
+    std::unique_ptr<Scene> load(const std::filesystem::path &path) {
+        MappedFile file(path);
+        if (!file.isOpen()) {
+            error = "cannot read " + path.string();
+            return nullptr;
+        }
+        return parse({file.data(), file.size()}, path.parent_path());
+    }
+
+    /**
+     * Build a scene from its description.
+     * @param directory Directory that paths in the description are relative to
+     * @return nullptr if the description is invalid, see getError
+     */
+    std::unique_ptr<Scene> parse(std::string_view source, const std::filesystem::path &directory = {}) {
+        text = source;
+        at = 0;
+        line = 1;
+        base = directory;
+        error.clear();
+        materials.clear();
+        definitions.clear();
+        files.clear();
+
+        SceneProperties properties;
+        std::vector<std::shared_ptr<Light>> lights;
+        std::vector<std::shared_ptr<Camera>> cameras;
+        std::shared_ptr<Camera> active;
+        std::vector<std::shared_ptr<sdf::Node>> objects;
+        for (std::string_view keyword = next(); !keyword.empty(); keyword = next()) {
+            bool valid;
+            if (keyword == "scene") {
+                valid = parseProperties(properties);
+            } else if (keyword == "material") {
+                std::string name(next());
+                valid = parseMaterial(materials[name]);
+            } else if (keyword == "light") {
+                lights.push_back(parseLight());
+                valid = lights.back() != nullptr;
+            } else if (keyword == "camera") {
+                bool isActive = false;
+                cameras.push_back(parseCamera(isActive));
+                valid = cameras.back() != nullptr;
+                if (isActive) {
+                    active = cameras.back();
+                }
+            } else if (keyword == "define") {
+                std::string name(next());
+                auto node = parseNode();
+                valid = node != nullptr;
+                definitions[name] = node;
+            } else if (keyword == "object") {
+                objects.push_back(parseNode());
+                valid = objects.back() != nullptr;
+            } else {
+                valid = fail("unknown statement '" + std::string(keyword) + "'");
+            }
+            if (!valid) {
+                return nullptr;
+            }
+        }
+        if (cameras.empty()) {
+            fail("scene has no camera");
+            return nullptr;
+        }
+
+        auto scene = std::make_unique<Scene>(properties);
+        for (auto &light : lights) {
+            scene->addLight(light);
+        }
+        for (auto &camera : cameras) {
+            scene->addCamera(camera);
+        }
+        if (active) {
+            scene->setActiveCamera(active);
+        }
+        scene->addSDFObjects(objects);
+        return scene;
+    }
+
+    /* Why the last scene could not be read, with the line of the error. */
+    [[nodiscard]] const std::string &getError() const {
+        return error;
+    }
+
+    /* Other files the last scene was built from, like meshes, as absolute paths. */
+    [[nodiscard]] const std::vector<std::filesystem::path> &getFiles() const {
+        return files;
+    }
+
+private:
+    using NodePtr = std::shared_ptr<sdf::Node>;
+
+    int width;
+    std::string_view text;
+    std::size_t at = 0;
+    int line = 1;
+    std::filesystem::path base;
+    std::string error;
+    std::map<std::string, Material, std::less<>> materials;
+    std::map<std::string, NodePtr, std::less<>> definitions;
+    std::vector<std::filesystem::path> files;
+
+    bool fail(const std::string &message) {
+        if (error.empty()) {
+            error = "line " + std::to_string(line) + ": " + message;
+        }
+        return false;
+    }
+
+    static std::string describe(std::string_view token) {
+        return token.empty() ? "end of file" : "'" + std::string(token) + "'";
+    }
+
+    void skipSpace() {
+        while (at < text.size()) {
+            char c = text[at];
+            if (c == '#') {
+                while (at < text.size() && text[at] != '\n') {
+                    ++at;
+                }
+            } else if (std::isspace(static_cast<unsigned char>(c))) {
+                line += c == '\n';
+                ++at;
+            } else {
+                break;
+            }
+        }
+    }
+
+    /* Next token: a brace, a quoted string with its quotes, or a run of other characters. Empty at the end. */
+    std::string_view next() {
+        skipSpace();
+        std::size_t start = at;
+        if (at >= text.size()) {
+            return {};
+        }
+        char c = text[at];
+        if (c == '{' || c == '}') {
+            ++at;
+        } else if (c == '"') {
+            std::size_t end = text.find('"', at + 1);
+            at = end == std::string_view::npos ? text.size() : end + 1;
+        } else {
+            while (at < text.size()) {
+                c = text[at];
+                if (std::isspace(static_cast<unsigned char>(c)) || c == '{' || c == '}' || c == '#' || c == '"') {
+                    break;
+                }
+                ++at;
+            }
+        }
+        return text.substr(start, at - start);
+    }
+
+    std::string_view peek() {
+        std::size_t savedAt = at;
+        int savedLine = line;
+        std::string_view token = next();
+        at = savedAt;
+        line = savedLine;
+        return token;
+    }
+
+    bool expect(std::string_view token) {
+        std::string_view found = next();
+        return found == token || fail("expected '" + std::string(token) + "', found " + describe(found));
+    }
+
+    template<typename T>
+    static bool convert(std::string_view token, T &value) {
+        auto [end, result] = std::from_chars(token.data(), token.data() + token.size(), value);
+        return result == std::errc() && end == token.data() + token.size();
+    }
+
+    template<typename T>
+    bool number(T &value) {
+        std::string_view token = next();
+        return convert(token, value) || fail("expected a number, found " + describe(token));
+    }
+
+    bool isNumber() {
+        float value;
+        return convert(peek(), value);
+    }
+
+    bool vector(glm::vec3 &v) {
+        return number(v.x) && number(v.y) && number(v.z);
+    }
+
+    bool boolean(bool &value) {
+        std::string_view token = next();
+        value = token == "true";
+        return value || token == "false" || fail("expected true or false, found " + describe(token));
+    }
+
+    bool string(std::string &value) {
+        std::string_view token = next();
+        if (token.size() < 2 || token.front() != '"' || token.back() != '"') {
+            return fail("expected a quoted string, found " + describe(token));
+        }
+        value = token.substr(1, token.size() - 2);
+        return true;
+    }
+
+    /* Read `{ key value... }`, handing each key to `field`, which returns false for keys it does not know. */
+    template<typename F>
+    bool block(F &&field) {
+        if (!expect("{")) {
+            return false;
+        }
+        for (std::string_view key = next(); key != "}"; key = next()) {
+            if (key.empty()) {
+                return fail("missing '}'");
+            }
+            if (!field(key)) {
+                return fail("unknown field '" + std::string(key) + "'");
+            }
+        }
+        return true;
+    }
+
+    bool parseProperties(SceneProperties &p) {
+        return block([&](std::string_view key) {
+            if (key == "background") return vector(p.backgroundColor);
+            if (key == "illumination") return boolean(p.illumination);
+            if (key == "fresnel") return boolean(p.fresnel);
+            if (key == "shadowing") return boolean(p.shadowing);
+            if (key == "absorption") return boolean(p.absorption);
+            if (key == "shadowIntensity") return number(p.shadowIntensity);
+            if (key == "maxRaymarchSteps") return number(p.maxRaymarchSteps);
+            if (key == "maxRaymarchDist") return number(p.maxRaymarchDist);
+            if (key == "maxDepth") return number(p.maxDepth);
+            if (key == "minContribution") return number(p.minContribution);
+            if (key == "relaxation") return number(p.relaxation);
+            if (key == "marcher") {
+                std::string_view marcher = next();
+                if (marcher == "sphere") {
+                    p.marcher = Marcher::Sphere;
+                } else if (marcher == "enhanced") {
+                    p.marcher = Marcher::Enhanced;
+                } else {
+                    return fail("unknown marcher '" + std::string(marcher) + "'");
+                }
+                return true;
+            }
+            return false;
+        });
+    }
+
+    bool parseMaterial(Material &m) {
+        return block([&](std::string_view key) {
+            if (key == "albedo") return vector(m.albedo);
+            if (key == "kd") return number(m.kd);
+            if (key == "ka") return number(m.ka);
+            if (key == "ks") return number(m.ks);
+            if (key == "p") return number(m.p);
+            if (key == "ior") return number(m.ior);
+            if (key == "transmittance") return number(m.transmittance);
+            if (key == "absorption") return number(m.absorption);
+            return false;
+        });
+    }
+
+    std::shared_ptr<Light> parseLight() {
+        vec3 position{0}, color{1};
+        float intensity = 1;
+        bool valid = block([&](std::string_view key) {
+            if (key == "position") return vector(position);
+            if (key == "color") return vector(color);
+            if (key == "intensity") return number(intensity);
+            return false;
+        });
+        return valid ? std::make_shared<Light>(position, color, intensity) : nullptr;
+    }
+
+    std::shared_ptr<Camera> parseCamera(bool &active) {
+        vec3 position{0, 0, -3}, up{0, 1, 0};
+        float focal = 1;
+        bool valid = block([&](std::string_view key) {
+            if (key == "position") return vector(position);
+            if (key == "up") return vector(up);
+            if (key == "focal") return number(focal);
+            if (key == "active") return active = true;
+            return false;
+        });
+        return valid ? std::make_shared<Camera>(position, up, focal * static_cast<float>(width)) : nullptr;
+    }
+
+    /* Read `{ nodes }`. */
+    bool parseOperands(std::vector<NodePtr> &operands) {
+        if (!expect("{")) {
+            return false;
+        }
+        while (peek() != "}") {
+            if (peek().empty()) {
+                return fail("missing '}'");
+            }
+            operands.push_back(parseNode());
+            if (!operands.back()) {
+                return false;
+            }
+        }
+        next();
+        return true;
+    }
+
+    /* Read `{ node }`. */
+    NodePtr parseOperand() {
+        std::vector<NodePtr> operands;
+        if (!parseOperands(operands)) {
+            return nullptr;
+        }
+        if (operands.size() != 1) {
+            fail("expected a single operand");
+            return nullptr;
+        }
+        return operands.front();
+    }
+
+    NodePtr parseNode() {
+        using namespace sdf;
+        std::string_view kind = next();
+        std::shared_ptr<Primitive> primitive;
+        if (kind == "sphere") {
+            float r;
+            if (!number(r)) return nullptr;
+            primitive = std::make_shared<Sphere>(r);
+        } else if (kind == "plane") {
+            vec3 normal;
+            float h;
+            if (!vector(normal) || !number(h)) return nullptr;
+            primitive = std::make_shared<Plane>(normal, h);
+        } else if (kind == "torus") {
+            glm::vec2 radii;
+            if (!number(radii.x) || !number(radii.y)) return nullptr;
+            primitive = std::make_shared<Torus>(radii);
+        } else if (kind == "box") {
+            vec3 dimensions;
+            if (!vector(dimensions)) return nullptr;
+            primitive = std::make_shared<Box>(dimensions);
+        } else if (kind == "triangle") {
+            vec3 v0, v1, v2;
+            if (!vector(v0) || !vector(v1) || !vector(v2)) return nullptr;
+            primitive = std::make_shared<Triangle>(v0, v1, v2);
+        } else if (kind == "mesh") {
+            std::string path;
+            if (!string(path)) return nullptr;
+            auto data = Mesh::load((base / path).string());
+            if (!data) {
+                fail("cannot read mesh " + path);
+                return nullptr;
+            }
+            files.push_back(std::filesystem::absolute(base / path).lexically_normal());
+            auto mesh = std::make_shared<Mesh>(*data);
+            if (mesh->getTriangleCount() == 0) {
+                fail("mesh " + path + " has no faces");
+                return nullptr;
+            }
+            primitive = mesh;
+        } else if (kind == "empty") {
+            return std::make_shared<sdf::Empty>();
+        } else if (kind == "use") {
+            std::string_view name = next();
+            auto it = definitions.find(name);
+            if (it == definitions.end()) {
+                fail("undefined node '" + std::string(name) + "'");
+                return nullptr;
+            }
+            return it->second;
+        } else if (kind == "union" || kind == "difference" || kind == "intersection") {
+            return parseCombination(kind);
+        } else if (kind == "transform") {
+            vec3 position{0}, rotation{0}, scale{1};
+            for (std::string_view key = peek(); key == "position" || key == "rotation" || key == "scale"; key = peek()) {
+                next();
+                if (key != "scale") {
+                    if (!vector(key == "position" ? position : rotation)) return nullptr;
+                } else if (!number(scale.x)) {
+                    return nullptr;
+                } else if (!isNumber()) {
+                    scale = vec3{scale.x};
+                } else if (!number(scale.y) || !number(scale.z)) {
+                    return nullptr;
+                }
+            }
+            auto child = parseOperand();
+            return child ? std::make_shared<ops::Transform>(child, position, glm::radians(rotation), scale) : nullptr;
+        } else if (kind == "elongate") {
+            vec3 amount;
+            if (!vector(amount)) return nullptr;
+            auto child = parseOperand();
+            return child ? std::make_shared<ops::Elongate>(child, amount) : nullptr;
+        } else if (kind == "round") {
+            float radius;
+            if (!number(radius)) return nullptr;
+            bool fixed = peek() == "fixed";
+            if (fixed) {
+                next();
+            }
+            auto child = parseOperand();
+            return child ? std::make_shared<ops::Round>(child, radius, !fixed) : nullptr;
+        } else if (kind == "onion") {
+            float thickness;
+            if (!number(thickness)) return nullptr;
+            auto child = parseOperand();
+            return child ? std::make_shared<ops::Onion>(child, thickness) : nullptr;
+        } else {
+            fail(kind.empty() ? "expected a node" : "unknown node '" + std::string(kind) + "'");
+            return nullptr;
+        }
+
+        if (peek() == "material") {
+            next();
+            std::string_view name = next();
+            auto it = materials.find(name);
+            if (it == materials.end()) {
+                fail("undefined material '" + std::string(name) + "'");
+                return nullptr;
+            }
+            primitive->setMaterial(it->second);
+        }
+        return primitive;
+    }
+
+    NodePtr parseCombination(std::string_view kind) {
+        using namespace sdf::ops;
+        bool smooth = peek() == "smooth";
+        float k = 0;
+        if (smooth) {
+            next();
+            if (!number(k)) return nullptr;
+        }
+        std::vector<NodePtr> operands;
+        if (!parseOperands(operands)) {
+            return nullptr;
+        }
+        if (kind == "union") {
+            // Like the operators of sdf/utils.h, hard unions of more than two operands become a single UnionN, and
+            // smooth ones a chain blending the operands from the first one on
+            if (operands.empty()) {
+                return std::make_shared<sdf::Empty>();
+            }
+            if (!smooth && operands.size() > 2) {
+                return std::make_shared<UnionN>(std::move(operands));
+            }
+            NodePtr chain = operands.front();
+            for (std::size_t i = 1; i < operands.size(); ++i) {
+                chain = std::make_shared<Union>(chain, operands[i], smooth, k);
+            }
+            return chain;
+        }
+        if (operands.size() != 2) {
+            fail(std::string(kind) + " needs two operands");
+            return nullptr;
+        }
+        if (kind == "difference") {
+            return std::make_shared<Difference>(operands[0], operands[1], smooth, k);
+        }
+        return std::make_shared<Intersection>(operands[0], operands[1], smooth, k);
+    }
+};
+
+/**
+ * Compact binary form of a scene, read back through a memory map.
+ * @details
+ * The file holds a header followed by flat arrays of materials, lights, cameras and the nodes of all objects, with
+ * the links and float parameters the nodes refer to. Nodes are stored children first, so a scene is rebuilt in one
+ * pass over the mapped records, without parsing or optimizing it again. Nodes shared by several parents, like the
+ * ones the optimizer merges, are stored once and stay shared. The paths, sizes and modification times of other files
+ * the scene was read from, like meshes, come last to tell when the cache is out of date.
+ *
+ * The layout is that of the build that wrote the file. Files whose header does not match are rejected.
+ */
+class SceneCache {
+public:
+    /* Size and modification time of the file a cache was made from, to tell when the cache is out of date. */
+    struct Source {
+        std::uint64_t size;
+        std::int64_t time;
+
+        bool operator==(const Source &) const = default;
+
+        static std::optional<Source> of(const std::filesystem::path &path) {
+            std::error_code error;
+            auto size = std::filesystem::file_size(path, error);
+            if (error) {
+                return std::nullopt;
+            }
+            auto time = std::filesystem::last_write_time(path, error);
+            if (error) {
+                return std::nullopt;
+            }
+            return Source{size, static_cast<std::int64_t>(time.time_since_epoch().count())};
+        }
+    };
+
+    /**
+     * Write a scene. Focal lengths of cameras are stored relative to the image width.
+     * @param source File the scene was read from, if any
+     * @param files Other files the scene was built from, which load checks as well, see SceneParser::getFiles
+     * @return False if the file could not be written, a file the scene was built from cannot be read, or the scene
+     * has nodes the format does not cover
+     */
+    static bool save(const Scene &scene, const std::filesystem::path &path, int width, const Source &source = {},
+                     std::span<const std::filesystem::path> files = {}) {
+        std::vector<FileRecord> fileRecords;
+        std::string paths;
+        for (const auto &file : files) {
+            auto fileSource = Source::of(file);
+            if (!fileSource) {
+                return false;
+            }
+            std::string name = file.string();
+            fileRecords.push_back({*fileSource, paths.size(), name.size()});
+            paths += name;
+        }
+
+        Tables tables;
+        std::vector<std::uint32_t> objects;
+        for (auto &node : scene.sdfNodes) {
+            auto index = write(node, tables);
+            if (!index) {
+                return false;
+            }
+            objects.push_back(*index);
+        }
+
+        std::vector<Material> materials;
+        for (std::size_t i = 0; i < tables.materials.size(); ++i) {
+            materials.push_back(tables.materials[static_cast<MaterialId>(i)]);
+        }
+        std::vector<LightRecord> lights;
+        for (auto &light : scene.lights) {
+            lights.push_back({light->position, light->color, light->intensity});
+        }
+        std::vector<CameraRecord> cameras;
+        for (auto &camera : scene.cameras) {
+            cameras.push_back({camera->pos(), camera->view(), camera->rot(),
+                               camera->focalLength() / static_cast<float>(width)});
+        }
+
+        Header header = expectedHeader();
+        header.source = source;
+        header.properties = scene.scene;
+        header.activeCamera = static_cast<std::uint32_t>(scene.activeCamIndex);
+        std::string file(sizeof(Header), '\0');
+        header.materials = append(file, materials);
+        header.lights = append(file, lights);
+        header.cameras = append(file, cameras);
+        header.nodes = append(file, tables.nodes);
+        header.links = append(file, tables.links);
+        header.params = append(file, tables.params);
+        header.objects = append(file, objects);
+        header.files = append(file, fileRecords);
+        header.paths = append(file, std::vector<char>(paths.begin(), paths.end()));
+        std::memcpy(file.data(), &header, sizeof(Header));
+
+        // Written next to the cache and moved over it, so a reader never maps a partly written file
+        auto temporary = std::filesystem::path(path) += ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write(file.data(), static_cast<std::streamsize>(file.size()));
+            if (!out) {
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        return !error;
+    }
+
+    /**
+     * Read a scene written by save, for images `width` pixels wide.
+     * @param source If given, the file the cache must have been made from, as it is now. The other files it was made
+     * from must be unchanged as well.
+     * @return nullptr if the file is missing, invalid or out of date
+     */
+    static std::unique_ptr<Scene> load(const std::filesystem::path &path, int width,
+                                       const std::optional<Source> &source = std::nullopt) {
+        MappedFile file(path);
+        Header header;
+        if (!file.isOpen() || file.size() < sizeof(Header)) {
+            return nullptr;
+        }
+        std::memcpy(&header, file.data(), sizeof(Header));
+        Header expected = expectedHeader();
+        if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version
+            || header.headerSize != expected.headerSize || header.nodeSize != expected.nodeSize
+            || header.materialSize != expected.materialSize || header.lightSize != expected.lightSize
+            || header.cameraSize != expected.cameraSize || header.fileSize != expected.fileSize
+            || (source && header.source != *source)) {
+            return nullptr;
+        }
+
+        bool valid = true;
+        auto materials = section<Material>(file, header.materials, valid);
+        auto lights = section<LightRecord>(file, header.lights, valid);
+        auto cameras = section<CameraRecord>(file, header.cameras, valid);
+        auto records = section<NodeRecord>(file, header.nodes, valid);
+        auto links = section<std::uint32_t>(file, header.links, valid);
+        auto params = section<float>(file, header.params, valid);
+        auto objects = section<std::uint32_t>(file, header.objects, valid);
+        auto files = section<FileRecord>(file, header.files, valid);
+        auto paths = section<char>(file, header.paths, valid);
+        if (!valid) {
+            return nullptr;
+        }
+        for (const FileRecord &record : files) {
+            if (record.path > paths.size() || record.pathLength > paths.size() - record.path) {
+                return nullptr;
+            }
+            std::string_view name(paths.data() + record.path, record.pathLength);
+            if (source && Source::of(std::filesystem::path(name)) != record.source) {
+                return nullptr;
+            }
+        }
+
+        std::vector<std::shared_ptr<sdf::Node>> nodes;
+        nodes.reserve(records.size());
+        for (const NodeRecord &record : records) {
+            if (record.links > links.size() || record.linkCount > links.size() - record.links
+                || record.params > params.size() || record.paramCount > params.size() - record.params
+                || (record.material >= materials.size() && !materials.empty())) {
+                return nullptr;
+            }
+            auto node = read(record, links.subspan(record.links, record.linkCount),
+                             params.subspan(record.params, record.paramCount), nodes, materials);
+            if (!node) {
+                return nullptr;
+            }
+            nodes.push_back(std::move(node));
+        }
+
+        auto scene = std::make_unique<Scene>(header.properties);
+        for (const LightRecord &light : lights) {
+            scene->addLight(std::make_shared<Light>(light.position, light.color, light.intensity));
+        }
+        for (const CameraRecord &camera : cameras) {
+            scene->addCamera(std::make_shared<Camera>(camera.position, camera.view, camera.rotation,
+                                                      camera.focal * static_cast<float>(width)));
+        }
+        if (header.activeCamera < cameras.size()) {
+            scene->activeCamIndex = static_cast<int>(header.activeCamera);
+        }
+        std::vector<std::shared_ptr<sdf::Node>> roots;
+        for (std::uint32_t object : objects) {
+            if (object >= nodes.size()) {
+                return nullptr;
+            }
+            roots.push_back(nodes[object]);
+        }
+        scene->addSDFObjects(roots);
+        return scene;
+    }
+
+private:
+    static constexpr std::uint32_t Version = 3;
+
+    enum class Kind : std::uint8_t {
+        Empty, Sphere, Plane, Torus, Box, Triangle, Mesh,
+        Union, Difference, Intersection, UnionN,
+        Transform, Elongate, Round, Onion
+    };
+
+    enum Flags : std::uint8_t {
+        Smooth = 1,
+        Subsumable = 2
+    };
+
+    // Operations keep the indices of their children in links, meshes their triangles. Children come before parents.
+    struct NodeRecord {
+        Kind kind;
+        std::uint8_t flags = 0;
+        MaterialId material = 0;
+        std::uint32_t links = 0;
+        std::uint32_t linkCount = 0;
+        std::uint32_t params = 0;
+        std::uint32_t paramCount = 0;
+    };
+
+    struct LightRecord {
+        glm::vec3 position;
+        glm::vec3 color;
+        float intensity;
+    };
+
+    struct CameraRecord {
+        glm::vec3 position;
+        glm::mat4 view;
+        glm::mat4 rotation;
+        // In image widths
+        float focal;
+    };
+
+    // Another file the scene was built from, with its path in the paths section
+    struct FileRecord {
+        Source source;
+        std::uint64_t path;
+        std::uint64_t pathLength;
+    };
+
+    // Array of records at a byte offset of the file
+    struct Section {
+        std::uint64_t offset = 0;
+        std::uint64_t count = 0;
+    };
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        // Sizes of the records, so a cache written with another layout of any of them is rejected
+        std::uint32_t headerSize;
+        std::uint32_t nodeSize;
+        std::uint32_t materialSize;
+        std::uint32_t lightSize;
+        std::uint32_t cameraSize;
+        std::uint32_t fileSize;
+        std::uint32_t activeCamera;
+        Source source;
+        SceneProperties properties;
+        Section materials, lights, cameras, nodes, links, params, objects, files, paths;
+    };
+
+    static_assert(std::is_trivially_copyable_v<Header> && std::is_trivially_copyable_v<Material>
+                  && std::is_trivially_copyable_v<LightRecord> && std::is_trivially_copyable_v<CameraRecord>
+                  && std::is_trivially_copyable_v<NodeRecord>
+                  && std::is_trivially_copyable_v<FileRecord>);
+
+    // Nodes written so far, with the materials they use
+    struct Tables {
+        MaterialTable materials;
+        std::vector<NodeRecord> nodes;
+        std::vector<std::uint32_t> links;
+        std::vector<float> params;
+        std::unordered_map<const sdf::Node *, std::uint32_t> written;
+    };
+
+    static Header expectedHeader() {
+        Header header{};
+        std::memcpy(header.magic, "SDFSCENE", sizeof(header.magic));
+        header.version = Version;
+        header.headerSize = sizeof(Header);
+        header.nodeSize = sizeof(NodeRecord);
+        header.materialSize = sizeof(Material);
+        header.lightSize = sizeof(LightRecord);
+        header.cameraSize = sizeof(CameraRecord);
+        header.fileSize = sizeof(FileRecord);
+        return header;
+    }
+
+    template<typename T>
+    static Section append(std::string &file, const std::vector<T> &records) {
+        // Every section starts 8 byte aligned, so records can be used in place in the mapped file
+        file.resize((file.size() + 7) / 8 * 8, '\0');
+        Section s{file.size(), records.size()};
+        file.append(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(T));
+        return s;
+    }
+
+    template<typename T>
+    static std::span<const T> section(const MappedFile &file, const Section &s, bool &valid) {
+        if (s.offset % alignof(T) != 0 || s.offset > file.size() || s.count > (file.size() - s.offset) / sizeof(T)) {
+            valid = false;
+            return {};
+        }
+        return {reinterpret_cast<const T *>(file.data() + s.offset), static_cast<std::size_t>(s.count)};
+    }
+
+    /* Append the records of a node and its children, unless already written. Empty for unsupported nodes. */
+    static std::optional<std::uint32_t> write(const std::shared_ptr<sdf::Node> &node, Tables &tables) {
+        using namespace sdf;
+        if (auto it = tables.written.find(node.get()); it != tables.written.end()) {
+            return it->second;
+        }
+
+        NodeRecord record{};
+        std::vector<std::uint32_t> links;
+        std::vector<float> params;
+        auto children = [&](std::initializer_list<std::shared_ptr<Node>> operands) {
+            for (auto &operand : operands) {
+                auto index = write(operand, tables);
+                if (!index) {
+                    return false;
+                }
+                links.push_back(*index);
+            }
+            return true;
+        };
+        auto vector = [&](const glm::vec3 &v) {
+            params.insert(params.end(), {v.x, v.y, v.z});
+        };
+
+        if (auto primitive = std::dynamic_pointer_cast<Primitive>(node)) {
+            record.material = tables.materials.add(primitive->getMaterial());
+        }
+        if (std::dynamic_pointer_cast<sdf::Empty>(node)) {
+            record.kind = Kind::Empty;
+        } else if (auto sphere = std::dynamic_pointer_cast<Sphere>(node)) {
+            record.kind = Kind::Sphere;
+            params = {sphere->getRadius()};
+        } else if (auto plane = std::dynamic_pointer_cast<Plane>(node)) {
+            record.kind = Kind::Plane;
+            vector(plane->getNormal());
+            params.push_back(plane->getHeight());
+        } else if (auto torus = std::dynamic_pointer_cast<Torus>(node)) {
+            record.kind = Kind::Torus;
+            params = {torus->getRadii().x, torus->getRadii().y};
+        } else if (auto box = std::dynamic_pointer_cast<Box>(node)) {
+            record.kind = Kind::Box;
+            vector(box->getDimensions());
+        } else if (auto triangle = std::dynamic_pointer_cast<Triangle>(node)) {
+            record.kind = Kind::Triangle;
+            for (int i = 0; i < 3; ++i) {
+                vector(triangle->getVertex(i));
+            }
+        } else if (auto mesh = std::dynamic_pointer_cast<Mesh>(node)) {
+            record.kind = Kind::Mesh;
+            MeshData data = mesh->getData();
+            for (auto &v : data.vertices) {
+                vector(v);
+            }
+            for (auto &t : data.triangles) {
+                links.insert(links.end(), {t.x, t.y, t.z});
+            }
+        } else if (auto binary = std::dynamic_pointer_cast<ops::BinaryOp>(node)) {
+            record.kind = std::dynamic_pointer_cast<ops::Union>(node) ? Kind::Union
+                          : std::dynamic_pointer_cast<ops::Difference>(node) ? Kind::Difference
+                          : Kind::Intersection;
+            record.flags = binary->isSmooth() ? Smooth : 0;
+            params = {binary->getSmoothness()};
+            if (!children({binary->getLeftChild(), binary->getRightChild()})) {
+                return std::nullopt;
+            }
+        } else if (auto group = std::dynamic_pointer_cast<ops::UnionN>(node)) {
+            record.kind = Kind::UnionN;
+            record.flags = group->isSmooth() ? Smooth : 0;
+            params = {group->getSmoothness()};
+            for (auto &child : group->getChildren()) {
+                if (!children({child})) {
+                    return std::nullopt;
+                }
+            }
+        } else if (auto transform = std::dynamic_pointer_cast<ops::Transform>(node)) {
+            record.kind = Kind::Transform;
+            const glm::mat4 &local = transform->getLocalTransform();
+            for (int column = 0; column < 4; ++column) {
+                for (int row = 0; row < 4; ++row) {
+                    params.push_back(local[column][row]);
+                }
+            }
+            params.push_back(transform->getDistanceFactor());
+            if (!children({transform->getChild()})) {
+                return std::nullopt;
+            }
+        } else if (auto elongate = std::dynamic_pointer_cast<ops::Elongate>(node)) {
+            record.kind = Kind::Elongate;
+            vector(elongate->getAmount());
+            if (!children({elongate->getChild()})) {
+                return std::nullopt;
+            }
+        } else if (auto round = std::dynamic_pointer_cast<ops::Round>(node)) {
+            record.kind = Kind::Round;
+            record.flags = round->isSubsumable() ? Subsumable : 0;
+            params = {round->getRadius()};
+            if (!children({round->getChild()})) {
+                return std::nullopt;
+            }
+        } else if (auto onion = std::dynamic_pointer_cast<ops::Onion>(node)) {
+            record.kind = Kind::Onion;
+            params = {onion->getThickness()};
+            if (!children({onion->getChild()})) {
+                return std::nullopt;
+            }
+        } else {
+            return std::nullopt;
+        }
+
+        record.links = static_cast<std::uint32_t>(tables.links.size());
+        record.linkCount = static_cast<std::uint32_t>(links.size());
+        record.params = static_cast<std::uint32_t>(tables.params.size());
+        record.paramCount = static_cast<std::uint32_t>(params.size());
+        tables.links.insert(tables.links.end(), links.begin(), links.end());
+        tables.params.insert(tables.params.end(), params.begin(), params.end());
+        auto index = static_cast<std::uint32_t>(tables.nodes.size());
+        tables.nodes.push_back(record);
+        tables.written.emplace(node.get(), index);
+        return index;
+    }
+
+    /* Build the node of a record, whose children are among `nodes`. nullptr if the record is invalid. */
+    static std::shared_ptr<sdf::Node> read(const NodeRecord &record, std::span<const std::uint32_t> links,
+                                           std::span<const float> params,
+                                           const std::vector<std::shared_ptr<sdf::Node>> &nodes,
+                                           std::span<const Material> materials) {
+        using namespace sdf;
+        auto expect = [&](std::size_t linkCount, std::size_t paramCount) {
+            return links.size() == linkCount && params.size() == paramCount
+                   && std::all_of(links.begin(), links.end(), [&](std::uint32_t i) { return i < nodes.size(); });
+        };
+        auto vector = [&](std::size_t i) {
+            return glm::vec3{params[i], params[i + 1], params[i + 2]};
+        };
+        auto child = [&](std::size_t i) {
+            return nodes[links[i]];
+        };
+        bool smooth = record.flags & Smooth;
+
+        std::shared_ptr<Primitive> primitive;
+        switch (record.kind) {
+            case Kind::Empty:
+                return expect(0, 0) ? std::make_shared<sdf::Empty>() : nullptr;
+            case Kind::Sphere:
+                if (!expect(0, 1)) return nullptr;
+                primitive = std::make_shared<Sphere>(params[0]);
+                break;
+            case Kind::Plane:
+                if (!expect(0, 4)) return nullptr;
+                primitive = std::make_shared<Plane>(vector(0), params[3]);
+                break;
+            case Kind::Torus:
+                if (!expect(0, 2)) return nullptr;
+                primitive = std::make_shared<Torus>(glm::vec2{params[0], params[1]});
+                break;
+            case Kind::Box:
+                if (!expect(0, 3)) return nullptr;
+                primitive = std::make_shared<Box>(vector(0));
+                break;
+            case Kind::Triangle:
+                if (!expect(0, 9)) return nullptr;
+                primitive = std::make_shared<Triangle>(vector(0), vector(3), vector(6));
+                break;
+            case Kind::Mesh: {
+                if (links.empty() || links.size() % 3 != 0 || params.size() % 3 != 0) return nullptr;
+                MeshData data;
+                for (std::size_t i = 0; i < params.size(); i += 3) {
+                    data.vertices.push_back(vector(i));
+                }
+                for (std::size_t i = 0; i < links.size(); i += 3) {
+                    if (std::max({links[i], links[i + 1], links[i + 2]}) >= data.vertices.size()) return nullptr;
+                    data.triangles.emplace_back(links[i], links[i + 1], links[i + 2]);
+                }
+                primitive = std::make_shared<Mesh>(data);
+                break;
+            }
+            case Kind::Union:
+                return expect(2, 1) ? std::make_shared<ops::Union>(child(0), child(1), smooth, params[0]) : nullptr;
+            case Kind::Difference:
+                return expect(2, 1) ? std::make_shared<ops::Difference>(child(0), child(1), smooth, params[0])
+                                    : nullptr;
+            case Kind::Intersection:
+                return expect(2, 1) ? std::make_shared<ops::Intersection>(child(0), child(1), smooth, params[0])
+                                    : nullptr;
+            case Kind::UnionN: {
+                if (!expect(links.size(), 1) || links.empty()) return nullptr;
+                std::vector<std::shared_ptr<Node>> children;
+                children.reserve(links.size());
+                for (std::uint32_t link : links) {
+                    children.push_back(nodes[link]);
+                }
+                return std::make_shared<ops::UnionN>(std::move(children), smooth, params[0]);
+            }
+            case Kind::Transform: {
+                if (!expect(1, 17)) return nullptr;
+                glm::mat4 local;
+                for (int column = 0; column < 4; ++column) {
+                    for (int row = 0; row < 4; ++row) {
+                        local[column][row] = params[column * 4 + row];
+                    }
+                }
+                return std::make_shared<ops::Transform>(child(0), local, params[16]);
+            }
+            case Kind::Elongate:
+                return expect(1, 3) ? std::make_shared<ops::Elongate>(child(0), vector(0)) : nullptr;
+            case Kind::Round:
+                return expect(1, 1) ? std::make_shared<ops::Round>(child(0), params[0], record.flags & Subsumable)
+                                    : nullptr;
+            case Kind::Onion:
+                return expect(1, 1) ? std::make_shared<ops::Onion>(child(0), params[0]) : nullptr;
+            default:
+                return nullptr;
+        }
+        if (!materials.empty()) {
+            primitive->setMaterial(materials[record.material]);
+        }
+        return primitive;
+    }
+};
+
+/**
+ * Load a scene file through a binary cache next to it, named like the file with `.cache` appended.
+ * @details
+ * The cache is used if it was made from the file and the meshes it refers to as they are now. Otherwise the file is
+ * parsed and the scene optimized, then written to the cache for the next run. Failing to write the cache, e.g. in a
+ * read-only directory, is not an error. Either way, the scene is optimized already.
+ * @param error Set to the reason the scene could not be loaded, if given
+ */
+inline std::unique_ptr<Scene> loadScene(const std::filesystem::path &path, int width, std::string *error = nullptr) {
+    auto source = SceneCache::Source::of(path);
+    if (!source) {
+        if (error) {
+            *error = "cannot read " + path.string();
+        }
+        return nullptr;
+    }
+    auto cache = std::filesystem::path(path) += ".cache";
+    if (auto scene = SceneCache::load(cache, width, source)) {
+        return scene;
+    }
+
+    SceneParser parser(width);
+    auto scene = parser.load(path);
+    if (!scene) {
+        if (error) {
+            *error = path.string() + ", " + parser.getError();
+        }
+        return nullptr;
+    }
+    scene->optimize();
+    SceneCache::save(*scene, cache, width, *source, parser.getFiles());
+    return scene;
+}
+
+#endif //PROJECT_SCENEFILE_H
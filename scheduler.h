@@ -0,0 +1,221 @@
+#ifndef PROJECT_SCHEDULER_H
+#define PROJECT_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * Hands out the tiles of a frame to threads along a Z-order curve, with work stealing.
+ * @details
+ * Tiles are sorted by the Morton code of their position, so that tiles following each other are neighbours on screen,
+ * and split into one contiguous range per thread. Each thread takes tiles from the front of its own range. Once that
+ * is empty, it steals the back half of the largest range left, so expensive regions like glass end up shared among
+ * threads without all of them contending for a single queue.
+ *
+ * Work runs on the OpenMP team, whose threads are kept alive between frames by the runtime.
+ */
+class TileScheduler {
+public:
+    /* Pixels [x0, x1) x [y0, y1) of the image. */
+    struct Tile {
+        int x0, y0, x1, y1;
+    };
+
+    struct Result {
+        // Number of times a thread stole tiles from another
+        std::uint64_t steals = 0;
+        // Whether tiles were left out because the run was cancelled
+        bool cancelled = false;
+    };
+
+    /* Divide an image into square tiles of the given size, unless it already is. */
+    void plan(int width, int height, int tileSize) {
+        if (width == w && height == h && tileSize == size) {
+            return;
+        }
+        w = width;
+        h = height;
+        size = tileSize;
+
+        int columns = (width + tileSize - 1) / tileSize;
+        int rows = (height + tileSize - 1) / tileSize;
+        std::vector<std::pair<std::uint32_t, Tile>> order;
+        for (int ty = 0; ty < rows; ++ty) {
+            for (int tx = 0; tx < columns; ++tx) {
+                int x0 = tx * tileSize;
+                int y0 = ty * tileSize;
+                Tile tile{x0, y0, std::min(x0 + tileSize, width), std::min(y0 + tileSize, height)};
+                order.emplace_back(morton(tx, ty), tile);
+            }
+        }
+        std::sort(order.begin(), order.end(), [](const auto &a, const auto &b) {
+            return a.first < b.first;
+        });
+        tiles.clear();
+        for (auto &[code, tile] : order) {
+            tiles.push_back(tile);
+        }
+    }
+
+    [[nodiscard]] const std::vector<Tile> &getTiles() const {
+        return tiles;
+    }
+
+    /**
+     * Call `render(tile, thread)` once for every tile, in parallel. Thread is the index of the calling thread, below
+     * maxThreads.
+     * @param cancel Called between tiles on the thread calling run, if given. Once it returns true, no more tiles are
+     * handed out and run returns when the tiles being rendered are done.
+     */
+    template<typename F>
+    Result run(F &&render, const std::function<bool()> &cancel = {}) {
+        std::atomic<std::uint64_t> steals = 0;
+        std::atomic<bool> cancelled = false;
+        #pragma omp parallel
+        {
+            #pragma omp single
+            split(teamSize());
+
+            int self = threadIndex();
+            std::uint64_t stolen = 0;
+            while (!cancelled.load(std::memory_order_relaxed)) {
+                int tile = next(self, stolen);
+                if (tile < 0) {
+                    break;
+                }
+                render(tiles[tile], self);
+                // Thread 0 is the one that called run
+                if (self == 0 && cancel && cancel()) {
+                    cancelled = true;
+                }
+            }
+            steals += stolen;
+        }
+        return {steals, cancelled};
+    }
+
+    /* Upper bound of the number of threads running tiles. */
+    static int maxThreads() {
+#ifdef _OPENMP
+        return omp_get_max_threads();
+#else
+        return 1;
+#endif
+    }
+
+private:
+    // Tiles [begin, end) in the order of the curve, packed as begin | end << 32 to update both at once.
+    // Padded to a cache line so threads taking their own tiles do not slow each other down.
+    struct alignas(64) Range {
+        std::atomic<std::uint64_t> bits;
+    };
+
+    static std::uint64_t pack(std::uint32_t begin, std::uint32_t end) {
+        return begin | static_cast<std::uint64_t>(end) << 32;
+    }
+
+    static std::uint32_t begin(std::uint64_t bits) {
+        return static_cast<std::uint32_t>(bits);
+    }
+
+    static std::uint32_t end(std::uint64_t bits) {
+        return static_cast<std::uint32_t>(bits >> 32);
+    }
+
+    /* Interleave the bits of x and y. */
+    static std::uint32_t morton(int x, int y) {
+        auto spread = [](std::uint32_t v) {
+            v &= 0xffff;
+            v = (v | v << 8) & 0x00ff00ff;
+            v = (v | v << 4) & 0x0f0f0f0f;
+            v = (v | v << 2) & 0x33333333;
+            v = (v | v << 1) & 0x55555555;
+            return v;
+        };
+        return spread(x) | spread(y) << 1;
+    }
+
+    static int teamSize() {
+#ifdef _OPENMP
+        return omp_get_num_threads();
+#else
+        return 1;
+#endif
+    }
+
+    static int threadIndex() {
+#ifdef _OPENMP
+        return omp_get_thread_num();
+#else
+        return 0;
+#endif
+    }
+
+    /* Give each of the threads an equal, contiguous share of the tiles. */
+    void split(int threads) {
+        if (threads != count) {
+            ranges = std::make_unique<Range[]>(threads);
+            count = threads;
+        }
+        auto n = static_cast<std::uint64_t>(tiles.size());
+        for (int i = 0; i < threads; ++i) {
+            ranges[i].bits.store(pack(n * i / threads, n * (i + 1) / threads), std::memory_order_relaxed);
+        }
+    }
+
+    /* Take the next tile of a thread, stealing if it has none left. -1 once all tiles are taken. */
+    int next(int self, std::uint64_t &stolen) {
+        auto &own = ranges[self].bits;
+        std::uint64_t bits = own.load();
+        while (begin(bits) < end(bits)) {
+            if (own.compare_exchange_weak(bits, pack(begin(bits) + 1, end(bits)))) {
+                return static_cast<int>(begin(bits));
+            }
+        }
+
+        while (true) {
+            int victim = -1;
+            std::uint32_t most = 0;
+            for (int i = 0; i < count; ++i) {
+                std::uint64_t other = ranges[i].bits.load(std::memory_order_relaxed);
+                if (i != self && end(other) - begin(other) > most) {
+                    most = end(other) - begin(other);
+                    victim = i;
+                }
+            }
+            if (victim < 0) {
+                // Threads still busy with tiles they stole render those themselves, so none are left to take
+                return -1;
+            }
+
+            bits = ranges[victim].bits.load();
+            if (begin(bits) >= end(bits)) {
+                continue;
+            }
+            // A single tile is taken whole, larger ranges keep their front half
+            std::uint32_t middle = begin(bits) + (end(bits) - begin(bits)) / 2;
+            if (ranges[victim].bits.compare_exchange_weak(bits, pack(begin(bits), middle))) {
+                ++stolen;
+                own.store(pack(middle + 1, end(bits)));
+                return static_cast<int>(middle);
+            }
+        }
+    }
+
+    int w = 0;
+    int h = 0;
+    int size = 0;
+    std::vector<Tile> tiles;
+    std::unique_ptr<Range[]> ranges;
+    int count = 0;
+};
+
+#endif //PROJECT_SCHEDULER_H
@@ -0,0 +1,299 @@
+#ifndef PROJECT_BATCH_H
+#define PROJECT_BATCH_H
+
+#include <algorithm>
+#include "simd.h"
+
+/***
+ * Batched evaluation of tapes, simd::Width points at a time.
+ * @details
+ * Every primitive and operation that can appear on a tape has a kernel here, mirroring the scalar implementation in
+ * shapes.h and ops.h. Node::signedDistances and the scalar tape interpreter remain the reference for validating them.
+ */
+namespace sdf::simd {
+
+    inline Float sphere(const Vec3 &p, const float *k) {
+        return length(p) - Float(k[0]);
+    }
+
+    inline Float plane(const Vec3 &p, const float *k) {
+        return dot(p, broadcast(k)) + Float(k[3]);
+    }
+
+    inline Float torus(const Vec3 &p, const float *k) {
+        Float qx = sqrt(p.x * p.x + p.z * p.z) - Float(k[0]);
+        return sqrt(qx * qx + p.y * p.y) - Float(k[1]);
+    }
+
+    inline Float box(const Vec3 &p, const float *k) {
+        Vec3 q = abs(p) - broadcast(k);
+        return length(max(q, 0.0f)) + min(maxComponent(q), 0.0f);
+    }
+
+    inline Float triangle(const Vec3 &p, const float *k) {
+        Vec3 p0 = p - broadcast(k), p1 = p - broadcast(k + 3), p2 = p - broadcast(k + 6);
+        Vec3 e0 = broadcast(k + 9), e1 = broadcast(k + 12), e2 = broadcast(k + 15);
+        Vec3 n = broadcast(k + 27);
+
+        Float s = sign(dot(broadcast(k + 18), p0)) + sign(dot(broadcast(k + 21), p1)) + sign(dot(broadcast(k + 24), p2));
+
+        Float edges = min(
+                min(
+                        length(e0 * clamp(dot(e0, p0) * Float(k[30]), 0.0f, 1.0f) - p0),
+                        length(e1 * clamp(dot(e1, p1) * Float(k[31]), 0.0f, 1.0f) - p1)
+                ),
+                length(e2 * clamp(dot(e2, p2) * Float(k[32]), 0.0f, 1.0f) - p2)
+        );
+        Float np = dot(n, p0);
+        Float face = sqrt(np * np * Float(k[33]));
+
+        return select(s < Float(2.0f), edges, face) - Float(0.001f);
+    }
+
+    inline Vec3 transform(const Vec3 &p, const float *k) {
+        Vec3 x = broadcast(k), y = broadcast(k + 3), z = broadcast(k + 6), t = broadcast(k + 9);
+        return x * p.x + y * p.y + z * p.z + t;
+    }
+
+    inline Vec3 elongate(const Vec3 &p, const float *k) {
+        Vec3 q = abs(p) - broadcast(k);
+        return mul(sign(p), max(q, 0.0f));
+    }
+
+    inline Float elongateCorrect(Float d, const Vec3 &p, const float *k) {
+        Vec3 q = abs(p) - broadcast(k);
+        return d + min(maxComponent(q), 0.0f);
+    }
+
+    // Batched ops::sminN with n = 3.
+    inline Float smoothUnion(Float a, Float b, Float k) {
+        Float h = max(k - abs(a - b), 0.0f) / k;
+        Float m = h * h * h * Float(0.5f);
+        return min(a, b) - m * k / Float(3.0f);
+    }
+
+    inline Float smoothDifference(Float a, Float b, Float k) {
+        Float h = clamp(Float(0.5f) - Float(0.5f) * (a + b) / k, 0.0f, 1.0f);
+        return mix(a, -b, h) + k * h * (Float(1.0f) - h);
+    }
+
+    inline Float smoothIntersection(Float a, Float b, Float k) {
+        Float h = clamp(Float(0.5f) - Float(0.5f) * (a - b) / k, 0.0f, 1.0f);
+        return mix(a, b, h) + k * h * (Float(1.0f) - h);
+    }
+}
+
+namespace sdf {
+
+    void Tape::signedDistances(const float *x, const float *y, const float *z, float *out, std::size_t n) const {
+        using simd::Width;
+
+        auto evaluate = [&](simd::Float *d, simd::Vec3 *q) {
+            std::size_t i = 0;
+            for (; i + Width <= n; i += Width) {
+                run(simd::Vec3::load(x + i, y + i, z + i), d, q).store(out + i);
+            }
+            if (i < n) {
+                // Pad the remainder with copies of the last point
+                float px[Width], py[Width], pz[Width], po[Width];
+                for (std::size_t j = 0; j < Width; ++j) {
+                    std::size_t s = std::min(i + j, n - 1);
+                    px[j] = x[s];
+                    py[j] = y[s];
+                    pz[j] = z[s];
+                }
+                run(simd::Vec3::load(px, py, pz), d, q).store(po);
+                std::copy(po, po + (n - i), out + i);
+            }
+        };
+
+        if (distanceRegisters <= MaxStackRegisters && pointRegisters <= MaxStackRegisters) {
+            simd::Float d[MaxStackRegisters];
+            simd::Vec3 q[MaxStackRegisters];
+            evaluate(d, q);
+            return;
+        }
+        thread_local std::vector<simd::Float> d;
+        thread_local std::vector<simd::Vec3> q;
+        d.resize(distanceRegisters);
+        q.resize(pointRegisters);
+        evaluate(d.data(), q.data());
+    }
+
+    simd::Float Tape::runNested(const simd::Vec3 &p) const {
+        if (distanceRegisters <= MaxStackRegisters && pointRegisters <= MaxStackRegisters) {
+            simd::Float d[MaxStackRegisters];
+            simd::Vec3 q[MaxStackRegisters];
+            return run(p, d, q);
+        }
+        std::vector<simd::Float> d(distanceRegisters);
+        std::vector<simd::Vec3> q(pointRegisters);
+        return run(p, d.data(), q.data());
+    }
+
+    // Batched ops::unionN. Nodes are entered once for all lanes, as long as any lane may need them.
+    simd::Float Tape::group(const Group &g, const simd::Vec3 &p) const {
+        using namespace simd;
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        const Float margin(g.smooth ? g.k : 0.0f);
+
+        std::byte buffer[1024];
+        std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+        std::pmr::vector<Float> candidates(&arena);
+
+        Float min(inf);
+        auto visit = [&](int child) {
+            Float d = g.children[child].runNested(p);
+            min = simd::min(min, d);
+            if (g.smooth) {
+                candidates.push_back(d);
+            }
+        };
+        auto distance = [&](const AABB &bounds) {
+            glm::vec3 c = bounds.center(), e = bounds.extent();
+            const float k[6] = {c.x, c.y, c.z, e.x, e.y, e.z};
+            return box(p - broadcast(k), k + 3);
+        };
+        // Ordering key of a node, the nearest distance of the lanes that may need it
+        auto key = [&](Float b) {
+            return reduceMin(select(b < min + margin, b, Float(inf)));
+        };
+
+        for (int child : g.bvh.getUnbounded()) {
+            visit(child);
+        }
+        const auto &nodes = g.bvh.getNodes();
+        if (!nodes.empty()) {
+            struct Entry {
+                int index;
+                Float b;
+            };
+            Entry stack[64];
+            int top = 0;
+            stack[top++] = {0, distance(nodes[0].box)};
+            while (top > 0) {
+                Entry entry = stack[--top];
+                if (!any(entry.b < min + margin)) {
+                    continue;
+                }
+                const auto &node = nodes[entry.index];
+                if (node.object >= 0) {
+                    visit(node.object);
+                    continue;
+                }
+                Float left = distance(nodes[node.left].box);
+                Float right = distance(nodes[node.right].box);
+                if (key(left) < key(right)) {
+                    stack[top++] = {node.right, right};
+                    stack[top++] = {node.left, left};
+                } else {
+                    stack[top++] = {node.left, left};
+                    stack[top++] = {node.right, right};
+                }
+            }
+        }
+
+        if (!g.smooth || candidates.empty()) {
+            return min;
+        }
+
+        // Blend each lane on its own, as the candidates and their order differ between lanes
+        std::pmr::vector<float> all(candidates.size() * Width, &arena);
+        for (std::size_t i = 0; i < candidates.size(); ++i) {
+            candidates[i].store(all.data() + i * Width);
+        }
+        float out[Width];
+        std::pmr::vector<float> lane(&arena);
+        for (std::size_t j = 0; j < Width; ++j) {
+            lane.clear();
+            for (std::size_t i = 0; i < candidates.size(); ++i) {
+                lane.push_back(all[i * Width + j]);
+            }
+            std::sort(lane.begin(), lane.end());
+            out[j] = ops::blendSorted(lane.data(), lane.size(), g.k);
+        }
+        return Float::load(out);
+    }
+
+    simd::Float Tape::run(const simd::Vec3 &p, simd::Float *d, simd::Vec3 *q) const {
+        using namespace simd;
+        const float *c = constants.data();
+        q[input] = p;
+
+        for (const auto &ins : code) {
+            const float *k = c + ins.param;
+            switch (ins.op) {
+                case OpCode::Constant:
+                    d[ins.out] = Float(k[0]);
+                    break;
+                case OpCode::Call: {
+                    // Nodes without a lowering are evaluated one lane at a time
+                    float px[Width], py[Width], pz[Width], po[Width];
+                    q[ins.a].x.store(px);
+                    q[ins.a].y.store(py);
+                    q[ins.a].z.store(pz);
+                    calls[ins.b]->signedDistances(px, py, pz, po, Width);
+                    d[ins.out] = Float::load(po);
+                    break;
+                }
+                case OpCode::Group:
+                    d[ins.out] = group(groups[ins.b], q[ins.a]);
+                    break;
+                case OpCode::Sphere:
+                    d[ins.out] = sphere(q[ins.a], k);
+                    break;
+                case OpCode::Plane:
+                    d[ins.out] = plane(q[ins.a], k);
+                    break;
+                case OpCode::Torus:
+                    d[ins.out] = torus(q[ins.a], k);
+                    break;
+                case OpCode::Box:
+                    d[ins.out] = box(q[ins.a], k);
+                    break;
+                case OpCode::Triangle:
+                    d[ins.out] = triangle(q[ins.a], k);
+                    break;
+                case OpCode::Transform:
+                    q[ins.out] = transform(q[ins.a], k);
+                    break;
+                case OpCode::Elongate:
+                    q[ins.out] = elongate(q[ins.a], k);
+                    break;
+                case OpCode::Scale:
+                    d[ins.out] = d[ins.a] * Float(k[0]);
+                    break;
+                case OpCode::ElongateCorrect:
+                    d[ins.out] = elongateCorrect(d[ins.a], q[ins.b], k);
+                    break;
+                case OpCode::Round:
+                    d[ins.out] = d[ins.a] - Float(k[0]);
+                    break;
+                case OpCode::Onion:
+                    d[ins.out] = abs(d[ins.a]) - Float(k[0]);
+                    break;
+                case OpCode::Union:
+                    d[ins.out] = min(d[ins.a], d[ins.b]);
+                    break;
+                case OpCode::SmoothUnion:
+                    d[ins.out] = smoothUnion(d[ins.a], d[ins.b], k[0]);
+                    break;
+                case OpCode::Difference:
+                    d[ins.out] = max(-d[ins.b], d[ins.a]);
+                    break;
+                case OpCode::SmoothDifference:
+                    d[ins.out] = smoothDifference(d[ins.a], d[ins.b], k[0]);
+                    break;
+                case OpCode::Intersection:
+                    d[ins.out] = max(d[ins.a], d[ins.b]);
+                    break;
+                case OpCode::SmoothIntersection:
+                    d[ins.out] = smoothIntersection(d[ins.a], d[ins.b], k[0]);
+                    break;
+            }
+        }
+        return d[result];
+    }
+}
+
+#endif //PROJECT_BATCH_H
@@ -0,0 +1,144 @@
+#ifndef PROJECT_BOUNDS_H
+#define PROJECT_BOUNDS_H
+
+#include <limits>
+#include <utility>
+#include <glm/glm.hpp>
+
+namespace sdf {
+
+    /**
+     * Axis aligned bounding box of the solid described by a SDF.
+     * @details
+     * Components may be infinite for unbounded shapes like planes. A default constructed box is empty.
+     */
+    struct AABB {
+        glm::vec3 min{std::numeric_limits<float>::infinity()};
+        glm::vec3 max{-std::numeric_limits<float>::infinity()};
+
+        /* Box containing all of space. */
+        static AABB infinite() {
+            constexpr float inf = std::numeric_limits<float>::infinity();
+            return {glm::vec3{-inf}, glm::vec3{inf}};
+        }
+
+        [[nodiscard]] bool isEmpty() const {
+            return min.x > max.x || min.y > max.y || min.z > max.z;
+        }
+
+        [[nodiscard]] bool isFinite() const {
+            return !isEmpty() && std::isfinite(min.x) && std::isfinite(min.y) && std::isfinite(min.z)
+                   && std::isfinite(max.x) && std::isfinite(max.y) && std::isfinite(max.z);
+        }
+
+        [[nodiscard]] glm::vec3 center() const {
+            return (min + max) * 0.5f;
+        }
+
+        /* Half the size of the box along each axis. */
+        [[nodiscard]] glm::vec3 extent() const {
+            return (max - min) * 0.5f;
+        }
+
+        /* Smallest box containing both boxes. */
+        [[nodiscard]] AABB merge(const AABB &other) const {
+            return {glm::min(min, other.min), glm::max(max, other.max)};
+        }
+
+        /* Largest box contained in both boxes. */
+        [[nodiscard]] AABB intersect(const AABB &other) const {
+            return {glm::max(min, other.min), glm::min(max, other.max)};
+        }
+
+        /* Grow the box by the given amount in every direction. */
+        [[nodiscard]] AABB expand(float amount) const {
+            if (isEmpty()) {
+                return *this;
+            }
+            return {min - amount, max + amount};
+        }
+
+        /* Grow the box by the given amount per axis. */
+        [[nodiscard]] AABB expand(const glm::vec3 &amount) const {
+            if (isEmpty()) {
+                return *this;
+            }
+            return {min - amount, max + amount};
+        }
+
+        /* Box containing this box after applying an affine transformation. */
+        [[nodiscard]] AABB transform(const glm::mat4 &m) const {
+            if (isEmpty()) {
+                return *this;
+            }
+            if (!isFinite()) {
+                return infinite();
+            }
+            glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1));
+            glm::vec3 e = extent();
+            glm::vec3 extent = glm::abs(glm::vec3(m[0])) * e.x
+                               + glm::abs(glm::vec3(m[1])) * e.y
+                               + glm::abs(glm::vec3(m[2])) * e.z;
+            return {c - extent, c + extent};
+        }
+
+        /* Box containing this box after scaling each axis. */
+        [[nodiscard]] AABB scale(const glm::vec3 &s) const {
+            if (isEmpty()) {
+                return *this;
+            }
+            glm::vec3 a = min * s, b = max * s;
+            return {glm::min(a, b), glm::max(a, b)};
+        }
+
+        /* Euclidean distance from a point to the box. Zero inside, infinite for empty boxes. */
+        [[nodiscard]] float distance(const glm::vec3 &p) const {
+            glm::vec3 d = glm::max(glm::max(min - p, p - max), 0.0f);
+            return glm::length(d);
+        }
+
+        /* Distance between the nearest points of two boxes. Zero if they overlap, infinite if either is empty. */
+        [[nodiscard]] float distance(const AABB &other) const {
+            glm::vec3 d = glm::max(glm::max(min - other.max, other.min - max), 0.0f);
+            return glm::length(d);
+        }
+
+        /**
+         * Signed distance from a point to the surface of a finite box, negative inside.
+         * @details
+         * Never exceeds the exact signed distance of a solid contained in the box, so it bounds that from below.
+         */
+        [[nodiscard]] float signedDistance(const glm::vec3 &p) const {
+            glm::vec3 q = glm::abs(p - center()) - extent();
+            return glm::length(glm::max(q, 0.0f)) + glm::min(glm::max(q.x, glm::max(q.y, q.z)), 0.0f);
+        }
+
+        /**
+         * Intersect a ray with the box.
+         * @return Ray parameters where the ray enters and exits the box. The ray misses if the first exceeds the second.
+         */
+        [[nodiscard]] std::pair<float, float> intersect(const glm::vec3 &origin, const glm::vec3 &dir) const {
+            constexpr float inf = std::numeric_limits<float>::infinity();
+            float enter = -inf, exit = inf;
+            for (int i = 0; i < 3; ++i) {
+                if (dir[i] == 0.0f) {
+                    if (origin[i] < min[i] || origin[i] > max[i]) {
+                        return {inf, -inf};
+                    }
+                    continue;
+                }
+                float inv = 1.0f / dir[i];
+                float t0 = (min[i] - origin[i]) * inv;
+                float t1 = (max[i] - origin[i]) * inv;
+                if (t0 > t1) {
+                    std::swap(t0, t1);
+                }
+                enter = glm::max(enter, t0);
+                exit = glm::min(exit, t1);
+            }
+            return {enter, exit};
+        }
+    };
+}
+
+#endif //PROJECT_BOUNDS_H
@@ -0,0 +1,175 @@
+#ifndef PROJECT_BRICKMAP_H
+#define PROJECT_BRICKMAP_H
+
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace sdf {
+
+    /**
+     * Sparse cache of a distance field, baked once for static objects.
+     * @details
+     * Space around the object is divided into bricks of BrickSize^3 voxels. Only bricks near the surface store samples,
+     * quantized to 16 bits, with one extra layer so lookups never need a neighbouring brick. All other bricks hold a
+     * single bound valid anywhere inside them. Lookups return conservative bounds, and decline near the surface where
+     * the exact field has to be evaluated instead, so marching with the cache finds the same surface.
+     */
+    class BrickMap {
+    public:
+        static constexpr int BrickSize = 8;
+
+        BrickMap() = default;
+
+        /**
+         * Bake the field of a tape within the given bounds.
+         * @param bounds Finite bounds of the object
+         * @param voxelSize Spacing of the stored samples
+         * @param band Distance to the surface within which lookups decline. Defaults to four voxels.
+         */
+        BrickMap(const Tape &tape, const AABB &bounds, float voxelSize, float band = 0)
+                : voxel(voxelSize), band(band > 0 ? band : 4 * voxelSize) {
+            const float brick = BrickSize * voxel;
+            const float halfDiagonal = 0.5f * std::sqrt(3.0f) * brick;
+            // Values in resident bricks are at most this far from zero
+            range = this->band + 2 * halfDiagonal;
+
+            box = bounds.expand(this->band + voxel);
+            dims = glm::max(glm::ivec3(glm::ceil((box.max - box.min) / brick)), 1);
+            box.max = box.min + glm::vec3(dims) * brick;
+
+            // Classify bricks by the distance at their centers
+            const std::size_t count = static_cast<std::size_t>(dims.x) * dims.y * dims.z;
+            std::vector<float> x(count), y(count), z(count), d(count);
+            for (std::size_t i = 0; i < count; ++i) {
+                glm::vec3 c = box.min + (glm::vec3(coordinates(i)) + 0.5f) * brick;
+                x[i] = c.x;
+                y[i] = c.y;
+                z[i] = c.z;
+            }
+            tape.signedDistances(x.data(), y.data(), z.data(), d.data(), count);
+
+            bricks.assign(count, -1);
+            far.assign(count, 0.0f);
+            std::vector<std::size_t> resident;
+            for (std::size_t i = 0; i < count; ++i) {
+                if (std::abs(d[i]) - halfDiagonal > this->band) {
+                    far[i] = d[i];
+                } else {
+                    bricks[i] = static_cast<std::int32_t>(resident.size());
+                    resident.push_back(i);
+                }
+            }
+
+            samples.resize(resident.size() * BrickSamples);
+            #pragma omp parallel for schedule(dynamic)
+            for (std::ptrdiff_t r = 0; r < static_cast<std::ptrdiff_t>(resident.size()); ++r) {
+                float bx[BrickSamples], by[BrickSamples], bz[BrickSamples], bd[BrickSamples];
+                glm::vec3 origin = box.min + glm::vec3(coordinates(resident[r])) * brick;
+                for (int s = 0; s < BrickSamples; ++s) {
+                    glm::vec3 p = origin + glm::vec3(s % Side, s / Side % Side, s / (Side * Side)) * voxel;
+                    bx[s] = p.x;
+                    by[s] = p.y;
+                    bz[s] = p.z;
+                }
+                tape.signedDistances(bx, by, bz, bd, BrickSamples);
+                for (int s = 0; s < BrickSamples; ++s) {
+                    samples[r * BrickSamples + s] = quantize(bd[s]);
+                }
+            }
+        }
+
+        /**
+         * Bound of the distance at p, with the sign of the field, that never exceeds the actual distance.
+         * @return The bound, or nothing if p may be within `band` of the surface.
+         */
+        [[nodiscard]] std::optional<float> lookup(const glm::vec3 &p) const {
+            if (bricks.empty()) {
+                return std::nullopt;
+            }
+            // The surface is at least `band` further inside than the cached region
+            float outside = box.distance(p);
+            if (outside > 0) {
+                return outside + band;
+            }
+
+            glm::vec3 g = (p - box.min) / voxel;
+            glm::ivec3 b = glm::clamp(glm::ivec3(g / float(BrickSize)), glm::ivec3(0), dims - 1);
+            std::size_t index = (static_cast<std::size_t>(b.z) * dims.y + b.y) * dims.x + b.x;
+            // The field changes no faster than distance, so far bricks are bounded by the distance to their center
+            if (bricks[index] < 0) {
+                glm::vec3 center = box.min + (glm::vec3(b) + 0.5f) * (BrickSize * voxel);
+                return std::copysign(std::abs(far[index]) - glm::distance(p, center), far[index]);
+            }
+
+            glm::vec3 local = glm::clamp(g - glm::vec3(b * BrickSize), 0.0f, float(BrickSize));
+            glm::ivec3 i = glm::min(glm::ivec3(local), BrickSize - 1);
+            glm::vec3 f = local - glm::vec3(i);
+            const std::int16_t *s = samples.data() + static_cast<std::size_t>(bricks[index]) * BrickSamples
+                                    + (i.z * Side + i.y) * Side + i.x;
+            auto at = [&](int dx, int dy, int dz) {
+                return float(s[(dz * Side + dy) * Side + dx]);
+            };
+            float v = glm::mix(
+                    glm::mix(glm::mix(at(0, 0, 0), at(1, 0, 0), f.x), glm::mix(at(0, 1, 0), at(1, 1, 0), f.x), f.y),
+                    glm::mix(glm::mix(at(0, 0, 1), at(1, 0, 1), f.x), glm::mix(at(0, 1, 1), at(1, 1, 1), f.x), f.y),
+                    f.z) * (range / Quantization);
+
+            // Interpolation is off by at most the weighted distance to the samples, which this bounds, plus rounding
+            glm::vec3 spread = f * (1.0f - f);
+            float margin = voxel * std::sqrt(spread.x + spread.y + spread.z) + range / Quantization;
+            float bound = std::abs(v) - margin;
+            if (bound < band) {
+                return std::nullopt;
+            }
+            return std::copysign(bound, v);
+        }
+
+        [[nodiscard]] bool empty() const {
+            return bricks.empty();
+        }
+
+        /* Number of bricks, and of those that store samples. */
+        [[nodiscard]] std::size_t brickCount() const {
+            return bricks.size();
+        }
+
+        [[nodiscard]] std::size_t residentBricks() const {
+            return samples.size() / BrickSamples;
+        }
+
+        [[nodiscard]] std::size_t bytes() const {
+            return bricks.size() * (sizeof(std::int32_t) + sizeof(float)) + samples.size() * sizeof(std::int16_t);
+        }
+
+    private:
+        static constexpr int Side = BrickSize + 1;
+        static constexpr int BrickSamples = Side * Side * Side;
+        static constexpr float Quantization = 32767.0f;
+
+        AABB box;
+        glm::ivec3 dims{0};
+        float voxel = 0;
+        float band = 0;
+        float range = 0;
+
+        // Offset of the samples of each brick in units of BrickSamples, or -1 for bricks away from the surface
+        std::vector<std::int32_t> bricks;
+        // Distance at the center of bricks away from the surface
+        std::vector<float> far;
+        std::vector<std::int16_t> samples;
+
+        [[nodiscard]] glm::ivec3 coordinates(std::size_t index) const {
+            auto i = static_cast<int>(index);
+            return {i % dims.x, i / dims.x % dims.y, i / (dims.x * dims.y)};
+        }
+
+        [[nodiscard]] std::int16_t quantize(float d) const {
+            return static_cast<std::int16_t>(std::lround(glm::clamp(d / range, -1.0f, 1.0f) * Quantization));
+        }
+    };
+}
+
+#endif //PROJECT_BRICKMAP_H
@@ -1,16 +1,21 @@
 #ifndef PROJECT_COMMON_H
 #define PROJECT_COMMON_H
 
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <glm/gtx/vec_swizzle.hpp>
 #include "../material.h"
+#include "bounds.h"
+#include "dual.h"
 
 namespace sdf {
 
-    /* Represents the compound return value of a SDF. Includes the sampled distance and material. */
+    class TapeBuilder;
+
+    /* Represents the compound return value of a SDF. Includes the sampled distance and the materials at the point. */
     struct Sample {
         float value = std::numeric_limits<float>::infinity();
-        Material material;
+        MaterialBlend materials;
     };
 
     /* Base class for all SDF objects. Used for building CSG trees. */
@@ -19,32 +24,85 @@ namespace sdf {
 
         Node() = default;
 
-        /* Obtain a sample of the SDF at the given point, containing distance and material. */
+        /**
+         * Obtain a sample of the SDF at the given point, containing distance and materials.
+         * @details
+         * Only needed to resolve the material once a surface has been found, marching and shading use distances only.
+         * Materials are identified by the IDs assigned in bindMaterials.
+         */
         [[nodiscard]] virtual Sample sampleAt(const glm::vec3 &p) = 0;
 
         /* Evaluate the SDF at a given point, yielding a distance value. */
         [[nodiscard]] virtual float signedDistance(const glm::vec3 &p) = 0;
 
+        /**
+         * Evaluate the SDF at `n` points given as separate coordinate arrays, writing one distance per point.
+         * @details
+         * Scalar reference for the batched tape evaluation, and fallback for nodes the tape calls back into.
+         */
+        void signedDistances(const float *x, const float *y, const float *z, float *out, std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                out[i] = signedDistance(glm::vec3(x[i], y[i], z[i]));
+            }
+        }
+
+        /**
+         * Lower this node into instructions of a flat evaluation tape.
+         * @details
+         * Nodes that do not provide their own lowering are evaluated on the tape through a call back into the tree.
+         * @param builder Tape under construction
+         * @param point Value holding the point this node is evaluated at
+         * @return Value holding the resulting distance
+         */
+        virtual std::uint32_t compile(TapeBuilder &builder, std::uint32_t point);
+
+        /**
+         * Add the materials of this node and its children to the material table of a scene, keeping their IDs.
+         * @details
+         * Called when the tree is added to a scene, materials changed afterwards are not picked up.
+         */
+        virtual void bindMaterials(MaterialTable &table) {}
+
+        /**
+         * Conservative bounds of the solid described by this node, computed bottom-up through the tree.
+         * @details
+         * Nodes that cannot tell their extent are unbounded.
+         */
+        [[nodiscard]] virtual AABB bounds() {
+            return AABB::infinite();
+        }
+
+        /**
+         * Evaluate the SDF at a point given as dual numbers, yielding the distance along with its gradient.
+         * @details
+         * Nodes that cannot provide derivatives estimate them from four samples of signedDistance around the point,
+         * with the tetrahedral pattern of Inigo Quilez, and chain them with the derivatives of the point.
+         */
+        [[nodiscard]] virtual dual::Float dualDistance(const dual::Vec3 &p) {
+            constexpr float e = 1e-4f;
+            const glm::vec2 k = glm::vec2(1.f, -1.f) * 0.5773f;
+            const glm::vec3 taps[4] = {glm::xyy(k), glm::yyx(k), glm::yxy(k), glm::xxx(k)};
+            glm::vec3 x = p.value();
+            glm::vec3 local{0};
+            for (const auto &tap : taps) {
+                local += tap * signedDistance(x + tap * e);
+            }
+            // The taps sum to zero and their outer products to 4 * 0.5773^2 times the identity
+            local /= 4 * 0.5773f * 0.5773f * e;
+            return {signedDistance(x), local.x * p.x.gradient + local.y * p.y.gradient + local.z * p.z.gradient};
+        }
+
         /**
          * Compute the normal vector at a given point.
          * @details
          * The point need not be on the surface of the SDF, in which case the normal represents the tangent vector to
-         * the gradient of the field represented by the SDF. May be costly to compute depending on the complexity of the SDF.
+         * the gradient of the field represented by the SDF. Computed in a single pass through the tree, see
+         * dualDistance.
          * @param p Point to evaluate
-         * @param e tolerance
          * @return
          */
-        [[nodiscard]] glm::vec3 normal(const glm::vec3 &p, float e) {
-            const glm::vec2 k = glm::vec2(1.f, -1.f) * 0.5773f;
-            glm::vec3 a = glm::xyy(k);
-            glm::vec3 b = glm::yyx(k);
-            glm::vec3 c = glm::yxy(k);
-            glm::vec3 d = glm::xxx(k);
-            glm::vec3 val = a * sampleAt(p + a * e).value
-                            + b * sampleAt(p + b * e).value
-                            + c * sampleAt(p + c * e).value
-                            + d * sampleAt(p + d * e).value;
-            return glm::normalize(val);
+        [[nodiscard]] glm::vec3 normal(const glm::vec3 &p) {
+            return glm::normalize(dualDistance(dual::Vec3::variable(p)).gradient);
         }
 
         static std::shared_ptr<Node> Empty;
@@ -60,6 +118,16 @@ namespace sdf {
         float signedDistance(const vec3 &p) override {
             return std::numeric_limits<float>::infinity();
         }
+
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            return std::numeric_limits<float>::infinity();
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override;
+
+        AABB bounds() override {
+            return {};
+        }
     };
 }
 
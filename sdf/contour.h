@@ -0,0 +1,712 @@
+#ifndef PROJECT_CONTOUR_H
+#define PROJECT_CONTOUR_H
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace sdf {
+
+    /**
+     * Destination of a mesh that is written out piece by piece, as it is extracted.
+     * @details
+     * Vertices are numbered from 0 in the order they are written. Triangles only refer to vertices written before them,
+     * and their vertices are in counterclockwise order seen from outside the solid.
+     */
+    class MeshWriter {
+    public:
+        virtual ~MeshWriter() = default;
+
+        virtual void writeVertices(std::span<const glm::vec3> positions, std::span<const glm::vec3> normals) = 0;
+
+        virtual void writeTriangles(std::span<const glm::uvec3> triangles) = 0;
+
+        /**
+         * Complete the mesh once everything has been written.
+         * @return False if the mesh could not be written
+         */
+        virtual bool finish() = 0;
+
+        /* Writer of a file in the format given by its extension, .obj or .ply. nullptr if the format is unknown. */
+        static std::unique_ptr<MeshWriter> open(const std::filesystem::path &path);
+    };
+
+    /* Wavefront OBJ text with positions and normals, written straight to the file. */
+    class ObjWriter final : public MeshWriter {
+    public:
+        explicit ObjWriter(const std::filesystem::path &path) : out(path, std::ios::binary) {}
+
+        void writeVertices(std::span<const glm::vec3> positions, std::span<const glm::vec3> normals) override {
+            buffer.clear();
+            for (std::size_t i = 0; i < positions.size(); ++i) {
+                line("v", positions[i]);
+                line("vn", normals[i]);
+            }
+            out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        }
+
+        void writeTriangles(std::span<const glm::uvec3> triangles) override {
+            buffer.clear();
+            for (auto &triangle : triangles) {
+                buffer += 'f';
+                for (int k = 0; k < 3; ++k) {
+                    // Indices start at 1, and the normal of a vertex has the same index as its position
+                    buffer += ' ';
+                    append(triangle[k] + 1);
+                    buffer += "//";
+                    append(triangle[k] + 1);
+                }
+                buffer += '\n';
+            }
+            out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        }
+
+        bool finish() override {
+            out.flush();
+            return static_cast<bool>(out);
+        }
+
+        [[nodiscard]] bool isOpen() const {
+            return out.is_open();
+        }
+
+    private:
+        std::ofstream out;
+        std::string buffer;
+
+        template<typename T>
+        void append(T value) {
+            char text[32];
+            buffer.append(text, std::to_chars(text, text + sizeof(text), value).ptr);
+        }
+
+        void line(const char *keyword, const glm::vec3 &v) {
+            buffer += keyword;
+            for (int k = 0; k < 3; ++k) {
+                buffer += ' ';
+                append(v[k]);
+            }
+            buffer += '\n';
+        }
+    };
+
+    /**
+     * Binary PLY with positions, normals and triangles.
+     * @details
+     * The header states the number of vertices and faces, and all vertices come before the faces. Both are streamed
+     * to temporary files until the mesh is finished, then copied to the file behind the header.
+     */
+    class PlyWriter final : public MeshWriter {
+    public:
+        explicit PlyWriter(const std::filesystem::path &path)
+                : out(path, std::ios::binary), vertexFile(std::tmpfile(), &std::fclose),
+                  faceFile(std::tmpfile(), &std::fclose) {}
+
+        void writeVertices(std::span<const glm::vec3> positions, std::span<const glm::vec3> normals) override {
+            buffer.resize(positions.size() * VertexBytes);
+            for (std::size_t i = 0; i < positions.size(); ++i) {
+                std::memcpy(&buffer[i * VertexBytes], &positions[i], sizeof(glm::vec3));
+                std::memcpy(&buffer[i * VertexBytes + sizeof(glm::vec3)], &normals[i], sizeof(glm::vec3));
+            }
+            vertices += positions.size();
+            failed |= !vertexFile || std::fwrite(buffer.data(), 1, buffer.size(), vertexFile.get()) != buffer.size();
+        }
+
+        void writeTriangles(std::span<const glm::uvec3> triangles) override {
+            buffer.resize(triangles.size() * FaceBytes);
+            for (std::size_t i = 0; i < triangles.size(); ++i) {
+                buffer[i * FaceBytes] = 3;
+                std::memcpy(&buffer[i * FaceBytes + 1], &triangles[i], sizeof(glm::uvec3));
+            }
+            faces += triangles.size();
+            failed |= !faceFile || std::fwrite(buffer.data(), 1, buffer.size(), faceFile.get()) != buffer.size();
+        }
+
+        bool finish() override {
+            if (failed) {
+                return false;
+            }
+            out << "ply\nformat " << (std::endian::native == std::endian::little ? "binary_little_endian"
+                                                                                  : "binary_big_endian") << " 1.0\n"
+                << "element vertex " << vertices << "\n"
+                << "property float x\nproperty float y\nproperty float z\n"
+                << "property float nx\nproperty float ny\nproperty float nz\n"
+                << "element face " << faces << "\n"
+                << "property list uchar uint vertex_indices\n"
+                << "end_header\n";
+            return copy(vertexFile.get()) && copy(faceFile.get()) && out.flush();
+        }
+
+        [[nodiscard]] bool isOpen() const {
+            return out.is_open() && vertexFile && faceFile;
+        }
+
+    private:
+        static constexpr std::size_t VertexBytes = 2 * sizeof(glm::vec3);
+        static constexpr std::size_t FaceBytes = 1 + sizeof(glm::uvec3);
+
+        std::ofstream out;
+        std::unique_ptr<std::FILE, decltype(&std::fclose)> vertexFile;
+        std::unique_ptr<std::FILE, decltype(&std::fclose)> faceFile;
+        std::vector<char> buffer;
+        std::size_t vertices = 0;
+        std::size_t faces = 0;
+        bool failed = false;
+
+        bool copy(std::FILE *file) {
+            std::rewind(file);
+            char block[1 << 16];
+            std::size_t read;
+            while ((read = std::fread(block, 1, sizeof(block), file)) > 0) {
+                out.write(block, static_cast<std::streamsize>(read));
+            }
+            return !std::ferror(file) && out;
+        }
+    };
+
+    /* Collects a mesh in memory, without its normals. */
+    class MeshDataWriter final : public MeshWriter {
+    public:
+        void writeVertices(std::span<const glm::vec3> positions, std::span<const glm::vec3> normals) override {
+            data.vertices.insert(data.vertices.end(), positions.begin(), positions.end());
+        }
+
+        void writeTriangles(std::span<const glm::uvec3> triangles) override {
+            data.triangles.insert(data.triangles.end(), triangles.begin(), triangles.end());
+        }
+
+        bool finish() override {
+            return true;
+        }
+
+        [[nodiscard]] const MeshData &getData() const {
+            return data;
+        }
+
+    private:
+        MeshData data;
+    };
+
+    inline std::unique_ptr<MeshWriter> MeshWriter::open(const std::filesystem::path &path) {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+            return static_cast<char>(std::tolower(c));
+        });
+        if (extension == ".obj") {
+            auto writer = std::make_unique<ObjWriter>(path);
+            return writer->isOpen() ? std::move(writer) : nullptr;
+        }
+        if (extension == ".ply") {
+            auto writer = std::make_unique<PlyWriter>(path);
+            return writer->isOpen() ? std::move(writer) : nullptr;
+        }
+        return nullptr;
+    }
+
+    /* Work done extracting a mesh. */
+    struct ContourStats {
+        // Chunks of cells the surface may pass through, and cells in them left after culling
+        std::size_t chunks = 0;
+        std::size_t cells = 0;
+        // Cells the surface passes through, with one vertex each
+        std::size_t vertices = 0;
+        std::size_t triangles = 0;
+        // Distance evaluations for culling, at corners and while locating the surface on edges
+        std::size_t evaluations = 0;
+        // Most chunks held in memory at once
+        std::size_t peakChunks = 0;
+    };
+
+    /**
+     * Extracts a closed triangle mesh of the surface of a SDF with dual contouring.
+     * @details
+     * Space is divided into a grid of cubic cells that is never stored in full. An octree over the grid is descended
+     * only into nodes whose center is closer to the surface than half their diagonal, as the surface cannot pass
+     * through the others. Nodes of ChunkSize^3 cells are chunks, within which the same culling continues down to single
+     * cells, whose corners are then sampled in batches through the tape.
+     *
+     * Every cell with corners on both sides of the surface gets a vertex, placed to minimize the squared distances to
+     * the tangent planes where the surface crosses its edges. Unlike the edge midpoints of marching cubes, this keeps
+     * the sharp edges and corners of CSG. Every crossed edge becomes a quad between the vertices of the four cells
+     * around it, split into two triangles. Neighbouring cells share their corners and so agree on every crossing,
+     * which makes the mesh closed. It is not always manifold, as parts of the surface thinner than a cell meet in a
+     * single vertex.
+     *
+     * Chunks are processed a layer along z at a time, with the chunks of a layer in parallel. Quads only need vertices
+     * of the same layer and the one below, so two layers are held at once and everything else is written out already.
+     * Culling relies on the SDF never overestimating the distance to the surface, which sphere tracing requires too.
+     */
+    class DualContouring {
+    public:
+        // Side of a chunk in cells, a power of two
+        static constexpr int ChunkSize = 32;
+
+        /* @param resolution Cells along the longest side of the bounds */
+        explicit DualContouring(int resolution = 256) : resolution(std::max(resolution, 1)) {}
+
+        /**
+         * Extract the surface of a node within its bounds.
+         * @return False if the node is unbounded or the mesh could not be written
+         */
+        bool extract(Node &node, MeshWriter &writer) {
+            return extract(node, node.bounds(), writer);
+        }
+
+        /* Extract the surface of a node within the given bounds, which are padded by two cells to close the mesh. */
+        bool extract(Node &node, const AABB &bounds, MeshWriter &writer);
+
+        [[nodiscard]] const ContourStats &getStats() const {
+            return stats;
+        }
+
+    private:
+        // Steps of false position locating the surface on a crossed edge
+        static constexpr int RefineSteps = 4;
+        // Eigenvalues of the tangent plane system below this fraction of the largest leave the mass point in place
+        static constexpr float PlaneThreshold = 0.1f;
+        static constexpr int Corners = ChunkSize + 1;
+
+        /* Crossed edge, by the cell at its lower end, with whether that end is inside the solid. */
+        struct Edge {
+            glm::ivec3 cell;
+            int axis;
+            bool inside;
+        };
+
+        /* Edge between corners on either side of the surface, with the part of it the surface is known to cross. */
+        struct Crossing {
+            glm::vec3 a;
+            glm::vec3 b;
+            // Distances at the ends of the part between t0 and t1
+            float da;
+            float db;
+            float t0 = 0;
+            float t1 = 1;
+            glm::vec3 point{0};
+            glm::vec3 normal{0};
+        };
+
+        struct Chunk {
+            glm::ivec3 coordinates{0};
+            // Cells with a vertex, as indices within the chunk in increasing order
+            std::vector<std::uint32_t> cells;
+            std::vector<glm::vec3> positions;
+            std::vector<glm::vec3> normals;
+            // Crossed edges at the lowest corner of the cells
+            std::vector<Edge> edges;
+            std::vector<glm::uvec3> triangles;
+            // Index of the first vertex of the chunk in the mesh
+            std::uint32_t first = 0;
+            // Cells left after culling
+            std::size_t remaining = 0;
+            std::size_t evaluations = 0;
+        };
+
+        struct Vertex {
+            std::uint32_t index;
+            glm::vec3 position;
+        };
+
+        int resolution;
+        ContourStats stats;
+        // Grid of the current extraction
+        glm::vec3 origin{0};
+        float cellSize = 0;
+        glm::ivec3 chunkCount{0};
+
+        [[nodiscard]] glm::vec3 corner(const glm::ivec3 &index) const {
+            return origin + glm::vec3(index) * cellSize;
+        }
+
+        /**
+         * Keep the cubes, given by their lowest cell and a side in cells, that the surface may pass through.
+         * @return Number of distance evaluations
+         */
+        std::size_t cull(const Tape &tape, std::vector<glm::ivec3> &cubes, int side) const {
+            std::size_t n = cubes.size();
+            std::vector<float> x(n), y(n), z(n), d(n);
+            for (std::size_t i = 0; i < n; ++i) {
+                glm::vec3 c = origin + (glm::vec3(cubes[i]) + 0.5f * float(side)) * cellSize;
+                x[i] = c.x;
+                y[i] = c.y;
+                z[i] = c.z;
+            }
+            tape.signedDistances(x.data(), y.data(), z.data(), d.data(), n);
+            // Slightly more than half the diagonal, so rounding never culls a cell with a crossing on its border
+            float reach = 0.5f * std::sqrt(3.0f) * float(side) * cellSize * 1.001f;
+            std::size_t kept = 0;
+            for (std::size_t i = 0; i < n; ++i) {
+                if (std::abs(d[i]) <= reach) {
+                    cubes[kept++] = cubes[i];
+                }
+            }
+            cubes.resize(kept);
+            return n;
+        }
+
+        /* The eight halves of each cube of the given side, leaving out those outside the grid. */
+        [[nodiscard]] std::vector<glm::ivec3> split(const std::vector<glm::ivec3> &cubes, int side) const {
+            const glm::ivec3 limit = chunkCount * ChunkSize;
+            const int half = side / 2;
+            std::vector<glm::ivec3> children;
+            children.reserve(cubes.size() * 8);
+            for (auto &cube : cubes) {
+                for (int c = 0; c < 8; ++c) {
+                    glm::ivec3 child = cube + glm::ivec3(c & 1, (c >> 1) & 1, c >> 2) * half;
+                    if (glm::all(glm::lessThan(child, limit))) {
+                        children.push_back(child);
+                    }
+                }
+            }
+            return children;
+        }
+
+        /* Chunks the surface may pass through, ordered by z, then y, then x. */
+        std::vector<glm::ivec3> findChunks(const Tape &tape) {
+            int side = ChunkSize * static_cast<int>(std::bit_ceil(static_cast<unsigned>(
+                    std::max({chunkCount.x, chunkCount.y, chunkCount.z}))));
+            std::vector<glm::ivec3> cubes{glm::ivec3(0)};
+            stats.evaluations += cull(tape, cubes, side);
+            for (; side > ChunkSize; side /= 2) {
+                cubes = split(cubes, side);
+                stats.evaluations += cull(tape, cubes, side / 2);
+            }
+            for (auto &cube : cubes) {
+                cube /= ChunkSize;
+            }
+            std::sort(cubes.begin(), cubes.end(), [](const glm::ivec3 &a, const glm::ivec3 &b) {
+                return std::tie(a.z, a.y, a.x) < std::tie(b.z, b.y, b.x);
+            });
+            return cubes;
+        }
+
+        /* Vertices of the cells of a chunk, and the crossed edges at their lowest corners. */
+        void contour(const Tape &tape, Node &node, Chunk &chunk) const {
+            const glm::ivec3 base = chunk.coordinates * ChunkSize;
+            std::vector<glm::ivec3> cells{base};
+            for (int side = ChunkSize; side > 1; side /= 2) {
+                cells = split(cells, side);
+                chunk.evaluations += cull(tape, cells, side / 2);
+            }
+            chunk.remaining = cells.size();
+            auto local = [&](const glm::ivec3 &cell) {
+                glm::ivec3 l = cell - base;
+                return static_cast<std::uint32_t>((l.z * ChunkSize + l.y) * ChunkSize + l.x);
+            };
+            std::sort(cells.begin(), cells.end(), [&](const glm::ivec3 &a, const glm::ivec3 &b) {
+                return local(a) < local(b);
+            });
+
+            // Sample the corners of the remaining cells, each once
+            auto cornerIndex = [&](const glm::ivec3 &index) {
+                glm::ivec3 l = index - base;
+                return static_cast<std::size_t>((l.z * Corners + l.y) * Corners + l.x);
+            };
+            std::vector<float> values(static_cast<std::size_t>(Corners) * Corners * Corners,
+                                      std::numeric_limits<float>::quiet_NaN());
+            std::vector<glm::ivec3> pending;
+            for (auto &cell : cells) {
+                for (int c = 0; c < 8; ++c) {
+                    glm::ivec3 index = cell + glm::ivec3(c & 1, (c >> 1) & 1, c >> 2);
+                    float &value = values[cornerIndex(index)];
+                    if (std::isnan(value)) {
+                        // Marks the corner as pending until it is sampled
+                        value = 0;
+                        pending.push_back(index);
+                    }
+                }
+            }
+            std::size_t n = pending.size();
+            std::vector<float> x(n), y(n), z(n), d(n);
+            for (std::size_t i = 0; i < n; ++i) {
+                glm::vec3 p = corner(pending[i]);
+                x[i] = p.x;
+                y[i] = p.y;
+                z[i] = p.z;
+            }
+            tape.signedDistances(x.data(), y.data(), z.data(), d.data(), n);
+            for (std::size_t i = 0; i < n; ++i) {
+                values[cornerIndex(pending[i])] = d[i];
+            }
+            chunk.evaluations += n;
+
+            // Crossed edges shared by several cells of the chunk are located once, found by lower corner and axis
+            std::vector<std::int32_t> crossingIndex(3 * values.size(), -1);
+            std::vector<Crossing> crossings;
+            auto crossing = [&](const glm::ivec3 &cell, int c, int axis) -> std::int32_t & {
+                return crossingIndex[3 * cornerIndex(cell + glm::ivec3(c & 1, (c >> 1) & 1, c >> 2)) + axis];
+            };
+            std::vector<std::pair<glm::ivec3, int>> surface;
+            for (auto &cell : cells) {
+                int inside = 0;
+                for (int c = 0; c < 8; ++c) {
+                    inside |= (values[cornerIndex(cell + glm::ivec3(c & 1, (c >> 1) & 1, c >> 2))] < 0) << c;
+                }
+                if (inside == 0 || inside == 0xFF) {
+                    continue;
+                }
+                surface.emplace_back(cell, inside);
+                forEachCrossing(inside, [&](int c, int axis) {
+                    std::int32_t &slot = crossing(cell, c, axis);
+                    if (slot < 0) {
+                        slot = static_cast<std::int32_t>(crossings.size());
+                        glm::ivec3 low = cell + glm::ivec3(c & 1, (c >> 1) & 1, c >> 2);
+                        glm::ivec3 high = low;
+                        high[axis] += 1;
+                        crossings.push_back({corner(low), corner(high), values[cornerIndex(low)],
+                                             values[cornerIndex(high)]});
+                    }
+                });
+            }
+            locate(tape, node, crossings, chunk.evaluations);
+
+            for (auto &[cell, inside] : surface) {
+                glm::mat3 ata(0);
+                glm::vec3 atb(0), mass(0), normal(0);
+                int count = 0;
+                forEachCrossing(inside, [&](int c, int axis) {
+                    const Crossing &edge = crossings[crossing(cell, c, axis)];
+                    const glm::vec3 &p = edge.point, &n = edge.normal;
+                    mass += p;
+                    ++count;
+                    if (std::isfinite(n.x) && std::isfinite(n.y) && std::isfinite(n.z)) {
+                        ata += glm::outerProduct(n, n);
+                        atb += n * glm::dot(n, p);
+                        normal += n;
+                    }
+                });
+                mass /= float(count);
+                glm::vec3 low = corner(cell);
+                glm::vec3 position = glm::clamp(solve(ata, atb, mass), low, low + cellSize);
+                float length = glm::length(normal);
+                chunk.cells.push_back(local(cell));
+                chunk.positions.push_back(position);
+                chunk.normals.push_back(length > 0 ? normal / length : node.normal(position));
+
+                for (int axis = 0; axis < 3; ++axis) {
+                    if ((inside & 1) != ((inside >> (1 << axis)) & 1)) {
+                        chunk.edges.push_back({cell, axis, (inside & 1) != 0});
+                    }
+                }
+            }
+        }
+
+        /* Call f(corner, axis) for each edge of a cell, by its lower corner, with one end inside and one outside. */
+        template<typename F>
+        static void forEachCrossing(int inside, F &&f) {
+            for (int axis = 0; axis < 3; ++axis) {
+                for (int c = 0; c < 8; ++c) {
+                    int c1 = c | (1 << axis);
+                    if (!((c >> axis) & 1) && ((inside >> c) & 1) != ((inside >> c1) & 1)) {
+                        f(c, axis);
+                    }
+                }
+            }
+        }
+
+        /**
+         * Locate the surface on crossed edges, along with its normal there.
+         * @details
+         * Steps of false position keep each crossing bracketed, and go through all edges at once in batches.
+         */
+        static void locate(const Tape &tape, Node &node, std::vector<Crossing> &crossings, std::size_t &evaluations) {
+            std::size_t n = crossings.size();
+            std::vector<float> x(n), y(n), z(n), d(n), t(n);
+            for (int step = 0; step < RefineSteps; ++step) {
+                for (std::size_t i = 0; i < n; ++i) {
+                    auto &c = crossings[i];
+                    t[i] = c.t0 + (c.t1 - c.t0) * c.da / (c.da - c.db);
+                    glm::vec3 p = glm::mix(c.a, c.b, t[i]);
+                    x[i] = p.x;
+                    y[i] = p.y;
+                    z[i] = p.z;
+                }
+                tape.signedDistances(x.data(), y.data(), z.data(), d.data(), n);
+                for (std::size_t i = 0; i < n; ++i) {
+                    auto &c = crossings[i];
+                    if ((d[i] < 0) == (c.da < 0)) {
+                        c.t0 = t[i];
+                        c.da = d[i];
+                    } else {
+                        c.t1 = t[i];
+                        c.db = d[i];
+                    }
+                }
+            }
+            evaluations += RefineSteps * n;
+            for (auto &c : crossings) {
+                c.point = glm::mix(c.a, c.b, c.t0 + (c.t1 - c.t0) * c.da / (c.da - c.db));
+                c.normal = node.normal(c.point);
+            }
+        }
+
+        /**
+         * Point closest to all tangent planes, given as the normal equations of their squared distances.
+         * @details
+         * Solved relative to the mean of the crossings, with eigenvalues below PlaneThreshold of the largest left
+         * out. Flat regions only constrain the vertex along their normal, and it stays at the mean along the surface.
+         */
+        static glm::vec3 solve(const glm::mat3 &ata, const glm::vec3 &atb, const glm::vec3 &mass) {
+            glm::vec3 values;
+            glm::mat3 vectors;
+            eigen(ata, values, vectors);
+            float largest = std::max({values.x, values.y, values.z});
+            glm::vec3 residual = atb - ata * mass;
+            glm::vec3 x = mass;
+            for (int i = 0; i < 3; ++i) {
+                if (values[i] > PlaneThreshold * largest && values[i] > 0) {
+                    x += vectors[i] * (glm::dot(vectors[i], residual) / values[i]);
+                }
+            }
+            return x;
+        }
+
+        /* Eigenvalues and eigenvectors, as columns, of a symmetric matrix, with the cyclic Jacobi method. */
+        static void eigen(glm::mat3 a, glm::vec3 &values, glm::mat3 &vectors) {
+            vectors = glm::mat3(1);
+            for (int sweep = 0; sweep < 8; ++sweep) {
+                for (auto [p, q] : {std::pair{0, 1}, std::pair{0, 2}, std::pair{1, 2}}) {
+                    float apq = a[q][p];
+                    if (std::abs(apq) <= 1e-12f) {
+                        continue;
+                    }
+                    float theta = (a[q][q] - a[p][p]) / (2 * apq);
+                    float t = (theta >= 0 ? 1.0f : -1.0f) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+                    float c = 1 / std::sqrt(t * t + 1);
+                    float s = t * c;
+                    glm::mat3 rotation(1);
+                    rotation[p][p] = c;
+                    rotation[q][q] = c;
+                    rotation[q][p] = s;
+                    rotation[p][q] = -s;
+                    a = glm::transpose(rotation) * a * rotation;
+                    vectors = vectors * rotation;
+                }
+            }
+            values = {a[0][0], a[1][1], a[2][2]};
+        }
+
+        /* Vertex of a cell, if it has one, among the chunks of the current and the previous layer. */
+        [[nodiscard]] static std::optional<Vertex> vertexOf(const glm::ivec3 &cell, const std::vector<Chunk> &current,
+                                                            const std::vector<Chunk> &previous) {
+            if (glm::any(glm::lessThan(cell, glm::ivec3(0)))) {
+                return std::nullopt;
+            }
+            glm::ivec3 coordinates = cell / ChunkSize;
+            const auto &layer = !current.empty() && current.front().coordinates.z == coordinates.z ? current : previous;
+            auto chunk = std::lower_bound(layer.begin(), layer.end(), coordinates, [](const Chunk &c, const glm::ivec3 &v) {
+                return std::tie(c.coordinates.z, c.coordinates.y, c.coordinates.x) < std::tie(v.z, v.y, v.x);
+            });
+            if (chunk == layer.end() || chunk->coordinates != coordinates) {
+                return std::nullopt;
+            }
+            glm::ivec3 l = cell - coordinates * ChunkSize;
+            auto index = static_cast<std::uint32_t>((l.z * ChunkSize + l.y) * ChunkSize + l.x);
+            auto found = std::lower_bound(chunk->cells.begin(), chunk->cells.end(), index);
+            if (found == chunk->cells.end() || *found != index) {
+                return std::nullopt;
+            }
+            auto offset = static_cast<std::size_t>(found - chunk->cells.begin());
+            return Vertex{chunk->first + static_cast<std::uint32_t>(offset), chunk->positions[offset]};
+        }
+
+        /* Two triangles for each crossed edge of a chunk, between the vertices of the cells around the edge. */
+        static void triangulate(Chunk &chunk, const std::vector<Chunk> &current, const std::vector<Chunk> &previous) {
+            for (auto &edge : chunk.edges) {
+                // Around the edge counterclockwise, seen from the upper end
+                glm::ivec3 b(0), c(0);
+                b[(edge.axis + 1) % 3] = 1;
+                c[(edge.axis + 2) % 3] = 1;
+                std::optional<Vertex> quad[4] = {
+                        vertexOf(edge.cell, current, previous), vertexOf(edge.cell - b, current, previous),
+                        vertexOf(edge.cell - b - c, current, previous), vertexOf(edge.cell - c, current, previous)};
+                if (!quad[0] || !quad[1] || !quad[2] || !quad[3]) {
+                    // Only if the SDF overestimated distances and a cell around the edge was culled
+                    continue;
+                }
+                // The outside is towards the upper end if the lower end is inside
+                if (!edge.inside) {
+                    std::swap(quad[1], quad[3]);
+                }
+                // Split along the shorter diagonal
+                if (glm::distance(quad[0]->position, quad[2]->position)
+                    <= glm::distance(quad[1]->position, quad[3]->position)) {
+                    chunk.triangles.emplace_back(quad[0]->index, quad[1]->index, quad[2]->index);
+                    chunk.triangles.emplace_back(quad[0]->index, quad[2]->index, quad[3]->index);
+                } else {
+                    chunk.triangles.emplace_back(quad[0]->index, quad[1]->index, quad[3]->index);
+                    chunk.triangles.emplace_back(quad[1]->index, quad[2]->index, quad[3]->index);
+                }
+            }
+        }
+    };
+
+    inline bool DualContouring::extract(Node &node, const AABB &bounds, MeshWriter &writer) {
+        stats = {};
+        if (!bounds.isFinite()) {
+            return false;
+        }
+        Tape tape = Tape::compile(node);
+        glm::vec3 size = bounds.max - bounds.min;
+        cellSize = std::max({size.x, size.y, size.z, std::numeric_limits<float>::min()}) / float(resolution);
+        // Corners on the border of the grid are outside the bounds, so the surface never leaves the grid
+        origin = bounds.min - 2 * cellSize;
+        glm::ivec3 cells = glm::ivec3(glm::ceil(size / cellSize)) + 4;
+        chunkCount = (cells + ChunkSize - 1) / ChunkSize;
+
+        std::vector<glm::ivec3> chunks = findChunks(tape);
+        stats.chunks = chunks.size();
+
+        std::vector<Chunk> previous, current;
+        std::uint32_t vertices = 0;
+        for (std::size_t begin = 0, end; begin < chunks.size(); begin = end) {
+            end = begin;
+            while (end < chunks.size() && chunks[end].z == chunks[begin].z) {
+                ++end;
+            }
+            current.assign(end - begin, {});
+            #pragma omp parallel for schedule(dynamic, 1)
+            for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(current.size()); ++i) {
+                current[i].coordinates = chunks[begin + i];
+                contour(tape, node, current[i]);
+            }
+
+            for (auto &chunk : current) {
+                chunk.first = vertices;
+                vertices += static_cast<std::uint32_t>(chunk.positions.size());
+                writer.writeVertices(chunk.positions, chunk.normals);
+            }
+            #pragma omp parallel for schedule(dynamic, 1)
+            for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(current.size()); ++i) {
+                triangulate(current[i], current, previous);
+            }
+            for (auto &chunk : current) {
+                writer.writeTriangles(chunk.triangles);
+                stats.cells += chunk.remaining;
+                stats.vertices += chunk.positions.size();
+                stats.triangles += chunk.triangles.size();
+                stats.evaluations += chunk.evaluations;
+            }
+            stats.peakChunks = std::max(stats.peakChunks, previous.size() + current.size());
+            std::swap(previous, current);
+        }
+        return writer.finish();
+    }
+}
+
+#endif //PROJECT_CONTOUR_H
@@ -0,0 +1,108 @@
+#ifndef PROJECT_DUAL_H
+#define PROJECT_DUAL_H
+
+#include <cmath>
+#include <glm/glm.hpp>
+
+/***
+ * Dual numbers for evaluating SDFs together with their gradient, by forward mode automatic differentiation.
+ * @details
+ * Every value carries its derivative with respect to the point the SDF is evaluated at, so a single evaluation yields
+ * both the distance and the normal. Functions that are not differentiable everywhere, like min and abs, take the
+ * derivative of the branch they select. The smooth operations mirror the ones in batch.h.
+ */
+namespace sdf::dual {
+
+    // Like simd::Float, default construction leaves the value uninitialized.
+    struct Float {
+        float value;
+        glm::vec3 gradient;
+
+        Float() = default;
+        /* Constant, not depending on the point. */
+        Float(float value) : value(value), gradient(0) {}
+        Float(float value, const glm::vec3 &gradient) : value(value), gradient(gradient) {}
+    };
+
+    struct Vec3 {
+        Float x, y, z;
+
+        Vec3() = default;
+        Vec3(const Float &x, const Float &y, const Float &z) : x(x), y(y), z(z) {}
+        /* Constant, not depending on the point. */
+        Vec3(const glm::vec3 &v) : x(v.x), y(v.y), z(v.z) {}
+
+        /* The point itself, which all derivatives are taken with respect to. */
+        static Vec3 variable(const glm::vec3 &p) {
+            return {{p.x, {1, 0, 0}}, {p.y, {0, 1, 0}}, {p.z, {0, 0, 1}}};
+        }
+
+        [[nodiscard]] glm::vec3 value() const {
+            return {x.value, y.value, z.value};
+        }
+    };
+
+    inline Float operator+(const Float &a, const Float &b) { return {a.value + b.value, a.gradient + b.gradient}; }
+    inline Float operator-(const Float &a, const Float &b) { return {a.value - b.value, a.gradient - b.gradient}; }
+    inline Float operator-(const Float &a) { return {-a.value, -a.gradient}; }
+
+    inline Float operator*(const Float &a, const Float &b) {
+        return {a.value * b.value, a.gradient * b.value + b.gradient * a.value};
+    }
+
+    inline Float operator/(const Float &a, const Float &b) {
+        return {a.value / b.value, (a.gradient * b.value - b.gradient * a.value) / (b.value * b.value)};
+    }
+
+    // The derivative of the square root is unbounded at zero, where the gradient is taken to vanish instead.
+    inline Float sqrt(const Float &a) {
+        float s = std::sqrt(a.value);
+        return {s, s > 0 ? a.gradient * (0.5f / s) : glm::vec3(0)};
+    }
+
+    inline Float abs(const Float &a) { return a.value < 0 ? -a : a; }
+    inline Float min(const Float &a, const Float &b) { return b.value < a.value ? b : a; }
+    inline Float max(const Float &a, const Float &b) { return b.value > a.value ? b : a; }
+    inline float sign(const Float &a) { return a.value > 0 ? 1.0f : a.value < 0 ? -1.0f : 0.0f; }
+
+    inline Float clamp(const Float &a, float lo, float hi) {
+        return a.value < lo ? Float(lo) : a.value > hi ? Float(hi) : a;
+    }
+
+    inline Float mix(const Float &a, const Float &b, const Float &t) { return a + (b - a) * t; }
+
+    inline Vec3 operator+(const Vec3 &a, const Vec3 &b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+    inline Vec3 operator-(const Vec3 &a, const Vec3 &b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+    inline Vec3 operator*(const glm::vec3 &a, const Float &b) { return {b * a.x, b * a.y, b * a.z}; }
+    inline Vec3 operator*(const Vec3 &a, const Float &b) { return {a.x * b, a.y * b, a.z * b}; }
+
+    // Component wise product with a constant vector.
+    inline Vec3 mul(const glm::vec3 &a, const Vec3 &b) { return {b.x * a.x, b.y * a.y, b.z * a.z}; }
+
+    inline Float dot(const Vec3 &a, const Vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline Float dot(const glm::vec3 &a, const Vec3 &b) { return b.x * a.x + b.y * a.y + b.z * a.z; }
+    inline Float length(const Vec3 &a) { return sqrt(dot(a, a)); }
+    inline Vec3 abs(const Vec3 &a) { return {abs(a.x), abs(a.y), abs(a.z)}; }
+    inline Vec3 max(const Vec3 &a, float b) { return {max(a.x, b), max(a.y, b), max(a.z, b)}; }
+    inline glm::vec3 sign(const Vec3 &a) { return {sign(a.x), sign(a.y), sign(a.z)}; }
+    inline Float maxComponent(const Vec3 &a) { return max(a.x, max(a.y, a.z)); }
+
+    // ops::sminN with n = 3.
+    inline Float smoothUnion(const Float &a, const Float &b, float k) {
+        Float h = max(Float(k) - abs(a - b), 0.0f) / k;
+        Float m = h * h * h * 0.5f;
+        return min(a, b) - m * (k / 3.0f);
+    }
+
+    inline Float smoothDifference(const Float &a, const Float &b, float k) {
+        Float h = clamp(Float(0.5f) - (a + b) * (0.5f / k), 0.0f, 1.0f);
+        return mix(a, -b, h) + h * (Float(1.0f) - h) * k;
+    }
+
+    inline Float smoothIntersection(const Float &a, const Float &b, float k) {
+        Float h = clamp(Float(0.5f) - (a - b) * (0.5f / k), 0.0f, 1.0f);
+        return mix(a, b, h) + h * (Float(1.0f) - h) * k;
+    }
+}
+
+#endif //PROJECT_DUAL_H
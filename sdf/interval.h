@@ -0,0 +1,91 @@
+#ifndef PROJECT_INTERVAL_H
+#define PROJECT_INTERVAL_H
+
+#include <cmath>
+#include <limits>
+#include <glm/glm.hpp>
+#include "bounds.h"
+
+/***
+ * Interval arithmetic for bounding SDFs over a box of points at once.
+ * @details
+ * Every value is a range that contains all values the exact computation can take for points in the box. Ranges of
+ * functions that are monotonic in each argument are exact, others may be wider than needed. Rounding is not directed,
+ * so bounds may be off by a few ulps, which callers comparing them allow for. The smooth operations and primitives
+ * have their ranges in specialize.h, next to the tape instructions they bound.
+ */
+namespace sdf::interval {
+
+    // Like simd::Float, default construction leaves the range uninitialized.
+    struct Float {
+        float lo, hi;
+
+        Float() = default;
+        /* Constant, a single value. */
+        Float(float value) : lo(value), hi(value) {}
+        Float(float lo, float hi) : lo(lo), hi(hi) {}
+
+        /* Any value, for what cannot be bounded. */
+        static Float unbounded() {
+            constexpr float inf = std::numeric_limits<float>::infinity();
+            return {-inf, inf};
+        }
+    };
+
+    struct Vec3 {
+        Float x, y, z;
+
+        Vec3() = default;
+        Vec3(const Float &x, const Float &y, const Float &z) : x(x), y(y), z(z) {}
+        /* All points of a box. */
+        explicit Vec3(const AABB &box) : x(box.min.x, box.max.x), y(box.min.y, box.max.y), z(box.min.z, box.max.z) {}
+
+        [[nodiscard]] glm::vec3 lo() const {
+            return {x.lo, y.lo, z.lo};
+        }
+
+        [[nodiscard]] glm::vec3 hi() const {
+            return {x.hi, y.hi, z.hi};
+        }
+
+        [[nodiscard]] AABB box() const {
+            return {lo(), hi()};
+        }
+    };
+
+    inline Float operator+(const Float &a, const Float &b) { return {a.lo + b.lo, a.hi + b.hi}; }
+    inline Float operator-(const Float &a, const Float &b) { return {a.lo - b.hi, a.hi - b.lo}; }
+    inline Float operator-(const Float &a) { return {-a.hi, -a.lo}; }
+
+    inline Float operator*(const Float &a, float b) {
+        return b < 0 ? Float(a.hi * b, a.lo * b) : Float(a.lo * b, a.hi * b);
+    }
+
+    inline Float sqrt(const Float &a) { return {std::sqrt(glm::max(a.lo, 0.0f)), std::sqrt(glm::max(a.hi, 0.0f))}; }
+
+    inline Float abs(const Float &a) {
+        if (a.lo >= 0) {
+            return a;
+        }
+        if (a.hi <= 0) {
+            return -a;
+        }
+        return {0.0f, glm::max(-a.lo, a.hi)};
+    }
+
+    inline Float square(const Float &a) {
+        Float b = abs(a);
+        return {b.lo * b.lo, b.hi * b.hi};
+    }
+
+    inline Float min(const Float &a, const Float &b) { return {glm::min(a.lo, b.lo), glm::min(a.hi, b.hi)}; }
+    inline Float max(const Float &a, const Float &b) { return {glm::max(a.lo, b.lo), glm::max(a.hi, b.hi)}; }
+
+    inline Vec3 abs(const Vec3 &a) { return {abs(a.x), abs(a.y), abs(a.z)}; }
+    inline Vec3 operator-(const Vec3 &a, const glm::vec3 &b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+    inline Float maxComponent(const Vec3 &a) { return max(a.x, max(a.y, a.z)); }
+    inline Float length(const Vec3 &a) { return sqrt(square(a.x) + square(a.y) + square(a.z)); }
+    inline Float dot(const glm::vec3 &a, const Vec3 &b) { return b.x * a.x + b.y * a.y + b.z * a.z; }
+}
+
+#endif //PROJECT_INTERVAL_H
@@ -0,0 +1,513 @@
+#ifndef PROJECT_MESH_H
+#define PROJECT_MESH_H
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace sdf {
+
+    /* Triangles of a mesh, as indices into a list of vertices shared between them. */
+    struct MeshData {
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::uvec3> triangles;
+    };
+
+    /**
+     * Exact signed distance to a closed triangle mesh, like one loaded from an OBJ or STL file.
+     * @details
+     * Triangles are stored as flat arrays in the order of the leaves of a BVH built with the surface area heuristic.
+     * A query finds the closest triangle, skipping nodes further than the closest triangle found so far. The sign
+     * comes from the angle weighted pseudo-normal of the closest feature, which is the face, an edge or a vertex of
+     * that triangle. It is exact for closed meshes and consistent near the surface of open ones.
+     */
+    class Mesh : public Primitive {
+    public:
+        // Triangles per leaf at most
+        static constexpr std::uint32_t LeafSize = 4;
+
+        explicit Mesh(const MeshData &data) {
+            build(data);
+        }
+
+        /* Read an OBJ or STL file, depending on its extension. Empty if it cannot be read. */
+        static std::optional<MeshData> load(const std::string &path) {
+            std::string extension = path.substr(std::min(path.size(), path.find_last_of('.')));
+            std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+                return static_cast<char>(std::tolower(c));
+            });
+            std::ifstream file(path, std::ios::binary);
+            if (!file) {
+                return std::nullopt;
+            }
+            if (extension == ".obj") {
+                return readOBJ(file);
+            }
+            if (extension == ".stl") {
+                return readSTL(file);
+            }
+            return std::nullopt;
+        }
+
+        /**
+         * Read the vertices and faces of a Wavefront OBJ file. Polygons are split into fans of triangles, everything
+         * but positions is ignored.
+         */
+        static std::optional<MeshData> readOBJ(std::istream &in) {
+            MeshData mesh;
+            std::string line;
+            std::vector<std::uint32_t> face;
+            while (std::getline(in, line)) {
+                std::istringstream tokens(line);
+                std::string type;
+                tokens >> type;
+                if (type == "v") {
+                    glm::vec3 v;
+                    if (!(tokens >> v.x >> v.y >> v.z)) {
+                        return std::nullopt;
+                    }
+                    mesh.vertices.push_back(v);
+                } else if (type == "f") {
+                    face.clear();
+                    for (std::string corner; tokens >> corner;) {
+                        // Corners are v, v/vt, v//vn or v/vt/vn, negative indices count from the last vertex
+                        long index = std::strtol(corner.c_str(), nullptr, 10);
+                        long count = static_cast<long>(mesh.vertices.size());
+                        index = index < 0 ? count + index : index - 1;
+                        if (index < 0 || index >= count) {
+                            return std::nullopt;
+                        }
+                        face.push_back(static_cast<std::uint32_t>(index));
+                    }
+                    for (std::size_t i = 2; i < face.size(); ++i) {
+                        mesh.triangles.emplace_back(face[0], face[i - 1], face[i]);
+                    }
+                }
+            }
+            return mesh;
+        }
+
+        /**
+         * Read a binary or ASCII STL file. Vertices at the same position are merged, as the mesh needs to know which
+         * triangles are neighbours.
+         */
+        static std::optional<MeshData> readSTL(std::istream &in) {
+            std::string bytes{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+            std::vector<glm::vec3> corners;
+
+            // Binary files have an 80 byte header, a count and 50 bytes per triangle. ASCII files may not start with
+            // "solid", but binary ones may, so the size tells them apart.
+            std::uint32_t count = 0;
+            if (bytes.size() >= 84) {
+                std::memcpy(&count, bytes.data() + 80, 4);
+            }
+            if (bytes.size() >= 84 && bytes.size() == 84 + 50 * static_cast<std::size_t>(count)) {
+                for (std::uint32_t i = 0; i < count; ++i) {
+                    // Normal, then three vertices
+                    const char *triangle = bytes.data() + 84 + 50 * static_cast<std::size_t>(i) + 12;
+                    for (int k = 0; k < 3; ++k) {
+                        float v[3];
+                        std::memcpy(v, triangle + 12 * k, 12);
+                        corners.emplace_back(v[0], v[1], v[2]);
+                    }
+                }
+            } else {
+                std::istringstream text(bytes);
+                for (std::string word; text >> word;) {
+                    if (word == "vertex") {
+                        glm::vec3 v;
+                        if (!(text >> v.x >> v.y >> v.z)) {
+                            return std::nullopt;
+                        }
+                        corners.push_back(v);
+                    }
+                }
+                if (corners.size() % 3 != 0) {
+                    return std::nullopt;
+                }
+            }
+
+            MeshData mesh;
+            std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> welded;
+            auto vertex = [&](const glm::vec3 &v) {
+                std::uint32_t bits[3];
+                std::memcpy(bits, &v, sizeof(bits));
+                std::uint64_t hash = bits[0] * 0x9e3779b97f4a7c15ull ^ bits[1] * 0xc2b2ae3d27d4eb4full ^ bits[2];
+                auto &candidates = welded[hash];
+                for (std::uint32_t i : candidates) {
+                    if (mesh.vertices[i] == v) {
+                        return i;
+                    }
+                }
+                candidates.push_back(static_cast<std::uint32_t>(mesh.vertices.size()));
+                mesh.vertices.push_back(v);
+                return candidates.back();
+            };
+            for (std::size_t i = 0; i < corners.size(); i += 3) {
+                std::uint32_t a = vertex(corners[i]);
+                std::uint32_t b = vertex(corners[i + 1]);
+                mesh.triangles.emplace_back(a, b, vertex(corners[i + 2]));
+            }
+            return mesh;
+        }
+
+        float signedDistance(const glm::vec3 &p) override {
+            // No triangle with area, so nothing to be close to
+            if (nodes.empty()) {
+                return std::numeric_limits<float>::infinity();
+            }
+            Closest c = closest(p);
+            return sign(p, c) * std::sqrt(c.distance2);
+        }
+
+        /* Exact gradient, pointing away from the closest point, or along its pseudo-normal on the surface. */
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            if (nodes.empty()) {
+                return std::numeric_limits<float>::infinity();
+            }
+            glm::vec3 x = p.value();
+            Closest c = closest(x);
+            float s = sign(x, c);
+            float d = std::sqrt(c.distance2);
+            glm::vec3 g = d > 1e-6f ? (x - c.point) * (s / d) : glm::normalize(pseudoNormal(c));
+            return {s * d, g.x * p.x.gradient + g.y * p.y.gradient + g.z * p.z.gradient};
+        }
+
+        AABB bounds() override {
+            return nodes.empty() ? AABB{} : nodes.front().box;
+        }
+
+        /* Vertices and triangles of the mesh, without the triangles that have no area. */
+        [[nodiscard]] MeshData getData() const {
+            return {vertices, triangleVertices};
+        }
+
+        [[nodiscard]] std::size_t getTriangleCount() const {
+            return ax.size();
+        }
+
+        [[nodiscard]] std::size_t getNodeCount() const {
+            return nodes.size();
+        }
+
+    private:
+        // Leaves have a count of triangles starting at `first`, inner nodes have their children at first and first + 1
+        struct BVHNode {
+            AABB box;
+            std::uint32_t first = 0;
+            std::uint32_t count = 0;
+        };
+
+        // Closest feature of a triangle to a point
+        enum Feature : std::uint8_t {
+            Face, VertexA, VertexB, VertexC, EdgeAB, EdgeBC, EdgeCA
+        };
+
+        struct Closest {
+            float distance2 = std::numeric_limits<float>::infinity();
+            glm::vec3 point{0};
+            std::uint32_t triangle = 0;
+            Feature feature = Face;
+        };
+
+        // Corner a and the edges from a to b and c of every triangle, in the order of the leaves
+        std::vector<float> ax, ay, az, abx, aby, abz, acx, acy, acz;
+        // Vertices and edges of every triangle, in the order of the leaves, indexing their pseudo-normals
+        std::vector<glm::uvec3> triangleVertices;
+        std::vector<glm::uvec3> triangleEdges;
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::vec3> vertexNormals;
+        std::vector<glm::vec3> edgeNormals;
+        std::vector<BVHNode> nodes;
+
+        static float distance2(const AABB &box, const glm::vec3 &p) {
+            glm::vec3 d = glm::max(glm::max(box.min - p, p - box.max), 0.0f);
+            return glm::dot(d, d);
+        }
+
+        static float area(const AABB &box) {
+            glm::vec3 e = box.max - box.min;
+            return box.isEmpty() ? 0.0f : e.x * e.y + e.y * e.z + e.z * e.x;
+        }
+
+        /* Closest point on a triangle, from Real-Time Collision Detection by Christer Ericson. */
+        static std::pair<glm::vec3, Feature> closestPoint(const glm::vec3 &p, const glm::vec3 &a,
+                                                          const glm::vec3 &ab, const glm::vec3 &ac) {
+            glm::vec3 ap = p - a;
+            float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+            if (d1 <= 0 && d2 <= 0) {
+                return {a, VertexA};
+            }
+            glm::vec3 bp = ap - ab;
+            float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+            if (d3 >= 0 && d4 <= d3) {
+                return {a + ab, VertexB};
+            }
+            float vc = d1 * d4 - d3 * d2;
+            if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+                return {a + ab * (d1 / (d1 - d3)), EdgeAB};
+            }
+            glm::vec3 cp = ap - ac;
+            float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+            if (d6 >= 0 && d5 <= d6) {
+                return {a + ac, VertexC};
+            }
+            float vb = d5 * d2 - d1 * d6;
+            if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+                return {a + ac * (d2 / (d2 - d6)), EdgeCA};
+            }
+            float va = d3 * d6 - d5 * d4;
+            if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+                return {a + ab + (ac - ab) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))), EdgeBC};
+            }
+            float denominator = 1.0f / (va + vb + vc);
+            return {a + ab * (vb * denominator) + ac * (vc * denominator), Face};
+        }
+
+        Closest closest(const glm::vec3 &p) const {
+            Closest best;
+            if (nodes.empty()) {
+                return best;
+            }
+            // Deep enough for the depth the build allows
+            std::uint32_t stack[128];
+            int top = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                const BVHNode &node = nodes[stack[--top]];
+                if (distance2(node.box, p) >= best.distance2) {
+                    continue;
+                }
+                if (node.count > 0) {
+                    for (std::uint32_t i = node.first; i < node.first + node.count; ++i) {
+                        auto [q, feature] = closestPoint(p, {ax[i], ay[i], az[i]}, {abx[i], aby[i], abz[i]},
+                                                         {acx[i], acy[i], acz[i]});
+                        glm::vec3 d = p - q;
+                        float d2 = glm::dot(d, d);
+                        if (d2 < best.distance2) {
+                            best = {d2, q, i, feature};
+                        }
+                    }
+                    continue;
+                }
+                // Visit the nearer child first
+                float left = distance2(nodes[node.first].box, p);
+                float right = distance2(nodes[node.first + 1].box, p);
+                if (left < right) {
+                    if (right < best.distance2) stack[top++] = node.first + 1;
+                    stack[top++] = node.first;
+                } else {
+                    if (left < best.distance2) stack[top++] = node.first;
+                    stack[top++] = node.first + 1;
+                }
+            }
+            return best;
+        }
+
+        [[nodiscard]] glm::vec3 pseudoNormal(const Closest &c) const {
+            const std::uint32_t i = c.triangle;
+            switch (c.feature) {
+                case VertexA:
+                    return vertexNormals[triangleVertices[i].x];
+                case VertexB:
+                    return vertexNormals[triangleVertices[i].y];
+                case VertexC:
+                    return vertexNormals[triangleVertices[i].z];
+                case EdgeAB:
+                    return edgeNormals[triangleEdges[i].x];
+                case EdgeBC:
+                    return edgeNormals[triangleEdges[i].y];
+                case EdgeCA:
+                    return edgeNormals[triangleEdges[i].z];
+                default:
+                    return glm::cross(glm::vec3{abx[i], aby[i], abz[i]}, glm::vec3{acx[i], acy[i], acz[i]});
+            }
+        }
+
+        [[nodiscard]] float sign(const glm::vec3 &p, const Closest &c) const {
+            return glm::dot(p - c.point, pseudoNormal(c)) >= 0 ? 1.0f : -1.0f;
+        }
+
+        void build(const MeshData &data) {
+            // Drop triangles without area, they have no normal to tell inside from outside
+            std::vector<glm::uvec3> triangles;
+            std::vector<glm::vec3> faceNormals;
+            for (const glm::uvec3 &t : data.triangles) {
+                glm::vec3 n = glm::cross(data.vertices[t.y] - data.vertices[t.x], data.vertices[t.z] - data.vertices[t.x]);
+                if (glm::dot(n, n) > 0) {
+                    triangles.push_back(t);
+                    faceNormals.push_back(glm::normalize(n));
+                }
+            }
+            const auto n = static_cast<std::uint32_t>(triangles.size());
+            if (n == 0) {
+                return;
+            }
+            vertices = data.vertices;
+
+            // Pseudo-normals: vertices weigh the normals of their triangles by the angle at the vertex, edges add the
+            // normals of the triangles on both sides
+            vertexNormals.assign(data.vertices.size(), glm::vec3{0});
+            std::unordered_map<std::uint64_t, std::uint32_t> edgeIndex;
+            std::vector<glm::uvec3> edges(n);
+            for (std::uint32_t i = 0; i < n; ++i) {
+                const glm::uvec3 &t = triangles[i];
+                for (int k = 0; k < 3; ++k) {
+                    std::uint32_t v = t[k], next = t[(k + 1) % 3], previous = t[(k + 2) % 3];
+                    glm::vec3 e0 = glm::normalize(data.vertices[next] - data.vertices[v]);
+                    glm::vec3 e1 = glm::normalize(data.vertices[previous] - data.vertices[v]);
+                    vertexNormals[v] += std::acos(glm::clamp(glm::dot(e0, e1), -1.0f, 1.0f)) * faceNormals[i];
+
+                    std::uint64_t key = static_cast<std::uint64_t>(std::min(v, next)) << 32 | std::max(v, next);
+                    auto [it, added] = edgeIndex.try_emplace(key, static_cast<std::uint32_t>(edgeNormals.size()));
+                    if (added) {
+                        edgeNormals.emplace_back(0);
+                    }
+                    edgeNormals[it->second] += faceNormals[i];
+                    edges[i][k] = it->second;
+                }
+            }
+
+            std::vector<AABB> boxes(n);
+            std::vector<glm::vec3> centroids(n);
+            for (std::uint32_t i = 0; i < n; ++i) {
+                const glm::uvec3 &t = triangles[i];
+                const glm::vec3 &a = data.vertices[t.x], &b = data.vertices[t.y], &c = data.vertices[t.z];
+                boxes[i] = {glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c))};
+                centroids[i] = boxes[i].center();
+            }
+
+            std::vector<std::uint32_t> order(n);
+            for (std::uint32_t i = 0; i < n; ++i) {
+                order[i] = i;
+            }
+            nodes.resize(2 * static_cast<std::size_t>(n) - 1);
+            std::atomic<std::uint32_t> used = 1;
+            #pragma omp parallel
+            #pragma omp single
+            buildNode(0, 0, n, 0, order, boxes, centroids, used);
+            nodes.resize(used);
+
+            // Store the triangles in the order of the leaves
+            for (auto *array : {&ax, &ay, &az, &abx, &aby, &abz, &acx, &acy, &acz}) {
+                array->resize(n);
+            }
+            triangleVertices.resize(n);
+            triangleEdges.resize(n);
+            for (std::uint32_t i = 0; i < n; ++i) {
+                const glm::uvec3 &t = triangles[order[i]];
+                glm::vec3 a = data.vertices[t.x];
+                glm::vec3 ab = data.vertices[t.y] - a, ac = data.vertices[t.z] - a;
+                ax[i] = a.x, ay[i] = a.y, az[i] = a.z;
+                abx[i] = ab.x, aby[i] = ab.y, abz[i] = ab.z;
+                acx[i] = ac.x, acy[i] = ac.y, acz[i] = ac.z;
+                triangleVertices[i] = t;
+                triangleEdges[i] = edges[order[i]];
+            }
+        }
+
+        /**
+         * Build the subtree of a node over triangles [begin, end) of `order`, reordering them so each leaf covers a
+         * range. Splits with the surface area heuristic over binned centroids, in parallel tasks for large subtrees.
+         */
+        void buildNode(std::uint32_t index, std::uint32_t begin, std::uint32_t end, int depth,
+                       std::vector<std::uint32_t> &order, const std::vector<AABB> &boxes,
+                       const std::vector<glm::vec3> &centroids, std::atomic<std::uint32_t> &used) {
+            constexpr int Bins = 16;
+            // Depth after which nodes are split at the median, which bounds the depth of the tree
+            constexpr int MaxSAHDepth = 64;
+
+            AABB box, centroidBox;
+            for (std::uint32_t i = begin; i < end; ++i) {
+                box = box.merge(boxes[order[i]]);
+                centroidBox = centroidBox.merge({centroids[order[i]], centroids[order[i]]});
+            }
+            BVHNode &node = nodes[index];
+            node.box = box;
+            const std::uint32_t count = end - begin;
+            if (count <= LeafSize) {
+                node.first = begin;
+                node.count = count;
+                return;
+            }
+
+            glm::vec3 extent = centroidBox.max - centroidBox.min;
+            int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+            std::uint32_t middle = begin;
+            if (extent[axis] > 0 && depth < MaxSAHDepth) {
+                float scale = Bins / extent[axis];
+                auto bin = [&](std::uint32_t triangle) {
+                    int b = static_cast<int>((centroids[triangle][axis] - centroidBox.min[axis]) * scale);
+                    return std::min(b, Bins - 1);
+                };
+                AABB binBoxes[Bins];
+                std::uint32_t binCounts[Bins] = {};
+                for (std::uint32_t i = begin; i < end; ++i) {
+                    int b = bin(order[i]);
+                    binBoxes[b] = binBoxes[b].merge(boxes[order[i]]);
+                    ++binCounts[b];
+                }
+                // Cost of splitting after each bin, sweeping from the right and then from the left
+                float rightCost[Bins];
+                AABB sweep;
+                std::uint32_t sweepCount = 0;
+                for (int b = Bins - 1; b > 0; --b) {
+                    sweep = sweep.merge(binBoxes[b]);
+                    sweepCount += binCounts[b];
+                    rightCost[b - 1] = area(sweep) * static_cast<float>(sweepCount);
+                }
+                sweep = {};
+                sweepCount = 0;
+                float bestCost = std::numeric_limits<float>::infinity();
+                int bestSplit = -1;
+                for (int b = 0; b < Bins - 1; ++b) {
+                    sweep = sweep.merge(binBoxes[b]);
+                    sweepCount += binCounts[b];
+                    float cost = area(sweep) * static_cast<float>(sweepCount) + rightCost[b];
+                    if (sweepCount > 0 && sweepCount < count && cost < bestCost) {
+                        bestCost = cost;
+                        bestSplit = b;
+                    }
+                }
+                if (bestSplit >= 0) {
+                    middle = static_cast<std::uint32_t>(std::partition(order.begin() + begin, order.begin() + end,
+                                                                       [&](std::uint32_t t) {
+                                                                           return bin(t) <= bestSplit;
+                                                                       }) - order.begin());
+                }
+            }
+            if (middle == begin || middle == end) {
+                middle = begin + count / 2;
+                std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                                 [&](std::uint32_t a, std::uint32_t b) {
+                                     return centroids[a][axis] < centroids[b][axis];
+                                 });
+            }
+
+            std::uint32_t left = used.fetch_add(2);
+            node.first = left;
+            node.count = 0;
+            // Only large subtrees are worth a task of their own
+            #pragma omp task if (count > 4096) default(shared)
+            buildNode(left, begin, middle, depth + 1, order, boxes, centroids, used);
+            buildNode(left + 1, middle, end, depth + 1, order, boxes, centroids, used);
+            #pragma omp taskwait
+        }
+    };
+}
+
+#endif //PROJECT_MESH_H
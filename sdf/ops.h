@@ -21,14 +21,21 @@ namespace sdf::ops {
         [[nodiscard]] std::shared_ptr<Node> getChild() const {
             return node;
         }
+
+        void bindMaterials(MaterialTable &table) override {
+            node->bindMaterials(table);
+        }
     };
 
-    // Base class for Binary operations on Signed Distance Functions
+    // Base class for Binary operations on Signed Distance Functions, optionally blending both operands smoothly
     class BinaryOp : public Node {
     protected:
         const std::shared_ptr<Node> a, b;
+        bool smooth;
+        float k;
     public:
-        BinaryOp(std::shared_ptr<Node> a, std::shared_ptr<Node> b) : a(std::move(a)), b(std::move(b)) {}
+        BinaryOp(std::shared_ptr<Node> a, std::shared_ptr<Node> b, bool smooth, float k)
+                : a(std::move(a)), b(std::move(b)), smooth(smooth), k(k) {}
 
         [[nodiscard]] std::shared_ptr<Node> getLeftChild() const {
             return a;
@@ -37,23 +44,32 @@ namespace sdf::ops {
         [[nodiscard]] std::shared_ptr<Node> getRightChild() const {
             return b;
         }
+
+        void bindMaterials(MaterialTable &table) override {
+            a->bindMaterials(table);
+            b->bindMaterials(table);
+        }
+
+        [[nodiscard]] bool isSmooth() const {
+            return smooth;
+        }
+
+        [[nodiscard]] float getSmoothness() const {
+            return k;
+        }
     };
 
     // Smooth minimum function with mix factor. As described here: https://iquilezles.org/www/articles/smin/smin.htm
     std::pair<float, float> sminN(float a, float b, float k, float n) {
-        float h = glm::max(k - abs(a - b), 0.0f) / k;
+        float h = glm::max(k - glm::abs(a - b), 0.0f) / k;
         float m = glm::pow(h, n) * 0.5f;
         float s = m * k / n;
         return (a < b) ? std::make_pair(a - s, m) : std::make_pair(b - s, m - 1.0f);
     }
-
     class Union final : public BinaryOp {
-    private:
-        bool smooth;
-        float k;
     public:
         Union(std::shared_ptr<Node> a, std::shared_ptr<Node> b, bool smooth = false, float k = 0.1f)
-                : BinaryOp(std::move(a), std::move(b)), smooth(smooth), k(k) {}
+                : BinaryOp(std::move(a), std::move(b), smooth, k) {}
 
         Sample sampleAt(const glm::vec3 &p) override {
             Sample s1 = a->sampleAt(p);
@@ -69,7 +85,7 @@ namespace sdf::ops {
 
                 float h = glm::clamp(0.5f + 0.5f * (d2 - d1) / k, 0.0f, 1.0f);
                 sample.value = s;
-                sample.material = Material::mix(s2.material, s1.material, h);
+                sample.materials = MaterialBlend::mix(s2.materials, s1.materials, h);
                 return sample;
             }
             if (d1 < d2) {
@@ -90,15 +106,146 @@ namespace sdf::ops {
 
             return glm::min(d1, d2);
         }
+
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            dual::Float d1 = a->dualDistance(p);
+            dual::Float d2 = b->dualDistance(p);
+
+            if (smooth) {
+                return dual::smoothUnion(d1, d2, k);
+            }
+
+            return dual::min(d1, d2);
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override {
+            std::uint32_t d1 = builder.emit(*a, point);
+            std::uint32_t d2 = builder.emit(*b, point);
+            if (smooth) {
+                return builder.distance(OpCode::SmoothUnion, d1, d2, {k});
+            }
+            return builder.distance(OpCode::Union, d1, d2);
+        }
+
+        AABB bounds() override {
+            AABB box = a->bounds().merge(b->bounds());
+            // sminN with n = 3 lowers the distance by at most k / 6
+            return smooth ? box.expand(k / 6.0f) : box;
+        }
     };
 
-    class Difference final : public BinaryOp {
+    /**
+     * Union of any number of children, optionally blended smoothly.
+     * @details
+     * The children are organised in a BVH over their bounds and visited nearest first, skipping every child whose
+     * bounds show it cannot lower the distance found so far. Smooth unions blend the children in order of increasing
+     * distance, leaving out those at least `k` further away than the nearest one, which would not contribute anyway.
+     */
+    class UnionN final : public Node {
+    public:
+        // Hard unions of fewer children are evaluated inline on tapes, as visiting the BVH costs more than it saves
+        static constexpr std::size_t MinGroupSize = 8;
+
     private:
+        std::vector<std::shared_ptr<Node>> children;
         bool smooth;
         float k;
+        BVH bvh;
+
+    public:
+        explicit UnionN(std::vector<std::shared_ptr<Node>> children, bool smooth = false, float k = 0.1f)
+                : children(std::move(children)), smooth(smooth), k(k) {
+            std::vector<AABB> bounds;
+            for (auto &child : this->children) {
+                bounds.push_back(child->bounds());
+            }
+            bvh = BVH(bounds);
+        }
+
+        Sample sampleAt(const glm::vec3 &p) override {
+            std::vector<Sample> samples;
+            float min = visitUnion(bvh, smooth ? k : 0.0f, p, [&](int child) {
+                samples.push_back(children[child]->sampleAt(p));
+                return samples.back().value;
+            });
+            if (samples.empty()) {
+                return {};
+            }
+            if (!smooth) {
+                return *std::find_if(samples.begin(), samples.end(), [&](const Sample &s) { return s.value == min; });
+            }
+
+            // Same blend as ops::blendSorted, mixing materials like Union
+            std::sort(samples.begin(), samples.end(), [](const Sample &a, const Sample &b) { return a.value < b.value; });
+            Sample sample = samples.front();
+            for (std::size_t i = 1; i < samples.size() && samples[i].value < samples.front().value + k; ++i) {
+                const Sample &s = samples[i];
+                float h = glm::clamp(0.5f + 0.5f * (s.value - sample.value) / k, 0.0f, 1.0f);
+                sample.value = sminN(sample.value, s.value, k, 3).first;
+                sample.materials = MaterialBlend::mix(s.materials, sample.materials, h);
+            }
+            return sample;
+        }
+
+        float signedDistance(const glm::vec3 &p) override {
+            return unionN(bvh, smooth, k, p, [&](int child) {
+                return children[child]->signedDistance(p);
+            });
+        }
+
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            glm::vec3 x = p.value();
+            return unionN(bvh, smooth, k, p, [&](int child) {
+                return children[child]->signedDistance(x);
+            }, [&](int child) {
+                return children[child]->dualDistance(p);
+            });
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override {
+            if (smooth || children.size() >= MinGroupSize) {
+                return builder.group(children, bvh, smooth, k, point);
+            }
+            // The minimum does not depend on the order, so small hard unions are lowered inline
+            std::uint32_t d = builder.emit(*children.front(), point);
+            for (std::size_t i = 1; i < children.size(); ++i) {
+                d = builder.distance(OpCode::Union, d, builder.emit(*children[i], point));
+            }
+            return d;
+        }
+
+        AABB bounds() override {
+            AABB box = bvh.bounds();
+            // Every blend lowers the distance by at most k / 6, see Union
+            if (smooth && children.size() > 1) {
+                box = box.expand(k / 6.0f * static_cast<float>(children.size() - 1));
+            }
+            return box;
+        }
+
+        [[nodiscard]] const std::vector<std::shared_ptr<Node>> &getChildren() const {
+            return children;
+        }
+
+        void bindMaterials(MaterialTable &table) override {
+            for (auto &child : children) {
+                child->bindMaterials(table);
+            }
+        }
+
+        [[nodiscard]] bool isSmooth() const {
+            return smooth;
+        }
+
+        [[nodiscard]] float getSmoothness() const {
+            return k;
+        }
+    };
+
+    class Difference final : public BinaryOp {
     public:
         Difference(std::shared_ptr<Node> a, std::shared_ptr<Node> b, bool smooth = false, float k = 1)
-                : BinaryOp(std::move(a), std::move(b)), smooth(smooth), k(k) {}
+                : BinaryOp(std::move(a), std::move(b), smooth, k) {}
 
         [[nodiscard]] Sample sampleAt(const glm::vec3 &p) override {
             Sample sample;
@@ -112,14 +259,14 @@ namespace sdf::ops {
             if (smooth) {
                 float h = glm::clamp(0.5f - 0.5f * (d2 + d1) / k, 0.0f, 1.0f);
                 sample.value = glm::mix(d2, -d1, h) + k * h * (1.0f - h);
-                sample.material = Material::mix(s2.material, s1.material, h);
+                sample.materials = MaterialBlend::mix(s2.materials, s1.materials, h);
             } else {
                 if (-d1 > d2) {
                     sample.value = -d1;
-                    sample.material = s1.material;
+                    sample.materials = s1.materials;
                 } else {
                     sample.value = d2;
-                    sample.material = s1.material;
+                    sample.materials = s1.materials;
                 }
             }
             return sample;
@@ -135,15 +282,35 @@ namespace sdf::ops {
                 return glm::max(-d1, d2);
             }
         }
+
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            dual::Float d1 = b->dualDistance(p);
+            dual::Float d2 = a->dualDistance(p);
+            if (smooth) {
+                return dual::smoothDifference(d2, d1, k);
+            }
+            return dual::max(-d1, d2);
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override {
+            std::uint32_t d1 = builder.emit(*a, point);
+            std::uint32_t d2 = builder.emit(*b, point);
+            if (smooth) {
+                return builder.distance(OpCode::SmoothDifference, d1, d2, {k});
+            }
+            return builder.distance(OpCode::Difference, d1, d2);
+        }
+
+        // The smooth maximum never lies below the hard one, so neither variant grows beyond the first operand.
+        AABB bounds() override {
+            return a->bounds();
+        }
     };
 
     class Intersection final : public BinaryOp {
-    private:
-        bool smooth;
-        float k;
     public:
         Intersection(std::shared_ptr<Node> a, std::shared_ptr<Node> b, bool smooth = false, float k = 1)
-                : BinaryOp(std::move(a), std::move(b)), smooth(smooth), k(k) {}
+                : BinaryOp(std::move(a), std::move(b), smooth, k) {}
 
         [[nodiscard]] Sample sampleAt(const glm::vec3 &p) override {
             Sample sample;
@@ -157,7 +324,7 @@ namespace sdf::ops {
             if (smooth) {
                 float h = glm::clamp(0.5f - 0.5f * (d2 - d1) / k, 0.0f, 1.0f);
                 sample.value = glm::mix(d2, d1, h) + k * h * (1.0f - h);
-                sample.material = Material::mix(s2.material, s1.material, h);
+                sample.materials = MaterialBlend::mix(s2.materials, s1.materials, h);
             } else {
                 if (d1 > d2) {
                     sample = s1;
@@ -179,6 +346,29 @@ namespace sdf::ops {
             }
             return glm::max(d1, d2);
         }
+
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            dual::Float d1 = b->dualDistance(p);
+            dual::Float d2 = a->dualDistance(p);
+
+            if (smooth) {
+                return dual::smoothIntersection(d2, d1, k);
+            }
+            return dual::max(d1, d2);
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override {
+            std::uint32_t d1 = builder.emit(*a, point);
+            std::uint32_t d2 = builder.emit(*b, point);
+            if (smooth) {
+                return builder.distance(OpCode::SmoothIntersection, d1, d2, {k});
+            }
+            return builder.distance(OpCode::Intersection, d1, d2);
+        }
+
+        AABB bounds() override {
+            return a->bounds().intersect(b->bounds());
+        }
     };
 
     class Transform final : public UnaryOp {
@@ -187,7 +377,9 @@ namespace sdf::ops {
                            const vec3 &translate = vec3(0, 0, 0),
                            const vec3 &rotate = vec3(0, 0, 0),
                            const vec3 &scale = vec3(1, 1, 1))
-                : UnaryOp(std::move(node)), scale(scale), transform(1) {
+                : UnaryOp(std::move(node)) {
+            mat4 transform(1);
+
             // Translation
             transform = glm::translate(transform, translate);
 
@@ -198,9 +390,20 @@ namespace sdf::ops {
             q *= glm::angleAxis(rotate.z, glm::yyx(axis));
             transform *= glm::mat4_cast(q);
 
-            // Scale performed separately
+            // Scale performed separately. Points are only ever mapped into the space of the child, so only the
+            // inverse is kept.
+            local = glm::inverse(transform) * glm::scale(vec3(1) / scale);
+            factor = 1.0f / glm::min(scale.x, glm::min(scale.y, scale.z));
         }
 
+        /**
+         * Construct a Transform directly from the affine map taking world space points into the space of the child.
+         * @param local World to local transformation
+         * @param factor Correction applied to distances of the child, at most the smallest scale of the inverse map
+         */
+        Transform(std::shared_ptr<Node> node, const mat4 &local, float factor)
+                : UnaryOp(std::move(node)), local(local), factor(factor) {}
+
         Sample sampleAt(const glm::vec3 &p) override {
             auto t = transformPoint(p);
             Sample sample = node->sampleAt(t);
@@ -214,17 +417,42 @@ namespace sdf::ops {
             return correctDistance(d);
         }
 
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            dual::Vec3 t = vec3(local[0]) * p.x + vec3(local[1]) * p.y + vec3(local[2]) * p.z + vec3(local[3]);
+            return node->dualDistance(t) * factor;
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override {
+            vec3 x = vec3(local[0]), y = vec3(local[1]), z = vec3(local[2]), t = vec3(local[3]);
+            std::uint32_t q = builder.point(OpCode::Transform, point, {
+                    x.x, x.y, x.z, y.x, y.y, y.z, z.x, z.y, z.z, t.x, t.y, t.z
+            });
+            std::uint32_t d = builder.emit(*node, q);
+            return builder.distance(OpCode::Scale, d, 0, {factor});
+        }
+
+        AABB bounds() override {
+            return node->bounds().transform(glm::inverse(local));
+        }
+
+        [[nodiscard]] const mat4 &getLocalTransform() const {
+            return local;
+        }
+
+        [[nodiscard]] float getDistanceFactor() const {
+            return factor;
+        }
+
     private:
-        mat4 transform;
-        vec3 scale;
+        mat4 local;
+        float factor;
 
         [[nodiscard]] vec3 transformPoint(const vec3 &point) const {
-            glm::vec3 transformed = vec3((glm::inverse(transform) * vec4(point / scale, 1)));
-            return transformed;
+            return vec3(local * vec4(point, 1));
         }
 
         [[nodiscard]] float correctDistance(float d) const {
-            return d / glm::min(scale.x, glm::min(scale.y, scale.z));
+            return d * factor;
         }
     };
 
@@ -247,13 +475,38 @@ namespace sdf::ops {
             float d = node->signedDistance(glm::sign(p) * glm::max(q, 0.0f));
             return d + glm::min(glm::max(q.x, glm::max(q.y, q.z)), 0.0f);
         }
+
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            dual::Vec3 q = dual::abs(p) - amount;
+            dual::Float d = node->dualDistance(dual::mul(dual::sign(p), dual::max(q, 0.0f)));
+            return d + dual::min(dual::maxComponent(q), 0.0f);
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override {
+            std::uint32_t q = builder.point(OpCode::Elongate, point, {amount.x, amount.y, amount.z});
+            std::uint32_t d = builder.emit(*node, q);
+            return builder.distance(OpCode::ElongateCorrect, d, point, {amount.x, amount.y, amount.z});
+        }
+
+        AABB bounds() override {
+            return node->bounds().expand(glm::abs(amount));
+        }
+
+        [[nodiscard]] const glm::vec3 &getAmount() const {
+            return amount;
+        }
     };
 
     class Round final : public UnaryOp {
     private:
         float radius;
+        bool subsumable;
     public:
-        explicit Round(std::shared_ptr<Node> node, float radius) : UnaryOp(std::move(node)), radius(radius) {}
+        /**
+         * @param subsumable Whether a smooth parent operation may absorb the rounding into its own smoothness
+         */
+        explicit Round(std::shared_ptr<Node> node, float radius, bool subsumable = true)
+                : UnaryOp(std::move(node)), radius(radius), subsumable(subsumable) {}
 
         [[nodiscard]] Sample sampleAt(const glm::vec3 &p) override {
             Sample sample = node->sampleAt(p);
@@ -266,9 +519,26 @@ namespace sdf::ops {
             return d - radius;
         }
 
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            return node->dualDistance(p) - radius;
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override {
+            std::uint32_t d = builder.emit(*node, point);
+            return builder.distance(OpCode::Round, d, 0, {radius});
+        }
+
+        AABB bounds() override {
+            return node->bounds().expand(radius);
+        }
+
         [[nodiscard]] float getRadius() const {
             return radius;
         }
+
+        [[nodiscard]] bool isSubsumable() const {
+            return subsumable;
+        }
     };
 
     class Onion final : public UnaryOp {
@@ -286,6 +556,23 @@ namespace sdf::ops {
             float d = node->signedDistance(p);
             return glm::abs(d) - thickness;
         }
+
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            return dual::abs(node->dualDistance(p)) - thickness;
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override {
+            std::uint32_t d = builder.emit(*node, point);
+            return builder.distance(OpCode::Onion, d, 0, {thickness});
+        }
+
+        AABB bounds() override {
+            return node->bounds().expand(thickness);
+        }
+
+        [[nodiscard]] float getThickness() const {
+            return thickness;
+        }
     };
 }
 
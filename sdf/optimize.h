@@ -0,0 +1,323 @@
+#ifndef PROJECT_OPTIMIZE_H
+#define PROJECT_OPTIMIZE_H
+
+#include <bit>
+#include <map>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+namespace sdf {
+
+    /* What an Optimizer did to the trees passed through it. */
+    struct OptimizeStats {
+        // Distinct nodes reachable from the trees before and after optimization
+        std::size_t nodesBefore = 0;
+        std::size_t nodesAfter = 0;
+
+        std::size_t transformsFolded = 0;
+        std::size_t emptiesRemoved = 0;
+        std::size_t roundsMerged = 0;
+        std::size_t duplicatesMerged = 0;
+    };
+
+    /**
+     * Simplifies CSG trees before they are compiled.
+     * @details
+     * Trees are rebuilt bottom-up, applying the following rewrites:
+     *  - Nested transforms are folded into a single affine map.
+     *  - Empty operands are removed, along with anything that becomes empty because of them.
+     *  - Rounding below a smooth operation is absorbed into the smoothness of that operation, like the operators in
+     *    utils.h do, unless it was built with operator%=.
+     *  - Structurally identical subtrees are shared, so the tape evaluates them once per point.
+     * All but the absorbed rounding are exact, up to float rounding. Absorbed rounding is not: the operand loses its
+     * offset and is blended over a wider band instead, which moves both the surface and the distances around it. The
+     * result is still a distance bound, so marching it stays safe.
+     * Node types the optimizer does not know are kept as they are. The same Optimizer should be used for all trees of a
+     * scene so duplicates are shared across objects, too.
+     */
+    class Optimizer {
+    public:
+        std::shared_ptr<Node> run(const std::shared_ptr<Node> &root) {
+            stats.nodesBefore += count(root, before);
+            auto result = rewrite(root);
+            stats.nodesAfter += count(result, after);
+            return result;
+        }
+
+        [[nodiscard]] const OptimizeStats &getStats() const {
+            return stats;
+        }
+
+    private:
+        using Key = std::vector<std::uint64_t>;
+
+        enum Kind : std::uint64_t {
+            EmptyKind, SphereKind, PlaneKind, TorusKind, BoxKind, TriangleKind,
+            UnionKind, DifferenceKind, IntersectionKind, UnionNKind,
+            TransformKind, ElongateKind, RoundKind, OnionKind
+        };
+
+        OptimizeStats stats;
+        // Rewritten form of every node visited so far, so shared subtrees are only rewritten once
+        std::map<const Node *, std::shared_ptr<Node>> rewritten;
+        // Canonical instance of every distinct node built so far
+        std::map<Key, std::shared_ptr<Node>> canonical;
+        std::unordered_set<const Node *> before, after;
+
+        static void push(Key &key, float f) {
+            key.push_back(std::bit_cast<std::uint32_t>(f));
+        }
+
+        static void push(Key &key, const glm::vec3 &v) {
+            push(key, v.x);
+            push(key, v.y);
+            push(key, v.z);
+        }
+
+        static void push(Key &key, const std::shared_ptr<Node> &node) {
+            key.push_back(reinterpret_cast<std::uintptr_t>(node.get()));
+        }
+
+        static void push(Key &key, const Material &m) {
+            push(key, m.albedo);
+            for (float f : {m.kd, m.ka, m.ks, m.p, m.ior, m.transmittance, m.absorption}) {
+                push(key, f);
+            }
+        }
+
+        static bool isEmpty(const std::shared_ptr<Node> &node) {
+            return dynamic_cast<const Empty *>(node.get()) != nullptr;
+        }
+
+        // Count distinct nodes of a tree that have not been counted yet.
+        static std::size_t count(const std::shared_ptr<Node> &node, std::unordered_set<const Node *> &seen) {
+            if (!seen.insert(node.get()).second) {
+                return 0;
+            }
+            std::size_t n = 1;
+            if (auto unary = std::dynamic_pointer_cast<ops::UnaryOp>(node)) {
+                n += count(unary->getChild(), seen);
+            } else if (auto binary = std::dynamic_pointer_cast<ops::BinaryOp>(node)) {
+                n += count(binary->getLeftChild(), seen);
+                n += count(binary->getRightChild(), seen);
+            } else if (auto group = std::dynamic_pointer_cast<ops::UnionN>(node)) {
+                for (auto &child : group->getChildren()) {
+                    n += count(child, seen);
+                }
+            }
+            return n;
+        }
+
+        // Return the existing node with the given key, or make one.
+        template<class Make>
+        std::shared_ptr<Node> intern(Key key, Make &&make) {
+            auto it = canonical.find(key);
+            if (it != canonical.end()) {
+                ++stats.duplicatesMerged;
+                return it->second;
+            }
+            std::shared_ptr<Node> node = make();
+            canonical.emplace(std::move(key), node);
+            return node;
+        }
+
+        std::shared_ptr<Node> empty() {
+            return intern({EmptyKind}, [] { return std::make_shared<Empty>(); });
+        }
+
+        std::shared_ptr<Node> rewrite(const std::shared_ptr<Node> &node) {
+            auto it = rewritten.find(node.get());
+            if (it != rewritten.end()) {
+                return it->second;
+            }
+            auto result = rewriteNode(node);
+            rewritten.emplace(node.get(), result);
+            return result;
+        }
+
+        std::shared_ptr<Node> rewriteNode(const std::shared_ptr<Node> &node) {
+            if (isEmpty(node)) {
+                return empty();
+            }
+            if (auto primitive = std::dynamic_pointer_cast<Primitive>(node)) {
+                return rewritePrimitive(primitive);
+            }
+            if (auto binary = std::dynamic_pointer_cast<ops::BinaryOp>(node)) {
+                return rewriteBinary(binary);
+            }
+            if (auto unary = std::dynamic_pointer_cast<ops::UnaryOp>(node)) {
+                return rewriteUnary(unary);
+            }
+            if (auto group = std::dynamic_pointer_cast<ops::UnionN>(node)) {
+                return rewriteUnionN(group);
+            }
+            return node;
+        }
+
+        std::shared_ptr<Node> rewritePrimitive(const std::shared_ptr<Primitive> &node) {
+            Key key;
+            if (auto sphere = std::dynamic_pointer_cast<Sphere>(node)) {
+                key = {SphereKind};
+                push(key, sphere->getRadius());
+            } else if (auto plane = std::dynamic_pointer_cast<Plane>(node)) {
+                key = {PlaneKind};
+                push(key, plane->getNormal());
+                push(key, plane->getHeight());
+            } else if (auto torus = std::dynamic_pointer_cast<Torus>(node)) {
+                key = {TorusKind};
+                push(key, torus->getRadii().x);
+                push(key, torus->getRadii().y);
+            } else if (auto box = std::dynamic_pointer_cast<Box>(node)) {
+                key = {BoxKind};
+                push(key, box->getDimensions());
+            } else if (auto triangle = std::dynamic_pointer_cast<Triangle>(node)) {
+                key = {TriangleKind};
+                for (int i = 0; i < 3; ++i) {
+                    push(key, triangle->getVertex(i));
+                }
+            } else {
+                return node;
+            }
+            push(key, node->getMaterial());
+            return intern(std::move(key), [&] { return node; });
+        }
+
+        std::shared_ptr<Node> rewriteBinary(const std::shared_ptr<ops::BinaryOp> &node) {
+            auto a = rewrite(node->getLeftChild());
+            auto b = rewrite(node->getRightChild());
+            bool smooth = node->isSmooth();
+            float k = node->getSmoothness();
+
+            bool isUnion = std::dynamic_pointer_cast<ops::Union>(node) != nullptr;
+            bool isDifference = std::dynamic_pointer_cast<ops::Difference>(node) != nullptr;
+            bool isIntersection = std::dynamic_pointer_cast<ops::Intersection>(node) != nullptr;
+            if (!isUnion && !isDifference && !isIntersection) {
+                return node;
+            }
+
+            if (isEmpty(a) || isEmpty(b)) {
+                ++stats.emptiesRemoved;
+                if (isUnion) {
+                    return isEmpty(a) ? b : a;
+                }
+                if (isDifference && !isEmpty(a)) {
+                    return a;
+                }
+                return empty();
+            }
+
+            if (smooth) {
+                for (auto *operand : {&a, &b}) {
+                    auto round = std::dynamic_pointer_cast<ops::Round>(*operand);
+                    if (round && round->isSubsumable()) {
+                        k += round->getRadius();
+                        *operand = round->getChild();
+                        ++stats.roundsMerged;
+                    }
+                }
+            }
+
+            Key key{isUnion ? UnionKind : isDifference ? DifferenceKind : IntersectionKind};
+            push(key, a);
+            push(key, b);
+            key.push_back(smooth);
+            push(key, k);
+            return intern(std::move(key), [&]() -> std::shared_ptr<Node> {
+                if (isUnion) {
+                    return std::make_shared<ops::Union>(a, b, smooth, k);
+                }
+                if (isDifference) {
+                    return std::make_shared<ops::Difference>(a, b, smooth, k);
+                }
+                return std::make_shared<ops::Intersection>(a, b, smooth, k);
+            });
+        }
+
+        std::shared_ptr<Node> rewriteUnionN(const std::shared_ptr<ops::UnionN> &node) {
+            std::vector<std::shared_ptr<Node>> children;
+            for (auto &child : node->getChildren()) {
+                auto rewrittenChild = rewrite(child);
+                if (isEmpty(rewrittenChild)) {
+                    ++stats.emptiesRemoved;
+                } else {
+                    children.push_back(rewrittenChild);
+                }
+            }
+            if (children.empty()) {
+                return empty();
+            }
+            // The union of a single child is that child, blended or not
+            if (children.size() == 1) {
+                return children.front();
+            }
+
+            Key key{UnionNKind};
+            key.push_back(node->isSmooth());
+            push(key, node->getSmoothness());
+            for (auto &child : children) {
+                push(key, child);
+            }
+            return intern(std::move(key), [&] {
+                return std::make_shared<ops::UnionN>(children, node->isSmooth(), node->getSmoothness());
+            });
+        }
+
+        std::shared_ptr<Node> rewriteUnary(const std::shared_ptr<ops::UnaryOp> &node) {
+            auto child = rewrite(node->getChild());
+            if (isEmpty(child)) {
+                ++stats.emptiesRemoved;
+                return empty();
+            }
+
+            if (auto transform = std::dynamic_pointer_cast<ops::Transform>(node)) {
+                glm::mat4 local = transform->getLocalTransform();
+                float factor = transform->getDistanceFactor();
+                // Points pass through this transform first, then through the one below it
+                if (auto inner = std::dynamic_pointer_cast<ops::Transform>(child)) {
+                    local = inner->getLocalTransform() * local;
+                    factor *= inner->getDistanceFactor();
+                    child = inner->getChild();
+                    ++stats.transformsFolded;
+                }
+                if (local == glm::mat4(1) && factor == 1.0f) {
+                    ++stats.transformsFolded;
+                    return child;
+                }
+                Key key{TransformKind};
+                for (int i = 0; i < 4; ++i) {
+                    push(key, glm::vec3(local[i]));
+                }
+                push(key, factor);
+                push(key, child);
+                return intern(std::move(key), [&] { return std::make_shared<ops::Transform>(child, local, factor); });
+            }
+            if (auto elongate = std::dynamic_pointer_cast<ops::Elongate>(node)) {
+                Key key{ElongateKind};
+                push(key, elongate->getAmount());
+                push(key, child);
+                return intern(std::move(key), [&] {
+                    return std::make_shared<ops::Elongate>(child, elongate->getAmount());
+                });
+            }
+            if (auto round = std::dynamic_pointer_cast<ops::Round>(node)) {
+                Key key{RoundKind};
+                push(key, round->getRadius());
+                key.push_back(round->isSubsumable());
+                push(key, child);
+                return intern(std::move(key), [&] {
+                    return std::make_shared<ops::Round>(child, round->getRadius(), round->isSubsumable());
+                });
+            }
+            if (auto onion = std::dynamic_pointer_cast<ops::Onion>(node)) {
+                Key key{OnionKind};
+                push(key, onion->getThickness());
+                push(key, child);
+                return intern(std::move(key), [&] { return std::make_shared<ops::Onion>(child, onion->getThickness()); });
+            }
+            return node;
+        }
+    };
+}
+
+#endif //PROJECT_OPTIMIZE_H
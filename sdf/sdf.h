@@ -3,8 +3,15 @@
 
 #pragma once
 #include "common.h"
+#include "tape.h"
 #include "shapes.h"
+#include "mesh.h"
 #include "ops.h"
+#include "optimize.h"
+#include "batch.h"
+#include "specialize.h"
+#include "brickmap.h"
+#include "contour.h"
 #include "utils.h"
 
 #endif //PROJECT_SDF_H
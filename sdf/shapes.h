@@ -11,16 +11,22 @@ namespace sdf {
     class Primitive : public Node {
     protected:
         Material mat;
+        // Index of mat in the material table of the scene
+        MaterialId id = 0;
     public:
         Primitive() = default;
 
         Sample sampleAt(const glm::vec3 &p) final {
             Sample sample;
             sample.value = signedDistance(p);
-            sample.material = mat;
+            sample.materials = MaterialBlend::of(id);
             return sample;
         }
 
+        void bindMaterials(MaterialTable &table) override {
+            id = table.add(mat);
+        }
+
         void setMaterial(const Material &material) {
             mat = material;
         }
@@ -28,6 +34,10 @@ namespace sdf {
         [[nodiscard]] Material getMaterial(const vec3 &p) const {
             return mat;
         }
+
+        [[nodiscard]] const Material &getMaterial() const {
+            return mat;
+        }
     };
 
     // Sphere SDF. Defined by a radius.
@@ -40,6 +50,22 @@ namespace sdf {
         float signedDistance(const glm::vec3 &p) override {
             return glm::length(p) - r;
         }
+
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            return dual::length(p) - r;
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override {
+            return builder.distance(OpCode::Sphere, point, 0, {r});
+        }
+
+        AABB bounds() override {
+            return {vec3{-r}, vec3{r}};
+        }
+
+        [[nodiscard]] float getRadius() const {
+            return r;
+        }
     };
 
     // Plane SDF. Defined by a normal vector and a height.
@@ -53,6 +79,39 @@ namespace sdf {
         float signedDistance(const glm::vec3 &p) override {
             return glm::dot(p, normal) + h;
         }
+
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            return dual::dot(normal, p) + h;
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override {
+            return builder.distance(OpCode::Plane, point, 0, {normal.x, normal.y, normal.z, h});
+        }
+
+        // Half space below the plane. Only axis aligned planes are bounded along their normal.
+        AABB bounds() override {
+            AABB box = AABB::infinite();
+            for (int i = 0; i < 3; ++i) {
+                if (normal[(i + 1) % 3] != 0 || normal[(i + 2) % 3] != 0 || normal[i] == 0) {
+                    continue;
+                }
+                float level = -h / normal[i];
+                if (normal[i] > 0) {
+                    box.max[i] = level;
+                } else {
+                    box.min[i] = level;
+                }
+            }
+            return box;
+        }
+
+        [[nodiscard]] const vec3 &getNormal() const {
+            return normal;
+        }
+
+        [[nodiscard]] float getHeight() const {
+            return h;
+        }
     };
 
     // Torus SDF. Defined by inner and outer radii.
@@ -66,6 +125,24 @@ namespace sdf {
             vec2 q = vec2(glm::length(glm::xz(p)) - r.x, p.y);
             return glm::length(q) - r.y;
         }
+
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            dual::Float qx = dual::sqrt(p.x * p.x + p.z * p.z) - r.x;
+            return dual::sqrt(qx * qx + p.y * p.y) - r.y;
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override {
+            return builder.distance(OpCode::Torus, point, 0, {r.x, r.y});
+        }
+
+        AABB bounds() override {
+            vec3 extent{r.x + r.y, r.y, r.x + r.y};
+            return {-extent, extent};
+        }
+
+        [[nodiscard]] const vec2 &getRadii() const {
+            return r;
+        }
     };
 
     // Closed Box SDF. Defined by extent from origin.
@@ -79,6 +156,23 @@ namespace sdf {
             glm::vec3 q = glm::abs(p) - dimensions;
             return glm::length(glm::max(q, 0.0f)) + glm::min(glm::max(q.x, glm::max(q.y, q.z)), 0.0f);
         }
+
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            dual::Vec3 q = dual::abs(p) - dimensions;
+            return dual::length(dual::max(q, 0.0f)) + dual::min(dual::maxComponent(q), 0.0f);
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override {
+            return builder.distance(OpCode::Box, point, 0, {dimensions.x, dimensions.y, dimensions.z});
+        }
+
+        AABB bounds() override {
+            return {-dimensions, dimensions};
+        }
+
+        [[nodiscard]] const glm::vec3 &getDimensions() const {
+            return dimensions;
+        }
     };
 
     // Triangle SDF. Defined by three vertices in world space.
@@ -128,6 +222,50 @@ namespace sdf {
 
             return val - 0.001f;
         }
+
+        dual::Float dualDistance(const dual::Vec3 &p) override {
+            dual::Vec3 p0 = p - v0;
+            dual::Vec3 p1 = p - v1;
+            dual::Vec3 p2 = p - v2;
+
+            dual::Float val;
+            if ((dual::sign(dual::dot(c0, p0)) +
+                 dual::sign(dual::dot(c1, p1)) +
+                 dual::sign(dual::dot(c2, p2))) < 2.0) {
+                val = dual::min(
+                        dual::min(
+                                dual::length(e0 * dual::clamp(dual::dot(e0, p0) * l0, 0.0f, 1.0f) - p0),
+                                dual::length(e1 * dual::clamp(dual::dot(e1, p1) * l1, 0.0f, 1.0f) - p1)
+                        ),
+                        dual::length(e2 * dual::clamp(dual::dot(e2, p2) * l2, 0.0f, 1.0f) - p2)
+                );
+
+            } else {
+                val = dual::dot(normal, p0) * dual::dot(normal, p0) * ln;
+                val = dual::sqrt(val);
+            }
+
+            return val - 0.001f;
+        }
+
+        std::uint32_t compile(TapeBuilder &builder, std::uint32_t point) override {
+            return builder.distance(OpCode::Triangle, point, 0, {
+                    v0.x, v0.y, v0.z, v1.x, v1.y, v1.z, v2.x, v2.y, v2.z,
+                    e0.x, e0.y, e0.z, e1.x, e1.y, e1.z, e2.x, e2.y, e2.z,
+                    c0.x, c0.y, c0.z, c1.x, c1.y, c1.z, c2.x, c2.y, c2.z,
+                    normal.x, normal.y, normal.z,
+                    l0, l1, l2, ln
+            });
+        }
+
+        AABB bounds() override {
+            AABB box{glm::min(v0, glm::min(v1, v2)), glm::max(v0, glm::max(v1, v2))};
+            return box.expand(0.001f);
+        }
+
+        [[nodiscard]] const glm::vec3 &getVertex(int i) const {
+            return i == 0 ? v0 : i == 1 ? v1 : v2;
+        }
     };
 }
 
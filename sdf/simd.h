@@ -0,0 +1,242 @@
+#ifndef PROJECT_SIMD_H
+#define PROJECT_SIMD_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(SDF_SIMD_SCALAR) && defined(__AVX2__)
+#define SDF_SIMD_AVX2
+#include <immintrin.h>
+#elif !defined(SDF_SIMD_SCALAR) && (defined(__SSE2__) || defined(_M_X64))
+#define SDF_SIMD_SSE
+#include <emmintrin.h>
+#endif
+
+/***
+ * Thin wrappers around SIMD registers, used to evaluate SDFs for several points at once and to quantize frames.
+ * @details
+ * Kernels are written once against simd::Float and simd::Vec3 and compile to AVX2 (8 lanes) or SSE2 (4 lanes)
+ * depending on the target, or to plain floats when neither is available or SDF_SIMD_SCALAR is defined.
+ */
+namespace sdf::simd {
+
+#if defined(SDF_SIMD_AVX2)
+
+    constexpr std::size_t Width = 8;
+
+    struct Mask {
+        __m256 v;
+    };
+
+    struct Float {
+        __m256 v;
+
+        Float() = default;
+        Float(__m256 v) : v(v) {}
+        Float(float f) : v(_mm256_set1_ps(f)) {}
+
+        static Float load(const float *p) { return _mm256_loadu_ps(p); }
+        void store(float *p) const { _mm256_storeu_ps(p, v); }
+    };
+
+    inline Float operator+(Float a, Float b) { return _mm256_add_ps(a.v, b.v); }
+    inline Float operator-(Float a, Float b) { return _mm256_sub_ps(a.v, b.v); }
+    inline Float operator*(Float a, Float b) { return _mm256_mul_ps(a.v, b.v); }
+    inline Float operator/(Float a, Float b) { return _mm256_div_ps(a.v, b.v); }
+    inline Float operator-(Float a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+    inline Float min(Float a, Float b) { return _mm256_min_ps(a.v, b.v); }
+    inline Float max(Float a, Float b) { return _mm256_max_ps(a.v, b.v); }
+    inline Float abs(Float a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+    inline Float sqrt(Float a) { return _mm256_sqrt_ps(a.v); }
+
+    inline Mask operator<(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+    inline Mask operator>(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)}; }
+    inline Mask operator<=(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+    inline Mask operator>=(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+    inline Mask operator&(Mask a, Mask b) { return {_mm256_and_ps(a.v, b.v)}; }
+    inline Mask operator|(Mask a, Mask b) { return {_mm256_or_ps(a.v, b.v)}; }
+    inline Mask operator~(Mask a) { return {_mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1)))}; }
+    inline bool any(Mask m) { return _mm256_movemask_ps(m.v) != 0; }
+    inline bool all(Mask m) { return _mm256_movemask_ps(m.v) == 0xFF; }
+    inline int bits(Mask m) { return _mm256_movemask_ps(m.v); }
+
+    // Lanes of `a` where the mask is set, `b` elsewhere.
+    inline Float select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+
+    struct Int {
+        __m256i v;
+
+        Int() = default;
+        Int(__m256i v) : v(v) {}
+        Int(std::uint32_t i) : v(_mm256_set1_epi32(static_cast<int>(i))) {}
+
+        void store(std::uint32_t *p) const { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v); }
+    };
+
+    // Rounds towards zero, like a cast.
+    inline Int truncate(Float a) { return _mm256_cvttps_epi32(a.v); }
+    inline Int operator<<(Int a, int n) { return _mm256_sll_epi32(a.v, _mm_cvtsi32_si128(n)); }
+    inline Int operator|(Int a, Int b) { return _mm256_or_si256(a.v, b.v); }
+
+#elif defined(SDF_SIMD_SSE)
+
+    constexpr std::size_t Width = 4;
+
+    struct Mask {
+        __m128 v;
+    };
+
+    struct Float {
+        __m128 v;
+
+        Float() = default;
+        Float(__m128 v) : v(v) {}
+        Float(float f) : v(_mm_set1_ps(f)) {}
+
+        static Float load(const float *p) { return _mm_loadu_ps(p); }
+        void store(float *p) const { _mm_storeu_ps(p, v); }
+    };
+
+    inline Float operator+(Float a, Float b) { return _mm_add_ps(a.v, b.v); }
+    inline Float operator-(Float a, Float b) { return _mm_sub_ps(a.v, b.v); }
+    inline Float operator*(Float a, Float b) { return _mm_mul_ps(a.v, b.v); }
+    inline Float operator/(Float a, Float b) { return _mm_div_ps(a.v, b.v); }
+    inline Float operator-(Float a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+    inline Float min(Float a, Float b) { return _mm_min_ps(a.v, b.v); }
+    inline Float max(Float a, Float b) { return _mm_max_ps(a.v, b.v); }
+    inline Float abs(Float a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+    inline Float sqrt(Float a) { return _mm_sqrt_ps(a.v); }
+
+    inline Mask operator<(Float a, Float b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+    inline Mask operator>(Float a, Float b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+    inline Mask operator<=(Float a, Float b) { return {_mm_cmple_ps(a.v, b.v)}; }
+    inline Mask operator>=(Float a, Float b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+    inline Mask operator&(Mask a, Mask b) { return {_mm_and_ps(a.v, b.v)}; }
+    inline Mask operator|(Mask a, Mask b) { return {_mm_or_ps(a.v, b.v)}; }
+    inline Mask operator~(Mask a) { return {_mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1)))}; }
+    inline bool any(Mask m) { return _mm_movemask_ps(m.v) != 0; }
+    inline bool all(Mask m) { return _mm_movemask_ps(m.v) == 0xF; }
+    inline int bits(Mask m) { return _mm_movemask_ps(m.v); }
+
+    // Lanes of `a` where the mask is set, `b` elsewhere.
+    inline Float select(Mask m, Float a, Float b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+
+    struct Int {
+        __m128i v;
+
+        Int() = default;
+        Int(__m128i v) : v(v) {}
+        Int(std::uint32_t i) : v(_mm_set1_epi32(static_cast<int>(i))) {}
+
+        void store(std::uint32_t *p) const { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+    };
+
+    // Rounds towards zero, like a cast.
+    inline Int truncate(Float a) { return _mm_cvttps_epi32(a.v); }
+    inline Int operator<<(Int a, int n) { return _mm_sll_epi32(a.v, _mm_cvtsi32_si128(n)); }
+    inline Int operator|(Int a, Int b) { return _mm_or_si128(a.v, b.v); }
+
+#else
+
+    constexpr std::size_t Width = 1;
+
+    struct Mask {
+        bool v;
+    };
+
+    struct Float {
+        float v;
+
+        Float() = default;
+        Float(float f) : v(f) {}
+
+        static Float load(const float *p) { return *p; }
+        void store(float *p) const { *p = v; }
+    };
+
+    inline Float operator+(Float a, Float b) { return a.v + b.v; }
+    inline Float operator-(Float a, Float b) { return a.v - b.v; }
+    inline Float operator*(Float a, Float b) { return a.v * b.v; }
+    inline Float operator/(Float a, Float b) { return a.v / b.v; }
+    inline Float operator-(Float a) { return -a.v; }
+    inline Float min(Float a, Float b) { return b.v < a.v ? b.v : a.v; }
+    inline Float max(Float a, Float b) { return a.v < b.v ? b.v : a.v; }
+    inline Float abs(Float a) { return std::fabs(a.v); }
+    inline Float sqrt(Float a) { return std::sqrt(a.v); }
+
+    inline Mask operator<(Float a, Float b) { return {a.v < b.v}; }
+    inline Mask operator>(Float a, Float b) { return {a.v > b.v}; }
+    inline Mask operator<=(Float a, Float b) { return {a.v <= b.v}; }
+    inline Mask operator>=(Float a, Float b) { return {a.v >= b.v}; }
+    inline Mask operator&(Mask a, Mask b) { return {a.v && b.v}; }
+    inline Mask operator|(Mask a, Mask b) { return {a.v || b.v}; }
+    inline Mask operator~(Mask a) { return {!a.v}; }
+    inline bool any(Mask m) { return m.v; }
+    inline bool all(Mask m) { return m.v; }
+    inline int bits(Mask m) { return m.v ? 1 : 0; }
+
+    // Lanes of `a` where the mask is set, `b` elsewhere.
+    inline Float select(Mask m, Float a, Float b) { return m.v ? a : b; }
+
+    struct Int {
+        std::uint32_t v;
+
+        Int() = default;
+        Int(std::uint32_t i) : v(i) {}
+
+        void store(std::uint32_t *p) const { *p = v; }
+    };
+
+    // Rounds towards zero, like a cast.
+    inline Int truncate(Float a) { return static_cast<std::uint32_t>(static_cast<std::int32_t>(a.v)); }
+    inline Int operator<<(Int a, int n) { return a.v << n; }
+    inline Int operator|(Int a, Int b) { return a.v | b.v; }
+
+#endif
+
+    inline Float clamp(Float x, Float lo, Float hi) { return min(max(x, lo), hi); }
+
+    // Smallest value of all lanes.
+    inline float reduceMin(Float a) {
+        float v[Width];
+        a.store(v);
+        float m = v[0];
+        for (std::size_t i = 1; i < Width; ++i) {
+            m = v[i] < m ? v[i] : m;
+        }
+        return m;
+    }
+
+    inline Float mix(Float a, Float b, Float t) { return a + (b - a) * t; }
+
+    // -1, 0 or 1 depending on the sign of each lane.
+    inline Float sign(Float a) {
+        return select(a > Float(0.0f), Float(1.0f), select(a < Float(0.0f), Float(-1.0f), Float(0.0f)));
+    }
+
+    /* Three component vector with one point per lane. */
+    struct Vec3 {
+        Float x, y, z;
+
+        static Vec3 load(const float *x, const float *y, const float *z) {
+            return {Float::load(x), Float::load(y), Float::load(z)};
+        }
+    };
+
+    inline Vec3 operator+(const Vec3 &a, const Vec3 &b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+    inline Vec3 operator-(const Vec3 &a, const Vec3 &b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+    inline Vec3 operator*(const Vec3 &a, Float s) { return {a.x * s, a.y * s, a.z * s}; }
+    inline Vec3 abs(const Vec3 &a) { return {abs(a.x), abs(a.y), abs(a.z)}; }
+    inline Vec3 sign(const Vec3 &a) { return {sign(a.x), sign(a.y), sign(a.z)}; }
+    inline Vec3 max(const Vec3 &a, Float b) { return {max(a.x, b), max(a.y, b), max(a.z, b)}; }
+    inline Vec3 mul(const Vec3 &a, const Vec3 &b) { return {a.x * b.x, a.y * b.y, a.z * b.z}; }
+    inline Float dot(const Vec3 &a, const Vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline Float length(const Vec3 &a) { return sqrt(dot(a, a)); }
+    inline Float maxComponent(const Vec3 &a) { return max(a.x, max(a.y, a.z)); }
+
+    // Broadcast a constant vector stored as three consecutive floats.
+    inline Vec3 broadcast(const float *k) { return {Float(k[0]), Float(k[1]), Float(k[2])}; }
+}
+
+#endif //PROJECT_SIMD_H
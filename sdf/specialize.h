@@ -0,0 +1,376 @@
+#ifndef PROJECT_SPECIALIZE_H
+#define PROJECT_SPECIALIZE_H
+
+#include <algorithm>
+#include "interval.h"
+
+/***
+ * Interval evaluation of tapes, and tapes specialized to a box.
+ * @details
+ * Every primitive and operation that can appear on a tape has a range here, mirroring the scalar implementation in
+ * shapes.h and ops.h. Nodes the tape calls back into are unbounded. Running a tape on the box tells, for every min and
+ * max like operation, whether one operand decides the result throughout the box. Specializing rebuilds the tape
+ * without the other operand and everything only it used, which for large CSG trees leaves the few nodes near the box.
+ */
+namespace sdf {
+
+    namespace interval {
+
+        inline Float sphere(const Vec3 &p, const float *k) {
+            return length(p) - Float(k[0]);
+        }
+
+        inline Float plane(const Vec3 &p, const float *k) {
+            return dot(glm::vec3(k[0], k[1], k[2]), p) + Float(k[3]);
+        }
+
+        inline Float torus(const Vec3 &p, const float *k) {
+            Float qx = sqrt(square(p.x) + square(p.z)) - Float(k[0]);
+            return sqrt(square(qx) + square(p.y)) - Float(k[1]);
+        }
+
+        // The distance grows with every coordinate of abs(p) - size, so it is lowest and highest at the ends
+        inline Float box(const Vec3 &p, const float *k) {
+            Vec3 q = abs(p) - glm::vec3(k[0], k[1], k[2]);
+            auto distance = [](const glm::vec3 &t) {
+                return glm::length(glm::max(t, 0.0f)) + glm::min(glm::max(t.x, glm::max(t.y, t.z)), 0.0f);
+            };
+            return {distance(q.lo()), distance(q.hi())};
+        }
+
+        // No nearer than the bounds of the vertices, and no further than the first vertex
+        inline Float triangle(const Vec3 &p, const float *k) {
+            glm::vec3 v0(k[0], k[1], k[2]), v1(k[3], k[4], k[5]), v2(k[6], k[7], k[8]);
+            AABB vertices{glm::min(v0, glm::min(v1, v2)), glm::max(v0, glm::max(v1, v2))};
+            AABB region = p.box();
+            glm::vec3 far = glm::max(glm::abs(region.min - v0), glm::abs(region.max - v0));
+            return {region.distance(vertices) - 0.001f, glm::length(far) - 0.001f};
+        }
+
+        inline Vec3 transform(const Vec3 &p, const float *k) {
+            return {p.x * k[0] + p.y * k[3] + p.z * k[6] + Float(k[9]),
+                    p.x * k[1] + p.y * k[4] + p.z * k[7] + Float(k[10]),
+                    p.x * k[2] + p.y * k[5] + p.z * k[8] + Float(k[11])};
+        }
+
+        // Coordinates move toward zero by the amount or stop at zero, which keeps their order
+        inline Vec3 elongate(const Vec3 &p, const float *k) {
+            auto shrink = [](const Float &x, float amount) {
+                auto f = [amount](float v) { return glm::sign(v) * glm::max(glm::abs(v) - amount, 0.0f); };
+                return Float(f(x.lo), f(x.hi));
+            };
+            return {shrink(p.x, k[0]), shrink(p.y, k[1]), shrink(p.z, k[2])};
+        }
+
+        inline Float elongateCorrect(const Float &d, const Vec3 &p, const float *k) {
+            Vec3 q = abs(p) - glm::vec3(k[0], k[1], k[2]);
+            return d + min(maxComponent(q), Float(0.0f));
+        }
+
+        // ops::sminN with n = 3 lowers the minimum by at most k / 6
+        inline Float smoothUnion(const Float &a, const Float &b, float k) {
+            Float m = min(a, b);
+            return {m.lo - k / 6.0f, m.hi};
+        }
+
+        // The smooth maximum of SmoothDifference and SmoothIntersection lies at most k / 4 above the hard one
+        inline Float smoothMax(const Float &a, const Float &b, float k) {
+            Float m = max(a, b);
+            return {m.lo, m.hi + k / 4.0f};
+        }
+
+        /* Whether `a` lies at least `gap` below `b` throughout, with some room for rounding of both. */
+        inline bool below(const Float &a, const Float &b, float gap = 0.0f) {
+            float slack = 1e-5f * (1.0f + glm::max(glm::abs(a.hi), glm::abs(b.lo)));
+            return a.hi + gap + slack <= b.lo;
+        }
+    }
+
+    /* What Tape::run on intervals found each instruction to depend on within the box. */
+    struct Tape::Pruning {
+        enum Keep : std::uint8_t {
+            Both,
+            // Only the first operand decides the result
+            A,
+            // Only the second operand decides the result, negated for differences
+            B
+        };
+        std::vector<Keep> keep;
+        // For group instructions, the box their point ranges over and the children that can affect them there
+        std::vector<AABB> regions;
+        std::vector<std::vector<int>> children;
+    };
+
+    /**
+     * Range of a group, visiting children nearest first and skipping those whose bounds show they cannot come within
+     * the blend width of the nearest one, like ops::visitUnion does for points.
+     * @param kept Receives the children that can affect the result, if given
+     */
+    interval::Float Tape::group(const Group &g, const interval::Vec3 &p, std::vector<int> *kept) const {
+        using namespace interval;
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        const float margin = g.smooth ? g.k : 0.0f;
+        const AABB region = p.box();
+
+        std::vector<std::pair<int, Float>> visited;
+        // Smallest upper bound of the children visited so far
+        float best = inf;
+        int nearest = -1;
+        g.bvh.traverse([&](const AABB &box) {
+            // Children are never nearer than their bounds, which tells something outside of them only
+            float gap = region.distance(box);
+            return gap > 0 && below(Float(best), Float(gap), margin) ? inf : gap;
+        }, [&](int child) {
+            Float range = g.children[child].run(p, nullptr);
+            // Outside of its bounds, a child is at least as far as they are
+            float gap = region.distance(g.bvh.bounds(child));
+            if (gap > 0) {
+                range.lo = glm::max(range.lo, gap);
+            }
+            visited.emplace_back(child, range);
+            if (range.hi < best || nearest < 0) {
+                best = range.hi;
+                nearest = child;
+            }
+        });
+        if (visited.empty()) {
+            return {inf, inf};
+        }
+
+        float lo = inf;
+        std::size_t count = 0;
+        for (const auto &[child, range] : visited) {
+            if (child == nearest || !below(Float(best), range, margin)) {
+                lo = glm::min(lo, range.lo);
+                ++count;
+                if (kept) {
+                    kept->push_back(child);
+                }
+            }
+        }
+        // Every blend lowers the distance by at most k / 6, see smoothUnion
+        if (g.smooth) {
+            lo -= g.k / 6.0f * static_cast<float>(count - 1);
+        }
+        return {lo, best};
+    }
+
+    /**
+     * Evaluate the tape on ranges of points, like the scalar run.
+     * @param pruning Receives which operands decide the result of each instruction, if given
+     */
+    interval::Float Tape::run(const interval::Vec3 &p, Pruning *pruning) const {
+        using namespace interval;
+        using Keep = Pruning::Keep;
+
+        Float dStack[MaxStackRegisters];
+        Vec3 qStack[MaxStackRegisters];
+        std::vector<Float> dHeap;
+        std::vector<Vec3> qHeap;
+        Float *d = dStack;
+        Vec3 *q = qStack;
+        if (distanceRegisters > MaxStackRegisters || pointRegisters > MaxStackRegisters) {
+            dHeap.resize(distanceRegisters);
+            qHeap.resize(pointRegisters);
+            d = dHeap.data();
+            q = qHeap.data();
+        }
+        if (pruning) {
+            pruning->keep.assign(code.size(), Keep::Both);
+            pruning->regions.assign(code.size(), AABB{});
+            pruning->children.assign(code.size(), {});
+        }
+
+        const float *c = constants.data();
+        q[input] = p;
+
+        for (std::size_t i = 0; i < code.size(); ++i) {
+            const auto &ins = code[i];
+            const float *k = c + ins.param;
+            Keep keep = Keep::Both;
+            switch (ins.op) {
+                case OpCode::Constant:
+                    d[ins.out] = k[0];
+                    break;
+                case OpCode::Call:
+                    d[ins.out] = Float::unbounded();
+                    break;
+                case OpCode::Group:
+                    if (pruning) {
+                        pruning->regions[i] = q[ins.a].box();
+                    }
+                    d[ins.out] = group(groups[ins.b], q[ins.a], pruning ? &pruning->children[i] : nullptr);
+                    break;
+                case OpCode::Sphere:
+                    d[ins.out] = sphere(q[ins.a], k);
+                    break;
+                case OpCode::Plane:
+                    d[ins.out] = plane(q[ins.a], k);
+                    break;
+                case OpCode::Torus:
+                    d[ins.out] = torus(q[ins.a], k);
+                    break;
+                case OpCode::Box:
+                    d[ins.out] = box(q[ins.a], k);
+                    break;
+                case OpCode::Triangle:
+                    d[ins.out] = triangle(q[ins.a], k);
+                    break;
+                case OpCode::Transform:
+                    q[ins.out] = transform(q[ins.a], k);
+                    break;
+                case OpCode::Elongate:
+                    q[ins.out] = elongate(q[ins.a], k);
+                    break;
+                case OpCode::Scale:
+                    d[ins.out] = d[ins.a] * k[0];
+                    break;
+                case OpCode::ElongateCorrect:
+                    d[ins.out] = elongateCorrect(d[ins.a], q[ins.b], k);
+                    break;
+                case OpCode::Round:
+                    d[ins.out] = d[ins.a] - Float(k[0]);
+                    break;
+                case OpCode::Onion:
+                    d[ins.out] = abs(d[ins.a]) - Float(k[0]);
+                    break;
+                case OpCode::Union: {
+                    Float a = d[ins.a], b = d[ins.b];
+                    keep = below(a, b) ? Keep::A : below(b, a) ? Keep::B : Keep::Both;
+                    d[ins.out] = min(a, b);
+                    break;
+                }
+                case OpCode::SmoothUnion: {
+                    // Operands at least k apart are not blended
+                    Float a = d[ins.a], b = d[ins.b];
+                    keep = below(a, b, k[0]) ? Keep::A : below(b, a, k[0]) ? Keep::B : Keep::Both;
+                    d[ins.out] = smoothUnion(a, b, k[0]);
+                    break;
+                }
+                case OpCode::Difference: {
+                    Float a = d[ins.a], b = -d[ins.b];
+                    keep = below(b, a) ? Keep::A : below(a, b) ? Keep::B : Keep::Both;
+                    d[ins.out] = max(a, b);
+                    break;
+                }
+                case OpCode::SmoothDifference: {
+                    // The blend weight is clamped to 0 or 1 once the sum of the operands leaves [-k, k]
+                    Float a = d[ins.a], b = -d[ins.b];
+                    Float sum = a - b;
+                    keep = below(Float(k[0]), sum) ? Keep::A : below(sum, Float(-k[0])) ? Keep::B : Keep::Both;
+                    d[ins.out] = smoothMax(a, b, k[0]);
+                    break;
+                }
+                case OpCode::Intersection: {
+                    Float a = d[ins.a], b = d[ins.b];
+                    keep = below(b, a) ? Keep::A : below(a, b) ? Keep::B : Keep::Both;
+                    d[ins.out] = max(a, b);
+                    break;
+                }
+                case OpCode::SmoothIntersection: {
+                    // The blend weight is clamped to 0 or 1 once the operands are at least k apart
+                    Float a = d[ins.a], b = d[ins.b];
+                    keep = below(b, a, k[0]) ? Keep::A : below(a, b, k[0]) ? Keep::B : Keep::Both;
+                    d[ins.out] = smoothMax(a, b, k[0]);
+                    break;
+                }
+            }
+            if (pruning) {
+                pruning->keep[i] = keep;
+            }
+        }
+        return d[result];
+    }
+
+    Tape Tape::specialize(const AABB &region) const {
+        using Keep = Pruning::Keep;
+        Pruning pruning;
+        run(interval::Vec3(region), &pruning);
+
+        // Registers are reused along the tape, so their values are renamed back into values written once, which are
+        // allocated registers anew when the tape is built
+        TapeBuilder builder;
+        Tape &tape = builder.tape;
+        tape.constants = constants;
+        tape.calls = calls;
+        std::vector<std::uint32_t> distances(distanceRegisters), points(pointRegisters);
+        points[input] = TapeBuilder::Input;
+        // Instruction of this tape each instruction of the new one comes from
+        std::vector<std::size_t> origins;
+
+        for (std::size_t i = 0; i < code.size(); ++i) {
+            Instruction ins = code[i];
+            auto sig = signature(ins.op);
+            auto value = [&](Operand kind, std::uint32_t reg) {
+                return kind == Operand::Point ? points[reg] : distances[reg];
+            };
+            std::uint32_t a = sig.a == Operand::None ? 0 : value(sig.a, ins.a);
+            std::uint32_t b = sig.b == Operand::None ? ins.b : value(sig.b, ins.b);
+
+            if (pruning.keep[i] == Keep::A) {
+                distances[ins.out] = a;
+                continue;
+            }
+            if (pruning.keep[i] == Keep::B) {
+                if (ins.op == OpCode::Difference || ins.op == OpCode::SmoothDifference) {
+                    distances[ins.out] = builder.distance(OpCode::Scale, b, 0, {-1.0f});
+                    origins.push_back(i);
+                } else {
+                    distances[ins.out] = b;
+                }
+                continue;
+            }
+            ins.a = a;
+            ins.b = b;
+            auto &values = sig.out == Operand::Point ? points : distances;
+            values[ins.out] = sig.out == Operand::Point ? builder.pointValues++ : builder.distanceValues++;
+            ins.out = values[code[i].out];
+            tape.code.push_back(ins);
+            origins.push_back(i);
+        }
+        const std::uint32_t root = distances[result];
+
+        // Leave out everything the result no longer depends on, walking back from it
+        std::vector<bool> usedDistances(builder.distanceValues), usedPoints(builder.pointValues);
+        usedDistances[root] = true;
+        std::vector<Instruction> live;
+        std::vector<std::size_t> liveOrigins;
+        for (std::size_t i = tape.code.size(); i-- > 0;) {
+            const auto &ins = tape.code[i];
+            auto sig = signature(ins.op);
+            if (!(sig.out == Operand::Point ? usedPoints : usedDistances)[ins.out]) {
+                continue;
+            }
+            if (sig.a != Operand::None) (sig.a == Operand::Point ? usedPoints : usedDistances)[ins.a] = true;
+            if (sig.b != Operand::None) (sig.b == Operand::Point ? usedPoints : usedDistances)[ins.b] = true;
+            live.push_back(ins);
+            liveOrigins.push_back(origins[i]);
+        }
+        std::reverse(live.begin(), live.end());
+        std::reverse(liveOrigins.begin(), liveOrigins.end());
+        tape.code = std::move(live);
+
+        // Groups that are still used keep only the children that can affect them, each specialized in turn
+        for (std::size_t i = 0; i < tape.code.size(); ++i) {
+            auto &ins = tape.code[i];
+            if (ins.op != OpCode::Group) {
+                continue;
+            }
+            const Group &g = groups[ins.b];
+            const auto &children = pruning.children[liveOrigins[i]];
+            const AABB &box = pruning.regions[liveOrigins[i]];
+            Group pruned{{}, {}, g.smooth, g.k};
+            std::vector<AABB> bounds;
+            for (int child : children) {
+                bounds.push_back(g.bvh.bounds(child));
+                pruned.children.push_back(g.children[child].specialize(box));
+            }
+            pruned.bvh = BVH(bounds);
+            ins.b = static_cast<std::uint32_t>(tape.groups.size());
+            tape.groups.push_back(std::move(pruned));
+        }
+        return builder.build(root);
+    }
+}
+
+#endif //PROJECT_SPECIALIZE_H
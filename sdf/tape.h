@@ -0,0 +1,616 @@
+#ifndef PROJECT_TAPE_H
+#define PROJECT_TAPE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtx/vec_swizzle.hpp>
+#include "dual.h"
+#include "interval.h"
+#include "simd.h"
+#include "../bvh.h"
+
+/***
+ * Flat instruction tapes for evaluating CSG trees without walking the tree.
+ * @details
+ * A finished tree is lowered once into a linear list of register based instructions. Evaluating the tape is a single
+ * loop over that list, avoiding the pointer chasing and virtual dispatch of Node::signedDistance.
+ */
+namespace sdf {
+
+    namespace ops {
+        std::pair<float, float> sminN(float a, float b, float k, float n);
+
+        /**
+         * Visit the objects of a BVH nearest first, skipping those whose bounds show they cannot come within `margin` of
+         * the smallest distance found so far. Unbounded objects are always visited, empty ones never.
+         * @details
+         * Unlike BVH::traverse, the distance to the bounds of a node is computed once and kept on the stack, as it is
+         * about as expensive as evaluating a simple object.
+         * @param visit Evaluates the signed distance of an object at p
+         * @return Smallest distance of all visited objects
+         */
+        template<class Visit>
+        float visitUnion(const BVH &bvh, float margin, const glm::vec3 &p, Visit &&visit) {
+            float min = std::numeric_limits<float>::infinity();
+            for (int object : bvh.getUnbounded()) {
+                min = glm::min(min, visit(object));
+            }
+            const auto &nodes = bvh.getNodes();
+            if (nodes.empty()) {
+                return min;
+            }
+
+            std::pair<int, float> stack[64];
+            int top = 0;
+            stack[top++] = {0, nodes[0].box.signedDistance(p)};
+            while (top > 0) {
+                auto[index, b] = stack[--top];
+                if (!(b < min + margin)) {
+                    continue;
+                }
+                const auto &node = nodes[index];
+                if (node.object >= 0) {
+                    min = glm::min(min, visit(node.object));
+                    continue;
+                }
+                // Push the farther child first so the nearer one is entered first
+                float left = nodes[node.left].box.signedDistance(p);
+                float right = nodes[node.right].box.signedDistance(p);
+                if (left < right) {
+                    stack[top++] = {node.right, right};
+                    stack[top++] = {node.left, left};
+                } else {
+                    stack[top++] = {node.left, left};
+                    stack[top++] = {node.right, right};
+                }
+            }
+            return min;
+        }
+
+        /**
+         * Blend distances given in increasing order like a chain of smooth unions, stopping at the first one that is at
+         * least `k` further away than the nearest and therefore would not contribute.
+         */
+        inline float blendSorted(const float *d, std::size_t n, float k) {
+            float result = d[0];
+            for (std::size_t i = 1; i < n && d[i] < d[0] + k; ++i) {
+                result = sminN(result, d[i], k, 3).first;
+            }
+            return result;
+        }
+
+        /**
+         * Distance of the union of the objects of a BVH, evaluating only those that can affect it.
+         * @details
+         * Smooth unions blend the objects in order of increasing distance, so the result does not depend on the order
+         * the objects are visited in.
+         * @param distance Evaluates the signed distance of an object at p
+         */
+        template<class Distance>
+        float unionN(const BVH &bvh, bool smooth, float k, const glm::vec3 &p, Distance &&distance) {
+            if (!smooth) {
+                return visitUnion(bvh, 0.0f, p, distance);
+            }
+            std::byte buffer[256];
+            std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+            std::pmr::vector<float> candidates(&arena);
+            visitUnion(bvh, k, p, [&](int object) {
+                candidates.push_back(distance(object));
+                return candidates.back();
+            });
+            if (candidates.empty()) {
+                return std::numeric_limits<float>::infinity();
+            }
+            std::sort(candidates.begin(), candidates.end());
+            return blendSorted(candidates.data(), candidates.size(), k);
+        }
+
+        /**
+         * unionN on dual numbers. Objects are located with their plain distances first, so only those that contribute
+         * to the result are differentiated.
+         * @param distance Evaluates the signed distance of an object at the value of p
+         * @param dualDistance Evaluates the signed distance and gradient of an object at p
+         */
+        template<class Distance, class DualDistance>
+        dual::Float unionN(const BVH &bvh, bool smooth, float k, const dual::Vec3 &p, Distance &&distance,
+                           DualDistance &&dualDistance) {
+            std::byte buffer[512];
+            std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+            std::pmr::vector<std::pair<float, int>> candidates(&arena);
+            visitUnion(bvh, smooth ? k : 0.0f, p.value(), [&](int object) {
+                candidates.emplace_back(distance(object), object);
+                return candidates.back().first;
+            });
+            if (candidates.empty()) {
+                return std::numeric_limits<float>::infinity();
+            }
+            if (!smooth) {
+                return dualDistance(std::min_element(candidates.begin(), candidates.end())->second);
+            }
+            std::sort(candidates.begin(), candidates.end());
+            // Same blend as blendSorted
+            dual::Float result = dualDistance(candidates.front().second);
+            for (std::size_t i = 1; i < candidates.size() && candidates[i].first < candidates.front().first + k; ++i) {
+                result = dual::smoothUnion(result, dualDistance(candidates[i].second), k);
+            }
+            return result;
+        }
+    }
+
+    enum class OpCode : std::uint8_t {
+        // Leaves
+        Constant,
+        Call,
+        Group,
+        Sphere,
+        Plane,
+        Torus,
+        Box,
+        Triangle,
+        // Point transformations
+        Transform,
+        Elongate,
+        // Distance operations
+        Scale,
+        ElongateCorrect,
+        Round,
+        Onion,
+        Union,
+        SmoothUnion,
+        Difference,
+        SmoothDifference,
+        Intersection,
+        SmoothIntersection,
+    };
+
+    /* Kind of register an instruction operand refers to. */
+    enum class Operand : std::uint8_t {
+        None,
+        Point,
+        Distance
+    };
+
+    /* Which register files the output and both operands of an instruction refer to. */
+    struct Signature {
+        Operand out, a, b;
+    };
+
+    constexpr Signature signature(OpCode op) {
+        switch (op) {
+            case OpCode::Constant:
+                return {Operand::Distance, Operand::None, Operand::None};
+            case OpCode::Call:
+            case OpCode::Group:
+            case OpCode::Sphere:
+            case OpCode::Plane:
+            case OpCode::Torus:
+            case OpCode::Box:
+            case OpCode::Triangle:
+                return {Operand::Distance, Operand::Point, Operand::None};
+            case OpCode::Transform:
+            case OpCode::Elongate:
+                return {Operand::Point, Operand::Point, Operand::None};
+            case OpCode::Scale:
+            case OpCode::Round:
+            case OpCode::Onion:
+                return {Operand::Distance, Operand::Distance, Operand::None};
+            case OpCode::ElongateCorrect:
+                return {Operand::Distance, Operand::Distance, Operand::Point};
+            default:
+                return {Operand::Distance, Operand::Distance, Operand::Distance};
+        }
+    }
+
+    /**
+     * A single tape instruction. Parameters are stored in the constant pool of the tape, starting at `param`.
+     * Call and Group instructions keep the index of the called node or group in `b`.
+     */
+    struct Instruction {
+        OpCode op;
+        std::uint32_t out = 0;
+        std::uint32_t a = 0;
+        std::uint32_t b = 0;
+        std::uint32_t param = 0;
+    };
+
+    /* Compiled, distance-only representation of a CSG tree. */
+    class Tape {
+    public:
+        Tape() = default;
+
+        /* Compile the CSG tree rooted at the given node. */
+        static Tape compile(Node &root);
+
+        /* Evaluate the compiled SDF at a given point, yielding a distance value. */
+        [[nodiscard]] float signedDistance(const glm::vec3 &p) const {
+            if (distanceRegisters <= MaxStackRegisters && pointRegisters <= MaxStackRegisters) {
+                float d[MaxStackRegisters];
+                glm::vec3 q[MaxStackRegisters];
+                return run(p, d, q);
+            }
+            thread_local std::vector<float> d;
+            thread_local std::vector<glm::vec3> q;
+            d.resize(distanceRegisters);
+            q.resize(pointRegisters);
+            return run(p, d.data(), q.data());
+        }
+
+        /**
+         * Evaluate the compiled SDF at `n` points given as separate coordinate arrays, writing one distance per point.
+         * @details
+         * Points are evaluated simd::Width at a time. Defined in batch.h.
+         */
+        void signedDistances(const float *x, const float *y, const float *z, float *out, std::size_t n) const;
+
+        /**
+         * Copy of the tape that yields the same distances within a box, up to rounding, leaving out the operands of
+         * every operation that cannot affect the result there, such as a union branch lying above the other one.
+         * @details
+         * Defined in specialize.h.
+         */
+        [[nodiscard]] Tape specialize(const AABB &region) const;
+
+        /* Number of instructions on the tape. */
+        [[nodiscard]] std::size_t size() const {
+            return code.size();
+        }
+
+        [[nodiscard]] bool empty() const {
+            return code.empty();
+        }
+
+    private:
+        friend class TapeBuilder;
+
+        struct Group;
+
+        static constexpr std::uint32_t MaxStackRegisters = 32;
+
+        std::vector<Instruction> code;
+        std::vector<float> constants;
+        // Nodes without a lowering of their own. Owned by the tree the tape was compiled from.
+        std::vector<Node *> calls;
+        std::vector<Group> groups;
+
+        std::uint32_t input = 0;
+        std::uint32_t result = 0;
+        std::uint32_t distanceRegisters = 0;
+        std::uint32_t pointRegisters = 0;
+
+        float run(const glm::vec3 &p, float *d, glm::vec3 *q) const;
+        simd::Float run(const simd::Vec3 &p, simd::Float *d, simd::Vec3 *q) const;
+
+        // Evaluate a tape from within another one, leaving the thread local registers of the outer one alone.
+        float runNested(const glm::vec3 &p) const;
+        simd::Float runNested(const simd::Vec3 &p) const;
+
+        float group(const Group &g, const glm::vec3 &p) const;
+        simd::Float group(const Group &g, const simd::Vec3 &p) const;
+
+        struct Pruning;
+
+        interval::Float run(const interval::Vec3 &p, Pruning *pruning) const;
+        interval::Float group(const Group &g, const interval::Vec3 &p, std::vector<int> *kept) const;
+    };
+
+    /* Union of several nodes, each compiled into a tape of its own and visited through a BVH over their bounds. */
+    struct Tape::Group {
+        BVH bvh;
+        std::vector<Tape> children;
+        bool smooth = false;
+        float k = 0;
+    };
+
+    /**
+     * Lowers CSG trees into tapes.
+     * @details
+     * Nodes emit instructions into value slots that are each written exactly once. Identical (node, point) pairs are
+     * emitted only once, so subtrees shared between several parents are evaluated once per tape evaluation.
+     * When the tape is built, the value slots are packed into as few registers as their lifetimes allow.
+     */
+    class TapeBuilder {
+    public:
+        TapeBuilder() = default;
+
+        /* Point value holding the point a tape is evaluated at. */
+        static constexpr std::uint32_t Input = 0;
+
+        /* Emit the instructions evaluating `node` at the point held in `at`, returning the distance value. */
+        std::uint32_t emit(Node &node, std::uint32_t at) {
+            auto key = std::make_pair(&node, at);
+            auto it = emitted.find(key);
+            if (it != emitted.end()) {
+                return it->second;
+            }
+            std::uint32_t value = node.compile(*this, at);
+            emitted.emplace(key, value);
+            return value;
+        }
+
+        /* Append an instruction producing a new distance value. */
+        std::uint32_t distance(OpCode op, std::uint32_t a = 0, std::uint32_t b = 0,
+                               std::initializer_list<float> params = {}) {
+            std::uint32_t out = distanceValues++;
+            append(op, out, a, b, params);
+            return out;
+        }
+
+        /* Append an instruction producing a new point value. */
+        std::uint32_t point(OpCode op, std::uint32_t a, std::initializer_list<float> params = {}) {
+            std::uint32_t out = pointValues++;
+            append(op, out, a, 0, params);
+            return out;
+        }
+
+        /**
+         * Append the union of several nodes evaluated as a unit, visiting only the ones near the point.
+         * @param bvh Hierarchy over the bounds of the children
+         * @param smooth Whether to blend the children with smoothness `k`, see ops::unionN
+         */
+        std::uint32_t group(const std::vector<std::shared_ptr<Node>> &children, const BVH &bvh, bool smooth, float k,
+                            std::uint32_t at) {
+            Tape::Group g{bvh, std::vector<Tape>(children.size()), smooth, k};
+            // Children compile independently, which adds up for groups of thousands of objects
+            #pragma omp parallel for schedule(dynamic, 64) if (children.size() >= 1024)
+            for (std::size_t i = 0; i < children.size(); ++i) {
+                g.children[i] = Tape::compile(*children[i]);
+            }
+            auto index = static_cast<std::uint32_t>(tape.groups.size());
+            tape.groups.push_back(std::move(g));
+            return distance(OpCode::Group, at, index);
+        }
+
+        /* Append a call back into the tree for nodes that cannot be lowered. */
+        std::uint32_t call(Node &node, std::uint32_t at) {
+            auto index = static_cast<std::uint32_t>(tape.calls.size());
+            tape.calls.push_back(&node);
+            return distance(OpCode::Call, at, index);
+        }
+
+        /* Finish the tape, with `root` as the resulting distance. */
+        Tape build(std::uint32_t root);
+
+    private:
+        friend class Tape;
+
+        Tape tape;
+        std::map<std::pair<Node *, std::uint32_t>, std::uint32_t> emitted;
+        std::uint32_t distanceValues = 0;
+        std::uint32_t pointValues = 1;
+
+        void append(OpCode op, std::uint32_t out, std::uint32_t a, std::uint32_t b,
+                    std::initializer_list<float> params) {
+            auto offset = static_cast<std::uint32_t>(tape.constants.size());
+            tape.constants.insert(tape.constants.end(), params.begin(), params.end());
+            tape.code.push_back({op, out, a, b, offset});
+        }
+    };
+
+    // Nodes without a lowering of their own are called back through the tree.
+    std::uint32_t Node::compile(TapeBuilder &builder, std::uint32_t point) {
+        return builder.call(*this, point);
+    }
+
+    std::uint32_t Empty::compile(TapeBuilder &builder, std::uint32_t point) {
+        return builder.distance(OpCode::Constant, 0, 0, {std::numeric_limits<float>::infinity()});
+    }
+
+    Tape Tape::compile(Node &root) {
+        TapeBuilder builder;
+        std::uint32_t result = builder.emit(root, TapeBuilder::Input);
+        return builder.build(result);
+    }
+
+    // Linear scan register allocation. Values are live from their definition to their last use.
+    Tape TapeBuilder::build(std::uint32_t root) {
+        const std::size_t n = tape.code.size();
+        std::vector<std::size_t> lastDistanceUse(distanceValues, 0);
+        std::vector<std::size_t> lastPointUse(pointValues, 0);
+
+        auto lastUse = [&](Operand kind) -> std::vector<std::size_t> & {
+            return kind == Operand::Point ? lastPointUse : lastDistanceUse;
+        };
+
+        for (std::size_t i = 0; i < n; ++i) {
+            const auto &ins = tape.code[i];
+            auto sig = signature(ins.op);
+            lastUse(sig.out)[ins.out] = i;
+            if (sig.a != Operand::None) lastUse(sig.a)[ins.a] = i;
+            if (sig.b != Operand::None) lastUse(sig.b)[ins.b] = i;
+        }
+        lastDistanceUse[root] = n;
+
+        struct RegisterFile {
+            std::vector<std::uint32_t> assigned;
+            std::vector<std::uint32_t> free;
+            std::uint32_t count = 0;
+
+            std::uint32_t allocate(std::uint32_t value) {
+                std::uint32_t reg;
+                if (free.empty()) {
+                    reg = count++;
+                } else {
+                    reg = free.back();
+                    free.pop_back();
+                }
+                assigned[value] = reg;
+                return reg;
+            }
+        };
+
+        constexpr auto unassigned = std::numeric_limits<std::uint32_t>::max();
+        RegisterFile distances{std::vector<std::uint32_t>(distanceValues, unassigned)};
+        RegisterFile points{std::vector<std::uint32_t>(pointValues, unassigned)};
+        auto file = [&](Operand kind) -> RegisterFile & {
+            return kind == Operand::Point ? points : distances;
+        };
+
+        tape.input = points.allocate(Input);
+
+        for (std::size_t i = 0; i < n; ++i) {
+            auto &ins = tape.code[i];
+            auto sig = signature(ins.op);
+
+            // Operands are read before the output is written, so registers freed here may be reused by the output.
+            std::uint32_t operands[2] = {ins.a, ins.b};
+            Operand kinds[2] = {sig.a, sig.b};
+            for (int j = 0; j < 2; ++j) {
+                if (kinds[j] == Operand::None) continue;
+                auto &regs = file(kinds[j]);
+                std::uint32_t reg = regs.assigned[operands[j]];
+                if (lastUse(kinds[j])[operands[j]] == i && (j == 0 || kinds[0] != kinds[1] || operands[0] != operands[1])) {
+                    regs.free.push_back(reg);
+                }
+                (j == 0 ? ins.a : ins.b) = reg;
+            }
+
+            auto &regs = file(sig.out);
+            std::uint32_t value = ins.out;
+            ins.out = regs.assigned[value] == unassigned ? regs.allocate(value) : regs.assigned[value];
+            if (lastUse(sig.out)[value] == i) {
+                regs.free.push_back(ins.out);
+            }
+        }
+
+        tape.result = distances.assigned[root];
+        tape.distanceRegisters = distances.count;
+        tape.pointRegisters = points.count;
+        return std::move(tape);
+    }
+
+    float Tape::runNested(const glm::vec3 &p) const {
+        if (distanceRegisters <= MaxStackRegisters && pointRegisters <= MaxStackRegisters) {
+            float d[MaxStackRegisters];
+            glm::vec3 q[MaxStackRegisters];
+            return run(p, d, q);
+        }
+        std::vector<float> d(distanceRegisters);
+        std::vector<glm::vec3> q(pointRegisters);
+        return run(p, d.data(), q.data());
+    }
+
+    float Tape::group(const Group &g, const glm::vec3 &p) const {
+        return ops::unionN(g.bvh, g.smooth, g.k, p, [&](int child) {
+            return g.children[child].runNested(p);
+        });
+    }
+
+    float Tape::run(const glm::vec3 &p, float *d, glm::vec3 *q) const {
+        const float *c = constants.data();
+        q[input] = p;
+
+        for (const auto &ins : code) {
+            const float *k = c + ins.param;
+            switch (ins.op) {
+                case OpCode::Constant:
+                    d[ins.out] = k[0];
+                    break;
+                case OpCode::Call:
+                    d[ins.out] = calls[ins.b]->signedDistance(q[ins.a]);
+                    break;
+                case OpCode::Group:
+                    d[ins.out] = group(groups[ins.b], q[ins.a]);
+                    break;
+                case OpCode::Sphere:
+                    d[ins.out] = glm::length(q[ins.a]) - k[0];
+                    break;
+                case OpCode::Plane:
+                    d[ins.out] = glm::dot(q[ins.a], glm::vec3(k[0], k[1], k[2])) + k[3];
+                    break;
+                case OpCode::Torus: {
+                    const glm::vec3 &x = q[ins.a];
+                    glm::vec2 t = glm::vec2(glm::length(glm::xz(x)) - k[0], x.y);
+                    d[ins.out] = glm::length(t) - k[1];
+                    break;
+                }
+                case OpCode::Box: {
+                    glm::vec3 t = glm::abs(q[ins.a]) - glm::vec3(k[0], k[1], k[2]);
+                    d[ins.out] = glm::length(glm::max(t, 0.0f)) + glm::min(glm::max(t.x, glm::max(t.y, t.z)), 0.0f);
+                    break;
+                }
+                case OpCode::Triangle: {
+                    auto v = [k](int i) { return glm::vec3(k[3 * i], k[3 * i + 1], k[3 * i + 2]); };
+                    const glm::vec3 &x = q[ins.a];
+                    glm::vec3 p0 = x - v(0), p1 = x - v(1), p2 = x - v(2);
+                    glm::vec3 e0 = v(3), e1 = v(4), e2 = v(5);
+                    glm::vec3 n = v(9);
+                    float val;
+                    if ((glm::sign(glm::dot(v(6), p0)) +
+                         glm::sign(glm::dot(v(7), p1)) +
+                         glm::sign(glm::dot(v(8), p2))) < 2.0) {
+                        val = glm::min(
+                                glm::min(
+                                        glm::length(e0 * glm::clamp(glm::dot(e0, p0) * k[30], 0.0f, 1.0f) - p0),
+                                        glm::length(e1 * glm::clamp(glm::dot(e1, p1) * k[31], 0.0f, 1.0f) - p1)
+                                ),
+                                glm::length(e2 * glm::clamp(glm::dot(e2, p2) * k[32], 0.0f, 1.0f) - p2)
+                        );
+                    } else {
+                        val = glm::sqrt(glm::dot(n, p0) * glm::dot(n, p0) * k[33]);
+                    }
+                    d[ins.out] = val - 0.001f;
+                    break;
+                }
+                case OpCode::Transform: {
+                    const glm::vec3 &x = q[ins.a];
+                    q[ins.out] = glm::vec3(k[0], k[1], k[2]) * x.x
+                                 + glm::vec3(k[3], k[4], k[5]) * x.y
+                                 + glm::vec3(k[6], k[7], k[8]) * x.z
+                                 + glm::vec3(k[9], k[10], k[11]);
+                    break;
+                }
+                case OpCode::Elongate: {
+                    const glm::vec3 &x = q[ins.a];
+                    glm::vec3 t = glm::abs(x) - glm::vec3(k[0], k[1], k[2]);
+                    q[ins.out] = glm::sign(x) * glm::max(t, 0.0f);
+                    break;
+                }
+                case OpCode::Scale:
+                    d[ins.out] = d[ins.a] * k[0];
+                    break;
+                case OpCode::ElongateCorrect: {
+                    glm::vec3 t = glm::abs(q[ins.b]) - glm::vec3(k[0], k[1], k[2]);
+                    d[ins.out] = d[ins.a] + glm::min(glm::max(t.x, glm::max(t.y, t.z)), 0.0f);
+                    break;
+                }
+                case OpCode::Round:
+                    d[ins.out] = d[ins.a] - k[0];
+                    break;
+                case OpCode::Onion:
+                    d[ins.out] = glm::abs(d[ins.a]) - k[0];
+                    break;
+                case OpCode::Union:
+                    d[ins.out] = glm::min(d[ins.a], d[ins.b]);
+                    break;
+                case OpCode::SmoothUnion:
+                    d[ins.out] = ops::sminN(d[ins.a], d[ins.b], k[0], 3).first;
+                    break;
+                case OpCode::Difference:
+                    d[ins.out] = glm::max(-d[ins.b], d[ins.a]);
+                    break;
+                case OpCode::SmoothDifference: {
+                    float a = d[ins.a], b = d[ins.b], r = k[0];
+                    float h = glm::clamp(0.5f - 0.5f * (a + b) / r, 0.0f, 1.0f);
+                    d[ins.out] = glm::mix(a, -b, h) + r * h * (1.0f - h);
+                    break;
+                }
+                case OpCode::Intersection:
+                    d[ins.out] = glm::max(d[ins.a], d[ins.b]);
+                    break;
+                case OpCode::SmoothIntersection: {
+                    float a = d[ins.a], b = d[ins.b], r = k[0];
+                    float h = glm::clamp(0.5f - 0.5f * (a - b) / r, 0.0f, 1.0f);
+                    d[ins.out] = glm::mix(a, b, h) + r * h * (1.0f - h);
+                    break;
+                }
+            }
+        }
+        return d[result];
+    }
+}
+
+#endif //PROJECT_TAPE_H
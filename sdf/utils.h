@@ -44,15 +44,47 @@ namespace sdf::utils {
         return std::make_shared<Empty>();
     }
 
+    /* Append the operands of `node` if it is a hard union, or `node` itself otherwise. */
+    static void appendUnionOperands(const std::shared_ptr<Node> &node, std::vector<std::shared_ptr<Node>> &operands) {
+        if (auto n = std::dynamic_pointer_cast<sdf::ops::UnionN>(node); n && !n->isSmooth()) {
+            operands.insert(operands.end(), n->getChildren().begin(), n->getChildren().end());
+        } else if (auto u = std::dynamic_pointer_cast<sdf::ops::Union>(node); u && !u->isSmooth()) {
+            operands.push_back(u->getLeftChild());
+            operands.push_back(u->getRightChild());
+        } else {
+            operands.push_back(node);
+        }
+    }
+
+    /**
+     * Union of two nodes, flattening chains of hard unions into a single sdf::ops::UnionN. Smooth unions stay nested,
+     * as blending is not associative and regrouping a chain of them would change its shape.
+     */
+    static std::shared_ptr<Node> makeUnion(const std::shared_ptr<Node> &a, const std::shared_ptr<Node> &b,
+                                           bool smooth = false, float k = 0.1f) {
+        if (smooth) {
+            return Builder<sdf::ops::Union>(a, b, smooth, k).asNode();
+        }
+        std::vector<std::shared_ptr<Node>> operands;
+        appendUnionOperands(a, operands);
+        appendUnionOperands(b, operands);
+        if (operands.size() == 2) {
+            return Builder<sdf::ops::Union>(a, b).asNode();
+        }
+        return Builder<sdf::ops::UnionN>(std::move(operands)).asNode();
+    }
+
     /**
      * Obtain the Union of two CSG trees. (Commutative)
      * @details
      * Depending on whether one of the nodes is an instance of sdf::ops::Round, i.e. a Node with a rounding operation
      * applied to it, the operation will remove the operation from the tree and apply the rounding in the union
      * node with the same amount as used in the original rounding operation.
+     * Chained hard unions are collected into a single sdf::ops::UnionN, which only evaluates the operands near the
+     * point being sampled.
      */
     template<class A, class B>
-    std::shared_ptr<sdf::ops::Union>
+    std::shared_ptr<Node>
     operator+(const std::shared_ptr<A> &a, const std::shared_ptr<B> &b) requires std::is_base_of_v<Node, A> &&
                                                                                  std::is_base_of_v<Node, B> {
         if constexpr (std::is_same_v<sdf::ops::Round, A> && std::is_same_v<sdf::ops::Round, B>) {
@@ -60,17 +92,17 @@ namespace sdf::utils {
             float factorA = a->getRadius();
             auto childB = b->getChild();
             float factorB = b->getRadius();
-            return Builder<sdf::ops::Union>(childA, childB, true, factorA + factorB).asNode();
+            return makeUnion(childA, childB, true, factorA + factorB);
         } else if constexpr (std::is_same_v<sdf::ops::Round, A>) {
             auto child = a->getChild();
             float factor = a->getRadius();
-            return Builder<sdf::ops::Union>(child, b, true, factor).asNode();
+            return makeUnion(child, b, true, factor);
         } else if constexpr (std::is_same_v<sdf::ops::Round, B>) {
             auto child = b->getChild();
             float factor = b->getRadius();
-            return Builder<sdf::ops::Union>(a, child, true, factor).asNode();
+            return makeUnion(a, child, true, factor);
         }
-        return Builder<sdf::ops::Union>(a, b).asNode();
+        return makeUnion(a, b);
     }
 
     /**
@@ -158,7 +190,7 @@ namespace sdf::utils {
      * @param amount How much the object should be rounded
      */
     std::shared_ptr<Node> operator%=(const std::shared_ptr<Node> &a, float amount) {
-        return a % amount;
+        return Builder<sdf::ops::Round>(a, amount, false).asNode();
     }
 }
 
@@ -0,0 +1,183 @@
+#ifndef PROJECT_STATISTICS_H
+#define PROJECT_STATISTICS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "framebuffer.h"
+
+/* Work done for a single pixel, over all rays traced for it. */
+struct PixelStats {
+    // Steps marching the primary ray and all reflected and refracted rays
+    std::uint32_t steps = 0;
+    // Distance evaluations of single objects, from distance caches or exact
+    std::uint32_t evaluations = 0;
+    std::uint32_t shadowSteps = 0;
+    // Deepest level of reflection or refraction reached, 0 if only the primary ray was traced
+    std::uint32_t depth = 0;
+    // Primary rays traced through the pixel, more than one where it was anti-aliased
+    std::uint32_t samples = 0;
+    // Whether any ray ran out of steps, or passed maxRaymarchDist without a hit
+    bool exhausted = false;
+    bool distanceLimit = false;
+
+    /* Add the work of another sample of the same pixel. */
+    void add(const PixelStats &other) {
+        steps += other.steps;
+        evaluations += other.evaluations;
+        shadowSteps += other.shadowSteps;
+        depth = std::max(depth, other.depth);
+        samples += other.samples;
+        exhausted |= other.exhausted;
+        distanceLimit |= other.distanceLimit;
+    }
+};
+
+/* False color for a value between 0 and 1, from dark blue through green to dark red. Polynomial fit of Turbo. */
+inline glm::vec3 heatmapColor(float x) {
+    x = glm::clamp(x, 0.0f, 1.0f);
+    float x2 = x * x, x3 = x2 * x, x4 = x2 * x2, x5 = x4 * x;
+    return glm::clamp(glm::vec3{
+            0.13572138f + 4.61539260f * x - 42.66032258f * x2 + 132.13108234f * x3 - 152.94239396f * x4
+            + 59.28637943f * x5,
+            0.09140261f + 2.19418839f * x + 4.84296658f * x2 - 14.18503333f * x3 + 4.27729857f * x4
+            + 2.82956604f * x5,
+            0.10667330f + 12.64194608f * x - 60.58204836f * x2 + 110.36276771f * x3 - 89.90310912f * x4
+            + 27.34824973f * x5}, 0.0f, 1.0f);
+}
+
+/**
+ * Per pixel statistics of a frame, with heatmaps, totals and histograms of them.
+ * @details
+ * Heatmaps of counts are scaled to the largest count of the frame, which the summary reports.
+ */
+class PixelStatistics {
+public:
+    PixelStatistics() = default;
+
+    PixelStatistics(int width, int height) : w(width), h(height), pixels(static_cast<std::size_t>(width) * height) {}
+
+    [[nodiscard]] int width() const {
+        return w;
+    }
+
+    [[nodiscard]] int height() const {
+        return h;
+    }
+
+    [[nodiscard]] PixelStats &at(int x, int y) {
+        return pixels[static_cast<std::size_t>(y) * w + x];
+    }
+
+    [[nodiscard]] const PixelStats &at(int x, int y) const {
+        return pixels[static_cast<std::size_t>(y) * w + x];
+    }
+
+    void clear() {
+        std::fill(pixels.begin(), pixels.end(), PixelStats{});
+    }
+
+    [[nodiscard]] Framebuffer heatmap(std::uint32_t PixelStats::*field) const {
+        float scale = 1.0f / static_cast<float>(std::max<std::uint32_t>(maximum(field), 1));
+        Framebuffer image(w, h);
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                image.set(x, y, heatmapColor(static_cast<float>(at(x, y).*field) * scale));
+            }
+        }
+        return image;
+    }
+
+    /* Pixels with a ray out of steps in red, and with a ray past the distance limit in blue. */
+    [[nodiscard]] Framebuffer limits() const {
+        Framebuffer image(w, h);
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                image.set(x, y, {at(x, y).exhausted ? 1 : 0, 0, at(x, y).distanceLimit ? 1 : 0});
+            }
+        }
+        return image;
+    }
+
+    /**
+     * Write the heatmaps of all statistics as images named after the given prefix, like `prefix_steps.png`.
+     * @return False if an image could not be written
+     */
+    bool saveHeatmaps(const std::string &prefix, const std::string &extension = ".png") const {
+        return heatmap(&PixelStats::steps).save(prefix + "_steps" + extension)
+               && heatmap(&PixelStats::evaluations).save(prefix + "_evaluations" + extension)
+               && heatmap(&PixelStats::shadowSteps).save(prefix + "_shadow" + extension)
+               && heatmap(&PixelStats::depth).save(prefix + "_depth" + extension)
+               && heatmap(&PixelStats::samples).save(prefix + "_samples" + extension)
+               && limits().save(prefix + "_limits" + extension);
+    }
+
+    [[nodiscard]] std::uint64_t total(std::uint32_t PixelStats::*field) const {
+        std::uint64_t sum = 0;
+        for (auto &pixel : pixels) {
+            sum += pixel.*field;
+        }
+        return sum;
+    }
+
+    [[nodiscard]] std::uint32_t maximum(std::uint32_t PixelStats::*field) const {
+        std::uint32_t max = 0;
+        for (auto &pixel : pixels) {
+            max = std::max(max, pixel.*field);
+        }
+        return max;
+    }
+
+    [[nodiscard]] std::uint64_t count(bool PixelStats::*flag) const {
+        return static_cast<std::uint64_t>(std::count_if(pixels.begin(), pixels.end(), [&](const PixelStats &p) {
+            return p.*flag;
+        }));
+    }
+
+    /**
+     * Number of pixels per range of values, in ranges of equal width from 0 up to the maximum. Uses one range per
+     * value if there are fewer values than `bins`.
+     */
+    [[nodiscard]] std::vector<std::uint64_t> histogram(std::uint32_t PixelStats::*field, int bins = 16) const {
+        std::uint64_t values = static_cast<std::uint64_t>(maximum(field)) + 1;
+        std::vector<std::uint64_t> counts(std::min<std::uint64_t>(bins, values));
+        for (auto &pixel : pixels) {
+            ++counts[static_cast<std::uint64_t>(pixel.*field) * counts.size() / values];
+        }
+        return counts;
+    }
+
+    /* Totals, maxima and histograms of all statistics as JSON. */
+    void writeSummary(std::ostream &out, int bins = 16) const {
+        const std::pair<const char *, std::uint32_t PixelStats::*> fields[] = {
+                {"steps",       &PixelStats::steps},
+                {"evaluations", &PixelStats::evaluations},
+                {"shadowSteps", &PixelStats::shadowSteps},
+                {"depth",       &PixelStats::depth},
+                {"samples",     &PixelStats::samples},
+        };
+        out << "{\n  \"width\": " << w << ",\n  \"height\": " << h << ",\n";
+        for (auto &[name, field] : fields) {
+            auto counts = histogram(field, bins);
+            out << "  \"" << name << "\": {\"total\": " << total(field) << ", \"max\": " << maximum(field)
+                << ", \"binWidth\": " << static_cast<double>(maximum(field) + 1) / static_cast<double>(counts.size())
+                << ", \"histogram\": [";
+            for (std::size_t i = 0; i < counts.size(); ++i) {
+                out << (i > 0 ? ", " : "") << counts[i];
+            }
+            out << "]},\n";
+        }
+        out << "  \"exhausted\": " << count(&PixelStats::exhausted) << ",\n"
+            << "  \"distanceLimit\": " << count(&PixelStats::distanceLimit) << "\n}\n";
+    }
+
+private:
+    int w = 0;
+    int h = 0;
+    std::vector<PixelStats> pixels;
+};
+
+#endif //PROJECT_STATISTICS_H